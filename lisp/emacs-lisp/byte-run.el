@@ -448,6 +448,31 @@ is enabled."
   ;; The implementation for the interpreter is basically trivial.
   (car (last body)))
 
+(defvar byte-compile-warnings)
+(defvar byte-compile-debug)
+
+(defun internal--compile-interpreted-functions ()
+  "Compile the functions in `internal--interpreted-functions-to-compile'.
+Each compiled function runs in place of the interpreted one from then
+on.  Stop when there is input.  Emacs calls this whenever it is idle;
+see `interpreted-function-compile-threshold'."
+  (require 'bytecomp)
+  (while (and internal--interpreted-functions-to-compile
+              (not (input-pending-p)))
+    (let ((fun (car internal--interpreted-functions-to-compile)))
+      (setq internal--interpreted-functions-to-compile
+            (cdr internal--interpreted-functions-to-compile))
+      (let ((compiled
+             (condition-case nil
+                 (let ((lexical-binding (eq (car fun) 'closure))
+                       (byte-compile-warnings nil)
+                       ;; Let errors reach us instead of being reported.
+                       (byte-compile-debug t))
+                   (byte-compile (byte-compile--reify-function fun)))
+               (error nil))))
+        (internal--set-compiled-definition
+         fun (and (byte-code-function-p compiled) compiled))))))
+
 
 ;; I nuked this because it's not a good idea for users to think of using it.
 ;; These options are a matter of installation preference, and have nothing to
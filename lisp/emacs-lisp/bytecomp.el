@@ -556,7 +556,10 @@ Each element is (INDEX . VALUE)")
 (byte-defop  50 -1 byte-pushcatch)
 (byte-defop  49 -1 byte-pushconditioncase)
 
-;; unused: 51-55
+;; Suspends the coroutine running the code; see `coroutine-yield'.
+(byte-defop  51  0 byte-yield)
+
+;; unused: 52-55
 
 (byte-defop  56 -1 byte-nth)
 (byte-defop  57  0 byte-symbolp)
@@ -3265,6 +3268,7 @@ If it is nil, then the handler is \"byte-compile-SYMBOL.\""
 (byte-defop-compiler symbol-function	1)
 (byte-defop-compiler (1+ byte-add1)	1)
 (byte-defop-compiler (1- byte-sub1)	1)
+(byte-defop-compiler (coroutine-yield byte-yield) 1)
 (byte-defop-compiler goto-char		1)
 (byte-defop-compiler char-after		0-1)
 (byte-defop-compiler set-buffer		1)
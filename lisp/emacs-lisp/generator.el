@@ -0,0 +1,194 @@
+;;; generator.el --- generators  -*- lexical-binding: t -*-
+
+;; Copyright (C) 2014 Free Software Foundation, Inc.
+
+;; Maintainer: emacs-devel@gnu.org
+;; Keywords: extensions, elisp
+;; Package: emacs
+
+;; This file is part of GNU Emacs.
+
+;; GNU Emacs is free software: you can redistribute it and/or modify
+;; it under the terms of the GNU General Public License as published by
+;; the Free Software Foundation, either version 3 of the License, or
+;; (at your option) any later version.
+
+;; GNU Emacs is distributed in the hope that it will be useful,
+;; but WITHOUT ANY WARRANTY; without even the implied warranty of
+;; MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+;; GNU General Public License for more details.
+
+;; You should have received a copy of the GNU General Public License
+;; along with GNU Emacs.  If not, see <http://www.gnu.org/licenses/>.
+
+;;; Commentary:
+
+;; This package implements generators for Emacs Lisp.  A generator is
+;; a function that returns an iterator, and an iterator is an object
+;; that produces a sequence of values on demand.  `iter-defun' and
+;; `iter-lambda' define generators, `iter-yield' produces a value from
+;; within one, and `iter-next' gets the next value of an iterator.
+;;
+;;   (iter-defun my-range (n)
+;;     (let ((i 0))
+;;       (while (< i n)
+;;         (iter-yield i)
+;;         (setq i (1+ i)))))
+;;
+;;   (iter-do (i (my-range 3))
+;;     (print i))
+;;
+;; An iterator is a coroutine (see `make-coroutine') that runs the body
+;; of the generator as byte-code.  `iter-yield' compiles into an
+;; instruction that suspends it, keeping its frame intact, so getting a
+;; value allocates nothing but what the body itself does.
+;;
+;; Generators need `lexical-binding'.  `iter-yield' can only be used in
+;; the body of a generator itself, not in functions it calls or lambda
+;; expressions within it.  The body of a generator that is not
+;; byte-compiled is compiled whenever the generator is called.  This
+;; signals an error if the body uses lexical variables bound outside
+;; it, including the arguments of the generator, because the compiled
+;; body could not share them; byte-compile such generators.
+
+;;; Code:
+
+(define-error 'iter-end-of-sequence "Iteration terminated")
+
+(defun iter--split-body (body)
+  "Split BODY into its leading declarations and its other forms.
+The declarations are a documentation string, and `declare' and
+`interactive' forms.  Return (DECLARATIONS . FORMS)."
+  (let ((declarations nil))
+    (while (and (cdr body)
+                (or (stringp (car body))
+                    (memq (car-safe (car body)) '(declare interactive))))
+      (push (pop body) declarations))
+    (cons (nreverse declarations) body)))
+
+(defvar byte-compile-warnings)
+(declare-function byte-compile--reify-function "bytecomp" (fun))
+
+(defun iter--mentions-p (symbol form)
+  "Return non-nil if SYMBOL occurs anywhere in FORM."
+  (let ((found nil))
+    (while (and (consp form) (not found))
+      (setq found (iter--mentions-p symbol (pop form))))
+    (or found (eq form symbol))))
+
+(defun iter--make (function)
+  "Return an iterator that runs FUNCTION as a coroutine.
+If FUNCTION is interpreted, byte-compile it first.  Signal an error if
+it is a closure that refers to lexical variables bound around it: the
+compiled code would get copies of them, and changes to them would not
+be shared."
+  (make-coroutine
+   (if (byte-code-function-p function)
+       function
+     (require 'bytecomp)
+     (when (eq (car-safe function) 'closure)
+       (let ((env nil))
+         (dolist (binding (cadr function))
+           (cond ((not (consp binding)) (push binding env))
+                 ((iter--mentions-p (car binding) (cddr function))
+                  (error "Generator uses lexical variable `%s'; \
+byte-compile it" (car binding)))))
+         ;; The bindings left out are not used.
+         (setq function `(closure ,(nreverse env) ,@(cddr function)))))
+     (let ((lexical-binding t)
+           (byte-compile-warnings nil))
+       (byte-compile (byte-compile--reify-function function))))))
+
+(defmacro iter-lambda (arglist &rest body)
+  "Return a lambda generator.
+`iter-lambda' is to `iter-defun' as `lambda' is to `defun'."
+  (declare (indent defun)
+           (debug (&define lambda-list lambda-doc def-body)))
+  (unless lexical-binding
+    (error "Generators need `lexical-binding'"))
+  (let ((split (iter--split-body body)))
+    `(lambda ,arglist
+       ,@(car split)
+       (iter--make (lambda () ,@(cdr split))))))
+
+(defmacro iter-defun (name arglist &rest body)
+  "Create a generator NAME.
+When called, the generator returns an iterator that runs BODY, with
+the variables in ARGLIST bound to the arguments, each time it is
+asked for a value with `iter-next'.  Within BODY, `iter-yield'
+suspends the iterator, producing a value.  When BODY returns, the
+iterator signals `iter-end-of-sequence' with the value BODY
+returned."
+  (declare (indent defun)
+           (debug (&define name lambda-list lambda-doc def-body))
+           (doc-string 3))
+  (unless lexical-binding
+    (error "Generators need `lexical-binding'"))
+  (let ((split (iter--split-body body)))
+    `(defun ,name ,arglist
+       ,@(car split)
+       (iter--make (lambda () ,@(cdr split))))))
+
+(defmacro iter-yield (value)
+  "When used inside a generator, yield control to caller.
+The caller of `iter-next' receives VALUE, and the next call to
+`iter-next' resumes execution at the previous `iter-yield' point,
+which returns the value passed to that `iter-next'."
+  `(coroutine-yield ,value))
+
+(defmacro iter-yield-from (value)
+  "When used inside a generator function, delegate to a sub-iterator.
+The values that the sub-iterator yields are passed directly to the
+caller, and values supplied to `iter-next' are sent to the
+sub-iterator.  `iter-yield-from' evaluates to the value that the
+sub-iterator function returns via `iter-end-of-sequence'."
+  (let ((errsym (make-symbol "yield-from-result"))
+        (valsym (make-symbol "yield-from-value")))
+    `(let ((,valsym ,value))
+       (unwind-protect
+           (condition-case ,errsym
+               (let ((vs nil))
+                 (while t
+                   (setq vs (iter-yield (iter-next ,valsym vs)))))
+             (iter-end-of-sequence (cdr-safe ,errsym)))
+         (iter-close ,valsym)))))
+
+(defun iter-next (iterator &optional yield-result)
+  "Extract a value from an iterator.
+YIELD-RESULT becomes the return value of `iter-yield' in the
+context of the generator.
+
+This routine raises the `iter-end-of-sequence' condition if the
+iterator cannot supply more values."
+  (let ((value (coroutine-resume iterator yield-result)))
+    (if (coroutine-live-p iterator)
+        value
+      (signal 'iter-end-of-sequence value))))
+
+(defun iter-close (iterator)
+  "Terminate an iterator early.
+Run any unwind-protect handlers in scope at the point ITERATOR
+is blocked."
+  (coroutine-close iterator))
+
+(defmacro iter-do (binding &rest body)
+  "Loop over values from an iterator.
+Evaluate BODY with VAR bound to each value from ITERATOR.
+Return the value with which ITERATOR finished iteration.
+
+\(fn (VAR ITERATOR) BODY...)"
+  (declare (indent 1)
+           (debug ((symbolp form) body)))
+  (let ((iterator (make-symbol "iterator"))
+        (value (make-symbol "value")))
+    `(let ((,iterator ,(nth 1 binding))
+           (,value nil))
+       (while (progn (setq ,value (coroutine-resume ,iterator))
+                     (coroutine-live-p ,iterator))
+         (let ((,(car binding) ,value))
+           ,@body))
+       ,value)))
+
+(provide 'generator)
+
+;;; generator.el ends here
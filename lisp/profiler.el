@@ -162,7 +162,8 @@ function name of a function itself."
                                 (:constructor profiler-make-profile))
   (tag 'profiler-profile)
   (version profiler-version)
-  ;; - `type' has a value indicating the kind of profile (`memory' or `cpu').
+  ;; - `type' has a value indicating the kind of profile (`memory', `cpu'
+  ;;   or `bytecode').
   ;; - `log' indicates the profile log.
   ;; - `timestamp' has a value giving the time when the profile was obtained.
   ;; - `diff-p' indicates if this profile represents a diff between two profiles.
@@ -173,6 +174,8 @@ function name of a function itself."
   (unless (eq (profiler-profile-type profile1)
 	      (profiler-profile-type profile2))
     (error "Can't compare different type of profiles"))
+  (when (eq (profiler-profile-type profile1) 'bytecode)
+    (error "Can't compare byte-code profiles"))
   (profiler-make-profile
    :type (profiler-profile-type profile1)
    :timestamp (current-time)
@@ -187,7 +190,9 @@ function name of a function itself."
    :type (profiler-profile-type profile)
    :timestamp (profiler-profile-timestamp profile)
    :diff-p (profiler-profile-diff-p profile)
-   :log (profiler-fixup-log (profiler-profile-log profile))))
+   :log (if (eq (profiler-profile-type profile) 'bytecode)
+            (profiler-profile-log profile)
+          (profiler-fixup-log (profiler-profile-log profile)))))
 
 (defun profiler-write-profile (profile filename &optional confirm)
   "Write PROFILE into file FILENAME."
@@ -207,12 +212,15 @@ function name of a function itself."
 
 (defun profiler-running-p (&optional mode)
   "Return non-nil if the profiler is running.
-Optional argument MODE means only check for the specified mode (cpu or mem)."
+Optional argument MODE means only check for the specified mode (cpu,
+mem or bytecode)."
   (cond ((eq mode 'cpu) (and (fboundp 'profiler-cpu-running-p)
                              (profiler-cpu-running-p)))
         ((eq mode 'mem) (profiler-memory-running-p))
+        ((eq mode 'bytecode) (profiler-byte-code-running-p))
         (t (or (profiler-running-p 'cpu)
-               (profiler-running-p 'mem)))))
+               (profiler-running-p 'mem)
+               (profiler-running-p 'bytecode)))))
 
 (defun profiler-cpu-profile ()
   "Return CPU profile."
@@ -230,6 +238,14 @@ Optional argument MODE means only check for the specified mode (cpu or mem)."
      :timestamp (current-time)
      :log (profiler-memory-log))))
 
+(defun profiler-byte-code-profile ()
+  "Return byte-code profile."
+  (when (profiler-byte-code-running-p)
+    (profiler-make-profile
+     :type 'bytecode
+     :timestamp (current-time)
+     :log (profiler-byte-code-log))))
+
 
 ;;; Calltrees
 
@@ -420,6 +436,43 @@ Optional argument MODE means only check for the specified mode (cpu or mem)."
     (profiler-calltree-compute-percentages tree)
     tree))
 
+(cl-defstruct (profiler-byte-code-entry (:type vector) (:constructor nil)
+                                        (:copier nil))
+  ;; An element of the log of the byte-code profiler; see
+  ;; `profiler-byte-code-log'.
+  function code constants counts calls)
+
+(defun profiler-byte-code-entry-total (entry)
+  "Return how many instructions of byte-code ENTRY ran."
+  (apply #'+ (append (profiler-byte-code-entry-counts entry) nil)))
+
+(defun profiler-byte-code-calltree (log entries)
+  "Return a calltree for the byte-code profiler log LOG.
+Its nodes are the functions in LOG, counting the instructions they
+ran, and their children are the functions they called, counting the
+calls.  Map the nodes to the elements of LOG in the hash table ENTRIES."
+  (let ((tree (profiler-make-calltree))
+        (total 0))
+    (dolist (entry log)
+      (let ((node (profiler-make-calltree
+                   :entry (profiler-byte-code-entry-function entry)
+                   :count (profiler-byte-code-entry-total entry)
+                   :parent tree)))
+        (pcase-dolist (`(,callee . ,count)
+                       (profiler-byte-code-entry-calls entry))
+          (push (profiler-make-calltree :entry callee :count count
+                                        :parent node)
+                (profiler-calltree-children node)))
+        (puthash node entry entries)
+        (cl-incf total (profiler-calltree-count node))
+        (push node (profiler-calltree-children tree))))
+    (unless (zerop total)
+      (dolist (node (profiler-calltree-children tree))
+        (setf (profiler-calltree-count-percent node)
+              (profiler-format-percent (profiler-calltree-count node)
+                                       total))))
+    tree))
+
 (defun profiler-calltree-sort (tree predicate)
   (let ((children (profiler-calltree-children tree)))
     (setf (profiler-calltree-children tree) (sort children predicate))
@@ -454,6 +507,9 @@ Optional argument MODE means only check for the specified mode (cpu or mem)."
     (19 right ((14 right profiler-format-number)
 	       (5 right)))))
 
+(defvar profiler-report-byte-code-line-format
+  profiler-report-memory-line-format)
+
 (defvar-local profiler-report-profile nil
   "The current profile.")
 
@@ -465,6 +521,9 @@ variable directly.")
   "The value can be `ascending' or `descending'.  Do not touch
 this variable directly.")
 
+(defvar-local profiler-report-byte-code-entries nil
+  "A hash table mapping calltrees to byte-code profiler log entries.")
+
 (defun profiler-report-make-entry-part (entry)
   (let ((string (cond
 		 ((eq entry t)
@@ -503,7 +562,8 @@ RET: expand or collapse"))
 	(count-percent (profiler-calltree-count-percent tree)))
     (profiler-format (cl-ecase (profiler-profile-type profiler-report-profile)
 		       (cpu profiler-report-cpu-line-format)
-		       (memory profiler-report-memory-line-format))
+		       (memory profiler-report-memory-line-format)
+		       (bytecode profiler-report-byte-code-line-format))
 		     name-part
 		     (if diff-p
 			 (list (if (> count 0)
@@ -538,6 +598,7 @@ RET: expand or collapse"))
     (define-key map "j"     'profiler-report-find-entry)
     (define-key map [mouse-2] 'profiler-report-find-entry)
     (define-key map "d"	    'profiler-report-describe-entry)
+    (define-key map "a"	    'profiler-report-disassemble-entry)
     (define-key map "C"	    'profiler-report-render-calltree)
     (define-key map "B"	    'profiler-report-render-reversed-calltree)
     (define-key map "A"	    'profiler-report-ascending-sort)
@@ -561,6 +622,9 @@ RET: expand or collapse"))
         ["Describe Entry" profiler-report-describe-entry
          :active (profiler-report-calltree-at-point)
          :help "Show the documentation of the current entry"]
+        ["Disassemble Entry" profiler-report-disassemble-entry
+         :active (profiler-report-byte-code-entry-at-point)
+         :help "Show the byte-code of the current entry with counts"]
         "--"
         ["Show Calltree" profiler-report-render-calltree
          :active profiler-report-reversed
@@ -591,7 +655,8 @@ RET: expand or collapse"))
 
 (defun profiler-report-make-buffer-name (profile)
   (format "*%s-Profiler-Report %s*"
-          (cl-ecase (profiler-profile-type profile) (cpu 'CPU) (memory 'Memory))
+          (cl-ecase (profiler-profile-type profile)
+            (cpu 'CPU) (memory 'Memory) (bytecode 'Byte-Code))
           (format-time-string "%Y-%m-%d %T" (profiler-profile-timestamp profile))))
 
 (defun profiler-report-setup-buffer-1 (profile)
@@ -719,11 +784,60 @@ otherwise collapse."
 	(require 'help-fns)
 	(describe-function entry)))))
 
+(defun profiler-report-byte-code-entry-at-point ()
+  (let ((tree (profiler-report-calltree-at-point)))
+    (and tree profiler-report-byte-code-entries
+         (gethash tree profiler-report-byte-code-entries))))
+
+(defun profiler-byte-code-disassemble (entry)
+  "Insert the disassembly of byte-code profiler log ENTRY.
+Each instruction is preceded by the number of times it ran."
+  (require 'disass)
+  (let ((counts (profiler-byte-code-entry-counts entry))
+        (start (point)))
+    (disassemble-1 (list 'byte-code
+                         (profiler-byte-code-entry-code entry)
+                         (profiler-byte-code-entry-constants entry)
+                         0)
+                   0)
+    (save-excursion
+      (goto-char start)
+      (while (not (eobp))
+        ;; Lines start with the offset of their instruction, which
+        ;; may be followed by a label.  Instructions of nested
+        ;; functions are indented.
+        (insert (if (looking-at "\\([0-9]+\\)\\(:[0-9]+\\)?[ \t]")
+                    (format "%14s "
+                            (profiler-format-number
+                             (aref counts (string-to-number
+                                           (match-string 1)))))
+                  (make-string 15 ?\s)))
+        (forward-line)))))
+
+(defun profiler-report-disassemble-entry ()
+  "Show the byte-code of the entry at point, with the number of times
+each instruction ran."
+  (interactive)
+  (let ((entry (profiler-report-byte-code-entry-at-point)))
+    (unless entry
+      (user-error "No byte-code profile for this entry"))
+    (with-output-to-temp-buffer "*Disassemble*"
+      (with-current-buffer standard-output
+        (insert (format "Byte-code of %s, with counts:\n"
+                        (profiler-format-entry
+                         (profiler-byte-code-entry-function entry))))
+        (profiler-byte-code-disassemble entry)))))
+
 (cl-defun profiler-report-render-calltree-1
     (profile &key reverse (order 'descending))
-  (let ((calltree (profiler-calltree-build
-                   (profiler-profile-log profile)
-                   :reverse reverse)))
+  (let ((calltree
+         (if (eq (profiler-profile-type profile) 'bytecode)
+             (profiler-byte-code-calltree
+              (profiler-profile-log profile)
+              (setq profiler-report-byte-code-entries
+                    (make-hash-table :test 'eq)))
+           (profiler-calltree-build (profiler-profile-log profile)
+                                    :reverse reverse))))
     (setq header-line-format
 	  (cl-ecase (profiler-profile-type profile)
 	    (cpu
@@ -733,7 +847,11 @@ otherwise collapse."
 	    (memory
 	     (profiler-report-header-line-format
 	      profiler-report-memory-line-format
-	      "Function" (list "Bytes" "%")))))
+	      "Function" (list "Bytes" "%")))
+	    (bytecode
+	     (profiler-report-header-line-format
+	      profiler-report-byte-code-line-format
+	      "Function" (list "Instructions" "%")))))
     (let ((predicate (cl-ecase order
 		       (ascending #'profiler-calltree-count<)
 		       (descending #'profiler-calltree-count>))))
@@ -805,15 +923,24 @@ otherwise collapse."
 ;;;###autoload
 (defun profiler-start (mode)
   "Start/restart profilers.
-MODE can be one of `cpu', `mem', or `cpu+mem'.
+MODE can be one of `cpu', `mem', `cpu+mem' or `bytecode'.
 If MODE is `cpu' or `cpu+mem', time-based profiler will be started.
-Also, if MODE is `mem' or `cpu+mem', then memory profiler will be started."
+Also, if MODE is `mem' or `cpu+mem', then memory profiler will be started.
+If MODE is `bytecode', the byte-code profiler, which counts the
+instructions of byte-code that run, will be started."
   (interactive
-   (list (if (not (fboundp 'profiler-cpu-start)) 'mem
-           (intern (completing-read "Mode (default cpu): "
-                                    '("cpu" "mem" "cpu+mem")
-                                    nil t nil nil "cpu")))))
+   (list (intern (completing-read
+                  (if (fboundp 'profiler-cpu-start) "Mode (default cpu): "
+                    "Mode (default mem): ")
+                  (if (fboundp 'profiler-cpu-start)
+                      '("cpu" "mem" "cpu+mem" "bytecode")
+                    '("mem" "bytecode"))
+                  nil t nil nil
+                  (if (fboundp 'profiler-cpu-start) "cpu" "mem")))))
   (cl-ecase mode
+    (bytecode
+     (profiler-byte-code-start)
+     (message "Byte-code profiler started"))
     (cpu
      (profiler-cpu-start profiler-sampling-interval)
      (message "CPU profiler started"))
@@ -829,11 +956,13 @@ Also, if MODE is `mem' or `cpu+mem', then memory profiler will be started."
   "Stop started profilers.  Profiler logs will be kept."
   (interactive)
   (let ((cpu (if (fboundp 'profiler-cpu-stop) (profiler-cpu-stop)))
-        (mem (profiler-memory-stop)))
+        (mem (profiler-memory-stop))
+        (bytecode (profiler-byte-code-stop)))
     (message "%s profiler stopped"
              (cond ((and mem cpu) "CPU and memory")
                    (mem "Memory")
                    (cpu "CPU")
+                   (bytecode "Byte-code")
                    (t "No")))))
 
 (defun profiler-reset ()
@@ -842,6 +971,7 @@ Also, if MODE is `mem' or `cpu+mem', then memory profiler will be started."
   (when (fboundp 'profiler-cpu-log)
     (ignore (profiler-cpu-log)))
   (ignore (profiler-memory-log))
+  (ignore (profiler-byte-code-log))
   t)
 
 (defun profiler-report-cpu ()
@@ -854,11 +984,17 @@ Also, if MODE is `mem' or `cpu+mem', then memory profiler will be started."
     (when profile
       (profiler-report-profile-other-window profile))))
 
+(defun profiler-report-byte-code ()
+  (let ((profile (profiler-byte-code-profile)))
+    (when profile
+      (profiler-report-profile-other-window profile))))
+
 (defun profiler-report ()
   "Report profiling results."
   (interactive)
   (profiler-report-cpu)
-  (profiler-report-memory))
+  (profiler-report-memory)
+  (profiler-report-byte-code))
 
 ;;;###autoload
 (defun profiler-find-profile (filename)
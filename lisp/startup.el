@@ -1272,6 +1272,12 @@ the `--debug-init' option to view a complete error backtrace."
 	(list 'error
 	      (substitute-command-keys "Memory exhausted--use \\[save-some-buffers] then exit and restart Emacs")))
 
+  ;; Compile interpreted functions that are called often.  In batch
+  ;; mode Emacs is never idle, so don't count their calls at all.
+  (if noninteractive
+      (setq interpreted-function-compile-threshold nil)
+    (run-with-idle-timer 1 t #'internal--compile-interpreted-functions))
+
   ;; Process the remaining args.
   (command-line-1 (cdr command-line-args))
 
@@ -29,6 +29,7 @@ along with GNU Emacs.  If not, see <http://www.gnu.org/licenses/>.  */
 
 #ifdef HAVE_PTHREAD
 #include <pthread.h>
+#include <signal.h>		/* For pthread_sigmask.  */
 #endif
 
 #include "lisp.h"
@@ -106,6 +107,50 @@ static bool valgrind_p;
 
 #endif /* not DOUG_LEA_MALLOC */
 
+/* Whether to allocate large vectors and large string data with mmap,
+   so that their memory goes back to the system as soon as they are
+   freed.  Doug Lea's malloc already does this by itself, and memory
+   freed into other mallocs' heaps is rarely returned.  */
+
+#if (defined HAVE_MMAP && !defined SYSTEM_MALLOC && !defined DOUG_LEA_MALLOC \
+     && !defined HYBRID_MALLOC && !defined WINDOWSNT && USE_LSB_TAG)
+# include <sys/mman.h>
+# ifndef MAP_ANON
+#  ifdef MAP_ANONYMOUS
+#   define MAP_ANON MAP_ANONYMOUS
+#  endif
+# endif
+# ifdef MAP_ANON
+#  define USE_MMAP_FOR_LISP 1
+# endif
+#endif
+
+#ifdef USE_MMAP_FOR_LISP
+
+/* Objects at least this large get their own mapping.  */
+
+enum { LISP_MMAP_THRESHOLD = 128 * 1024 };
+
+#endif
+
+/* True if memory has been given back to malloc since the last call
+   to trim_heap.  */
+
+static bool heap_freed;
+
+/* Return the number of free objects that sweeping keeps in blocks of
+   BLOCK_SIZE objects, as set by `gc-spare-blocks', before it starts
+   freeing blocks that contain free objects only.  */
+
+static EMACS_INT
+spare_objects (int block_size)
+{
+  return (gc_spare_blocks <= 0 ? 0
+	  : gc_spare_blocks < EMACS_INT_MAX / block_size
+	  ? gc_spare_blocks * block_size
+	  : EMACS_INT_MAX);
+}
+
 /* Mark, unmark, query mark bit of a Lisp string.  S must be a pointer
    to a struct Lisp_String.  */
 
@@ -128,7 +173,14 @@ struct emacs_globals globals;
 
 EMACS_INT consing_since_gc;
 
-/* Similar minimum, computed from Vgc_cons_percentage.  */
+/* Number of buffers allocated so far, and number of bytes allocated
+   for vectors.  The counters for other kinds of objects are Lisp
+   variables.  */
+
+static EMACS_INT buffers_consed, vector_bytes_consed;
+
+/* Similar minimum, computed from Vgc_cons_percentage and adjusted by
+   schedule_next_gc.  */
 
 EMACS_INT gc_relative_threshold;
 
@@ -273,6 +325,11 @@ static Lisp_Object Qintervals;
 static Lisp_Object Qbuffers;
 static Lisp_Object Qstring_bytes, Qvector_slots, Qheap;
 static Lisp_Object Qgc_cons_threshold;
+static Lisp_Object Qnumber, Qtrigger, Qpause, Qmark, Qstack_scan;
+static Lisp_Object Qweak_tables, Qsweep, Qreclaimed;
+static Lisp_Object Qexplicit, Qthreshold, Qmemory_full, Qidle;
+static Lisp_Object Qtypes, Qmarkers, Qoverlays, Qhash_tables;
+static Lisp_Object Qlarge_vectors;
 Lisp_Object Qautomatic_gc;
 Lisp_Object Qchar_table_extra_slots;
 
@@ -281,15 +338,20 @@ Lisp_Object Qchar_table_extra_slots;
 static Lisp_Object Qpost_gc_hook;
 
 static void mark_terminals (void);
-static void gc_sweep (void);
+struct gc_record;
+static void gc_sweep (struct gc_record *);
+static void trim_heap (void);
 static Lisp_Object make_pure_vector (ptrdiff_t);
 static void mark_buffer (struct buffer *);
+static void process_mark_stack (ptrdiff_t);
 
 #if !defined REL_ALLOC || defined SYSTEM_MALLOC || defined HYBRID_MALLOC
 static void refill_memory_reserve (void);
 #endif
 static void compact_small_strings (void);
 static void free_large_strings (void);
+static void free_shared_sdata (void);
+static void deduplicate_strings (void);
 extern Lisp_Object which_symbols (Lisp_Object, EMACS_INT) EXTERNALLY_VISIBLE;
 
 /* When scanning the C stack for live Lisp objects, Emacs keeps track of
@@ -389,6 +451,46 @@ static void *min_heap_address, *max_heap_address;
 static struct mem_node mem_z;
 #define MEM_NIL &mem_z
 
+/* A map from the pages of the address space to the nodes of the tree
+   overlapping them, so that most lookups need not search the tree.
+   Pages are MEM_PAGE_BITS bits wide, the size and alignment of cons
+   and float blocks, so that each of these blocks has its own pages.
+   The map is a radix tree with three levels, covering the low
+   MEM_ADDRESS_BITS bits of addresses; Lisp data above that is only
+   found by searching the tree.  */
+
+enum
+  {
+    MEM_PAGE_BITS = 10,
+    MEM_ADDRESS_BITS = min (48, CHAR_BIT * sizeof (void *)),
+    MEM_LEAF_BITS = 12,
+    MEM_MID_BITS = (MEM_ADDRESS_BITS - MEM_PAGE_BITS - MEM_LEAF_BITS) / 2,
+    MEM_ROOT_BITS = (MEM_ADDRESS_BITS - MEM_PAGE_BITS - MEM_LEAF_BITS
+		     - MEM_MID_BITS)
+  };
+
+/* True if address P is covered by the page map.  */
+
+#define MEM_PAGE_MAPPED_P(p) \
+  ((uintptr_t) (p) >> (MEM_ADDRESS_BITS - 1) >> 1 == 0)
+
+/* A leaf of the page map.  COUNT[I] is the number of nodes of the
+   tree overlapping page I of the leaf; if it is 1, NODE[I] is that
+   node.  */
+
+struct mem_page_leaf
+{
+  struct mem_node *node[1 << MEM_LEAF_BITS];
+  unsigned short count[1 << MEM_LEAF_BITS];
+};
+
+struct mem_page_mid
+{
+  struct mem_page_leaf *leaf[1 << MEM_MID_BITS];
+};
+
+static struct mem_page_mid *mem_page_root[1 << MEM_ROOT_BITS];
+
 static struct mem_node *mem_insert (void *, void *, enum mem_type);
 static void mem_insert_fixup (struct mem_node *);
 static void mem_rotate_left (struct mem_node *);
@@ -403,10 +505,6 @@ static struct mem_node *mem_find (void *);
 # define DEADP(x) 0
 #endif
 
-/* Recording what needs to be marked for gc.  */
-
-struct gcpro *gcprolist;
-
 /* Addresses of staticpro'd variables.  Initialize it to a nonzero
    value; otherwise some compilers put it into BSS.  */
 
@@ -714,12 +812,27 @@ malloc_unblock_input (void)
 # define MALLOC_UNBLOCK_INPUT ((void) 0)
 #endif
 
+/* Tell the memory profiler that SIZE bytes were malloc'd.  Not while
+   collecting garbage, when the profiler's log has marked objects in it
+   and cannot be used.  */
+
 #define MALLOC_PROBE(size)			\
   do {						\
-    if (profiler_memory_running)		\
+    if (profiler_memory_running && !gc_in_progress) \
       malloc_probe (size);			\
   } while (0)
 
+/* Tell the memory profiler that a Lisp object of SIZE bytes, of the
+   kind named by the symbol KIND, was allocated.  The blocks that Lisp
+   objects are allocated from are not reported to it by MALLOC_PROBE,
+   so that the memory they take is not counted twice.  */
+
+#define ALLOC_PROBE(kind, size)			\
+  do {						\
+    if (profiler_memory_running)		\
+      alloc_probe (kind, size);			\
+  } while (0)
+
 
 /* Like malloc but check for no memory and block interrupt input..  */
 
@@ -986,7 +1099,6 @@ lisp_malloc (size_t nbytes, enum mem_type type)
   MALLOC_UNBLOCK_INPUT;
   if (!val && nbytes)
     memory_full (nbytes);
-  MALLOC_PROBE (nbytes);
   return val;
 }
 
@@ -998,12 +1110,69 @@ lisp_free (void *block)
 {
   MALLOC_BLOCK_INPUT;
   free (block);
+  heap_freed = true;
 #if GC_MARK_STACK && !defined GC_MALLOC_CHECK
   mem_delete (mem_find (block));
 #endif
   MALLOC_UNBLOCK_INPUT;
 }
 
+/* Like lisp_malloc, but if NBYTES is large, try to map the memory on
+   its own, so that freeing it gives it back to the system.  Store into
+   *MAPPED the number of bytes mapped, or 0 if the memory came from
+   lisp_malloc.  */
+
+static void *
+lisp_malloc_large (size_t nbytes, enum mem_type type, size_t *mapped)
+{
+#ifdef USE_MMAP_FOR_LISP
+  if (nbytes >= LISP_MMAP_THRESHOLD && mmap_lisp_allowed_p ())
+    {
+      void *val;
+
+      MALLOC_BLOCK_INPUT;
+      val = mmap (NULL, nbytes, PROT_READ | PROT_WRITE,
+		  MAP_PRIVATE | MAP_ANON, -1, 0);
+#if GC_MARK_STACK && !defined GC_MALLOC_CHECK
+      if (val != MAP_FAILED && type != MEM_TYPE_NON_LISP)
+	mem_insert (val, (char *) val + nbytes, type);
+#endif
+      MALLOC_UNBLOCK_INPUT;
+
+      if (val != MAP_FAILED)
+	{
+	  *mapped = nbytes;
+	  return val;
+	}
+    }
+#endif
+
+  *mapped = 0;
+  return lisp_malloc (nbytes, type);
+}
+
+/* Free BLOCK, allocated with lisp_malloc_large, which stored MAPPED
+   into its last argument.  */
+
+static void
+lisp_free_large (void *block, size_t mapped)
+{
+#ifdef USE_MMAP_FOR_LISP
+  if (mapped)
+    {
+      MALLOC_BLOCK_INPUT;
+      munmap (block, mapped);
+#if GC_MARK_STACK && !defined GC_MALLOC_CHECK
+      mem_delete (mem_find (block));
+#endif
+      MALLOC_UNBLOCK_INPUT;
+      return;
+    }
+#endif
+
+  lisp_free (block);
+}
+
 /*****  Allocation of aligned blocks of memory to store Lisp data.  *****/
 
 /* The entry point is lisp_align_malloc which returns blocks of at most
@@ -1210,8 +1379,6 @@ lisp_align_malloc (size_t nbytes, enum mem_type type)
 
   MALLOC_UNBLOCK_INPUT;
 
-  MALLOC_PROBE (nbytes);
-
   eassert (0 == ((uintptr_t) val) % BLOCK_ALIGN);
   return val;
 }
@@ -1255,10 +1422,285 @@ lisp_align_free (void *block)
       eassert ((uintptr_t) ABLOCKS_BASE (abase) % BLOCK_ALIGN == 0);
 #endif
       free (ABLOCKS_BASE (abase));
+      heap_freed = true;
     }
   MALLOC_UNBLOCK_INPUT;
 }
 
+
+/***********************************************************************
+			 Garbage Collection Threads
+ ***********************************************************************/
+
+/* Garbage collection can use several threads to sweep the heap, as
+   controlled by `gc-sweep-threads', and to mark cons cells, as
+   controlled by `gc-threads'.  The threads are created on demand and
+   never exit; between collections they wait for a new job.  Jobs are
+   only run by the main thread, which takes part in them itself.  */
+
+/* Whether cons cells can be marked in parallel; see
+   mark_frontier_conses.  */
+
+#if (defined HAVE_PTHREAD && !defined GC_CHECK_MARKED_OBJECTS \
+     && (defined __clang__ || 4 < __GNUC__ + (7 <= __GNUC_MINOR__)))
+# define PARALLEL_MARK 1
+#else
+# define PARALLEL_MARK 0
+#endif
+
+#if PARALLEL_MARK
+
+/* True while process_mark_stack leaves conses to mark_frontier.  */
+
+static bool mark_conses_in_parallel;
+
+#endif
+
+#ifdef HAVE_PTHREAD
+
+/* Maximum number of threads working on a job, the main thread
+   included.  */
+
+enum { GC_THREADS_MAX = 64 };
+
+/* Number of GC threads created so far, not counting the main
+   thread.  */
+
+static int gc_threads_started;
+
+/* The generation of the job each GC thread last worked on.  */
+
+static unsigned int gc_thread_generation[GC_THREADS_MAX];
+
+/* Protects the following variables, which describe the current job.
+   The main thread starts a job by incrementing gc_job_generation and
+   signaling gc_job_start; each GC thread that takes part decrements
+   gc_job_pending and the last one signals gc_job_done.  */
+
+static pthread_mutex_t gc_job_mutex;
+static pthread_cond_t gc_job_start, gc_job_done;
+static unsigned int gc_job_generation;
+static void (*gc_job_fn) (int, int);
+static int gc_job_threads, gc_job_pending;
+
+/* Body of GC thread number (intptr_t) ARG.  */
+
+static void *
+gc_thread (void *arg)
+{
+  int k = (intptr_t) arg;
+
+  pthread_mutex_lock (&gc_job_mutex);
+  for (;;)
+    {
+      int nthreads;
+      void (*fn) (int, int);
+
+      while (gc_thread_generation[k] == gc_job_generation)
+	pthread_cond_wait (&gc_job_start, &gc_job_mutex);
+      gc_thread_generation[k] = gc_job_generation;
+
+      nthreads = gc_job_threads;
+      fn = gc_job_fn;
+      if (k < nthreads)
+	{
+	  pthread_mutex_unlock (&gc_job_mutex);
+	  fn (k, nthreads);
+	  pthread_mutex_lock (&gc_job_mutex);
+	  if (--gc_job_pending == 0)
+	    pthread_cond_signal (&gc_job_done);
+	}
+    }
+  return NULL;
+}
+
+/* Make sure N - 1 GC threads are running, and return the number of
+   threads that can work on a job, including the main thread.  This
+   may be less than N if threads cannot be created.  */
+
+static int
+start_gc_threads (int n)
+{
+  sigset_t all, oldset;
+
+  n = min (n, GC_THREADS_MAX);
+  if (n <= gc_threads_started + 1)
+    return max (n, 1);
+
+  /* Leave signals to the main thread.  */
+  sigfillset (&all);
+  pthread_sigmask (SIG_SETMASK, &all, &oldset);
+
+  while (gc_threads_started < n - 1)
+    {
+      int k = gc_threads_started + 1;
+      pthread_t thread;
+
+      gc_thread_generation[k] = gc_job_generation;
+      if (pthread_create (&thread, NULL, gc_thread, (void *) (intptr_t) k))
+	break;
+      pthread_detach (thread);
+      gc_threads_started = k;
+    }
+
+  pthread_sigmask (SIG_SETMASK, &oldset, 0);
+  return min (n, gc_threads_started + 1);
+}
+
+/* Call FN (K, NTHREADS) in each of NTHREADS threads, for K from 0 to
+   NTHREADS - 1, this thread being thread 0, and wait for all of them
+   to return.  */
+
+static void
+run_gc_job (void (*fn) (int, int), int nthreads)
+{
+  pthread_mutex_lock (&gc_job_mutex);
+  gc_job_fn = fn;
+  gc_job_threads = nthreads;
+  gc_job_pending = nthreads - 1;
+  gc_job_generation++;
+  pthread_cond_broadcast (&gc_job_start);
+  pthread_mutex_unlock (&gc_job_mutex);
+
+  fn (0, nthreads);
+
+  pthread_mutex_lock (&gc_job_mutex);
+  while (gc_job_pending)
+    pthread_cond_wait (&gc_job_done, &gc_job_mutex);
+  pthread_mutex_unlock (&gc_job_mutex);
+}
+
+#endif /* HAVE_PTHREAD */
+
+/* What sweeping one block of objects found.  Each of the functions
+   that sweep a kind of block fills in one of these per block, possibly
+   from several threads at once; the caller then goes over them in
+   order to build the free list, free empty blocks and count objects.
+   Only the last step needs global state, so only it is serial.  */
+
+struct block_sweep
+{
+  /* The block being swept.  */
+  void *block;
+
+  /* Number of objects in use, and number of free objects.  */
+  int nused, nfree;
+
+  /* The free objects in the block, chained together as for the free
+     list of their type, or NULL if there are none.  */
+  void *free_head, *free_tail;
+
+  /* For string blocks, the number of bytes in the live strings.  */
+  EMACS_INT nbytes;
+};
+
+/* Return the block after B in a list of blocks whose `next' member is
+   NEXT_OFFSET bytes into each block.  */
+
+#define NEXT_BLOCK(b, next_offset) (*(void **) ((char *) (b) + (next_offset)))
+
+/* Don't bother waking up the GC threads to sweep fewer blocks.  */
+
+enum { SWEEP_PARALLEL_MIN_BLOCKS = 64 };
+
+/* Vector of block_sweep structures used by sweep_blocks.  */
+
+static struct block_sweep *block_sweeps;
+static ptrdiff_t block_sweeps_size;
+
+#ifdef HAVE_PTHREAD
+
+/* The sweeping job being run by the GC threads.  */
+
+static struct block_sweep *sweep_job;
+static ptrdiff_t sweep_job_size;
+static void (*sweep_job_fn) (struct block_sweep *);
+
+/* Do the share of the current sweeping job of thread K out of
+   NTHREADS.  */
+
+static void
+sweep_job_share (int k, int nthreads)
+{
+  ptrdiff_t i = sweep_job_size * k / nthreads;
+  ptrdiff_t end = sweep_job_size * (k + 1) / nthreads;
+
+  for (; i < end; i++)
+    sweep_job_fn (&sweep_job[i]);
+}
+
+#endif /* HAVE_PTHREAD */
+
+/* Sweep the list of blocks starting with FIRST, whose `next' member is
+   NEXT_OFFSET bytes into each block, by calling FN on each of them.
+   If `gc-sweep-threads' allows it and there are enough blocks, do this
+   in parallel and return the vector of results, in list order.
+   Otherwise, return NULL; the caller then sweeps each block in turn
+   with sweep_one_block.  FN must not allocate memory or change any
+   global state.  */
+
+static struct block_sweep *
+sweep_blocks (void *first, ptrdiff_t next_offset,
+	      void (*fn) (struct block_sweep *))
+{
+#ifdef HAVE_PTHREAD
+  ptrdiff_t i, n = 0;
+  void *b;
+  int nthreads;
+
+  if (gc_sweep_threads <= 1)
+    return NULL;
+
+  for (b = first; b; b = NEXT_BLOCK (b, next_offset))
+    n++;
+  if (n < SWEEP_PARALLEL_MIN_BLOCKS)
+    return NULL;
+
+  if (block_sweeps_size < n)
+    {
+      /* Don't use xrealloc: if memory is short, sweeping serially is
+	 better than not collecting garbage at all.  */
+      struct block_sweep *p = realloc (block_sweeps, n * sizeof *p);
+      if (!p)
+	return NULL;
+      block_sweeps = p;
+      block_sweeps_size = n;
+    }
+
+  nthreads = start_gc_threads (min (gc_sweep_threads, GC_THREADS_MAX));
+  if (nthreads <= 1)
+    return NULL;
+
+  for (b = first, i = 0; b; b = NEXT_BLOCK (b, next_offset), i++)
+    block_sweeps[i].block = b;
+  sweep_job = block_sweeps;
+  sweep_job_size = n;
+  sweep_job_fn = fn;
+  run_gc_job (sweep_job_share, nthreads);
+  return block_sweeps;
+#else
+  return NULL;
+#endif
+}
+
+/* Return the result of sweeping BLOCK, the Ith block of its list, with
+   FN.  SWEEPS is what sweep_blocks returned; if it is NULL, sweep the
+   block now, putting the result into *ONE.  */
+
+static struct block_sweep *
+sweep_one_block (struct block_sweep *sweeps, ptrdiff_t i, void *block,
+		 void (*fn) (struct block_sweep *), struct block_sweep *one)
+{
+  if (sweeps)
+    {
+      eassert (sweeps[i].block == block);
+      return &sweeps[i];
+    }
+  one->block = block;
+  fn (one);
+  return one;
+}
+
 
 /***********************************************************************
 			 Interval Allocation
@@ -1332,6 +1774,7 @@ make_interval (void)
   consing_since_gc += sizeof (struct interval);
   intervals_consed++;
   total_free_intervals--;
+  ALLOC_PROBE (Qintervals, sizeof (struct interval));
   RESET_INTERVAL (val);
   val->gcmarkbit = 0;
   return val;
@@ -1468,6 +1911,10 @@ struct sblock
      of the sblock if there isn't any space left in this block.  */
   sdata *next_free;
 
+  /* For an sblock holding the data of a large string, the number of
+     bytes mapped for it by lisp_malloc_large.  */
+  size_t mapped;
+
   /* String data.  */
   sdata data[FLEXIBLE_ARRAY_MEMBER];
 };
@@ -1527,6 +1974,51 @@ static EMACS_INT total_string_bytes;
 
 #define SDATA_OF_STRING(S) ((sdata *) ((S)->data - SDATA_DATA_OFFSET))
 
+/* String contents shared by several strings, as arranged by
+   deduplicate_strings when `gc-deduplicate-strings' is non-nil.  Each
+   struct shared_sdata is followed by an sdata holding the contents,
+   whose string back-pointer is &shared_string.  Shared data is not in
+   any sblock, so compact_small_strings never moves it, and it is freed
+   by free_shared_sdata once no live string uses it.  Strings must not
+   modify shared data: see unshare_string_data.  */
+
+struct shared_sdata
+{
+  /* Next in the same bucket of shared_sdata_table.  */
+  struct shared_sdata *next;
+
+  /* Hash code and size of the contents.  */
+  EMACS_UINT hash;
+  ptrdiff_t nbytes;
+
+  /* True if a live string uses this data; see free_shared_sdata.  */
+  bool used;
+};
+
+enum
+{
+  shared_sdata_offset = ROUNDUP (sizeof (struct shared_sdata),
+				 sizeof (ptrdiff_t))
+};
+
+#define SDATA_OF_SHARED(P) ((sdata *) ((char *) (P) + shared_sdata_offset))
+#define SHARED_OF_SDATA(D) \
+  ((struct shared_sdata *) ((char *) (D) - shared_sdata_offset))
+
+/* The owner of all shared sdata, as far as their back-pointers go.  */
+
+static struct Lisp_String shared_string;
+
+/* True if live string S, which is not pure, shares its data.  */
+
+#define STRING_DATA_SHARED_P(S) (SDATA_OF_STRING (S)->string == &shared_string)
+
+/* Hash table of all shared sdata, with SHARED_SDATA_TABLE_SIZE buckets,
+   a power of 2, holding SHARED_SDATA_COUNT of them.  */
+
+static struct shared_sdata **shared_sdata_table;
+static ptrdiff_t shared_sdata_table_size, shared_sdata_count;
+
 
 #ifdef GC_CHECK_STRING_OVERRUN
 
@@ -1740,6 +2232,7 @@ allocate_string (void)
   ++total_strings;
   ++strings_consed;
   consing_since_gc += sizeof *s;
+  ALLOC_PROBE (Qstrings, sizeof *s);
 
 #ifdef GC_CHECK_STRING_BYTES
   if (!noninteractive)
@@ -1791,19 +2284,22 @@ allocate_string_data (struct Lisp_String *s,
   if (nbytes > LARGE_STRING_BYTES)
     {
       size_t size = offsetof (struct sblock, data) + needed;
+      size_t mapped;
 
 #ifdef DOUG_LEA_MALLOC
       if (!mmap_lisp_allowed_p ())
         mallopt (M_MMAP_MAX, 0);
 #endif
 
-      b = lisp_malloc (size + GC_STRING_EXTRA, MEM_TYPE_NON_LISP);
+      b = lisp_malloc_large (size + GC_STRING_EXTRA, MEM_TYPE_NON_LISP,
+			     &mapped);
 
 #ifdef DOUG_LEA_MALLOC
       if (!mmap_lisp_allowed_p ())
         mallopt (M_MMAP_MAX, MMAP_MAX_AREAS);
 #endif
 
+      b->mapped = mapped;
       b->next_free = b->data;
       b->data[0].string = NULL;
       b->next = large_sblocks;
@@ -1849,102 +2345,131 @@ allocate_string_data (struct Lisp_String *s,
 
   /* Note that Faset may call to this function when S has already data
      assigned.  In this case, mark data as free by setting it's string
-     back-pointer to null, and record the size of the data in it.  */
-  if (old_data)
+     back-pointer to null, and record the size of the data in it.
+     Data shared with other strings is left alone.  */
+  if (old_data && old_data->string != &shared_string)
     {
       SDATA_NBYTES (old_data) = old_nbytes;
       old_data->string = NULL;
     }
 
   consing_since_gc += needed;
+  ALLOC_PROBE (Qstrings, needed);
 }
 
 
-/* Sweep and compact strings.  */
+/* Sweep the string block of SWEEP: unmark its live strings and chain
+   the dead ones together.  */
 
-NO_INLINE /* For better stack traces */
 static void
-sweep_strings (void)
+sweep_string_block (struct block_sweep *sweep)
 {
-  struct string_block *b, *next;
-  struct string_block *live_blocks = NULL;
-
-  string_free_list = NULL;
-  total_strings = total_free_strings = 0;
-  total_string_bytes = 0;
+  struct string_block *b = sweep->block;
+  struct Lisp_String *free_head = NULL, *free_tail = NULL;
+  int i, nused = 0;
+  EMACS_INT nbytes = 0;
 
-  /* Scan strings_blocks, free Lisp_Strings that aren't marked.  */
-  for (b = string_blocks; b; b = next)
+  for (i = 0; i < STRING_BLOCK_SIZE; ++i)
     {
-      int i, nfree = 0;
-      struct Lisp_String *free_list_before = string_free_list;
-
-      next = b->next;
+      struct Lisp_String *s = b->strings + i;
 
-      for (i = 0; i < STRING_BLOCK_SIZE; ++i)
+      if (s->data)
 	{
-	  struct Lisp_String *s = b->strings + i;
-
-	  if (s->data)
+	  /* String was not on free-list before.  */
+	  if (STRING_MARKED_P (s))
 	    {
-	      /* String was not on free-list before.  */
-	      if (STRING_MARKED_P (s))
-		{
-		  /* String is live; unmark it and its intervals.  */
-		  UNMARK_STRING (s);
+	      /* String is live; unmark it and its intervals.  */
+	      UNMARK_STRING (s);
 
-		  /* Do not use string_(set|get)_intervals here.  */
-		  s->intervals = balance_intervals (s->intervals);
+	      /* Do not use string_(set|get)_intervals here.  */
+	      s->intervals = balance_intervals (s->intervals);
 
-		  ++total_strings;
-		  total_string_bytes += STRING_BYTES (s);
-		}
-	      else
-		{
-		  /* String is dead.  Put it on the free-list.  */
-		  sdata *data = SDATA_OF_STRING (s);
+	      ++nused;
+	      nbytes += STRING_BYTES (s);
+	      continue;
+	    }
+	  else if (STRING_DATA_SHARED_P (s))
+	    /* String is dead, but its data may be used by others.  */
+	    s->data = NULL;
+	  else
+	    {
+	      /* String is dead.  Put it on the free-list.  */
+	      sdata *data = SDATA_OF_STRING (s);
 
-		  /* Save the size of S in its sdata so that we know
-		     how large that is.  Reset the sdata's string
-		     back-pointer so that we know it's free.  */
+	      /* Save the size of S in its sdata so that we know
+		 how large that is.  Reset the sdata's string
+		 back-pointer so that we know it's free.  */
 #ifdef GC_CHECK_STRING_BYTES
-		  if (string_bytes (s) != SDATA_NBYTES (data))
-		    emacs_abort ();
+	      if (string_bytes (s) != SDATA_NBYTES (data))
+		emacs_abort ();
 #else
-		  data->n.nbytes = STRING_BYTES (s);
+	      data->n.nbytes = STRING_BYTES (s);
 #endif
-		  data->string = NULL;
-
-		  /* Reset the strings's `data' member so that we
-		     know it's free.  */
-		  s->data = NULL;
+	      data->string = NULL;
 
-		  /* Put the string on the free-list.  */
-		  NEXT_FREE_LISP_STRING (s) = string_free_list;
-		  string_free_list = s;
-		  ++nfree;
-		}
-	    }
-	  else
-	    {
-	      /* S was on the free-list before.  Put it there again.  */
-	      NEXT_FREE_LISP_STRING (s) = string_free_list;
-	      string_free_list = s;
-	      ++nfree;
+	      /* Reset the strings's `data' member so that we
+		 know it's free.  */
+	      s->data = NULL;
 	    }
 	}
 
+      /* S is free, either from before or just now.  Chain it to the
+	 others.  */
+      NEXT_FREE_LISP_STRING (s) = free_head;
+      free_head = s;
+      if (!free_tail)
+	free_tail = s;
+    }
+
+  sweep->nused = nused;
+  sweep->nfree = STRING_BLOCK_SIZE - nused;
+  sweep->free_head = free_head;
+  sweep->free_tail = free_tail;
+  sweep->nbytes = nbytes;
+}
+
+/* Sweep and compact strings.  */
+
+NO_INLINE /* For better stack traces */
+static void
+sweep_strings (void)
+{
+  struct string_block *b, *next;
+  struct string_block *live_blocks = NULL;
+  struct block_sweep *sweeps, one;
+  ptrdiff_t i;
+
+  string_free_list = NULL;
+  total_strings = total_free_strings = 0;
+  total_string_bytes = 0;
+
+  sweeps = sweep_blocks (string_blocks, offsetof (struct string_block, next),
+			 sweep_string_block);
+
+  /* Scan strings_blocks, free Lisp_Strings that aren't marked.  */
+  for (b = string_blocks, i = 0; b; b = next, i++)
+    {
+      struct block_sweep *sweep
+	= sweep_one_block (sweeps, i, b, sweep_string_block, &one);
+
+      next = b->next;
+      total_strings += sweep->nused;
+      total_string_bytes += sweep->nbytes;
+
       /* Free blocks that contain free Lisp_Strings only, except
-	 the first two of them.  */
-      if (nfree == STRING_BLOCK_SIZE
-	  && total_free_strings > STRING_BLOCK_SIZE)
-	{
-	  lisp_free (b);
-	  string_free_list = free_list_before;
-	}
+	 the first `gc-spare-blocks' of them.  */
+      if (sweep->nfree == STRING_BLOCK_SIZE
+	  && total_free_strings > spare_objects (STRING_BLOCK_SIZE))
+	lisp_free (b);
       else
 	{
-	  total_free_strings += nfree;
+	  if (sweep->free_head)
+	    {
+	      struct Lisp_String *tail = sweep->free_tail;
+	      NEXT_FREE_LISP_STRING (tail) = string_free_list;
+	      string_free_list = sweep->free_head;
+	    }
+	  total_free_strings += sweep->nfree;
 	  b->next = live_blocks;
 	  live_blocks = b;
 	}
@@ -1954,6 +2479,9 @@ sweep_strings (void)
 
   string_blocks = live_blocks;
   free_large_strings ();
+  free_shared_sdata ();
+  if (gc_deduplicate_strings)
+    deduplicate_strings ();
   compact_small_strings ();
 
   check_string_free_list ();
@@ -1973,7 +2501,7 @@ free_large_strings (void)
       next = b->next;
 
       if (b->data[0].string == NULL)
-	lisp_free (b);
+	lisp_free_large (b, b->mapped);
       else
 	{
 	  b->next = live_blocks;
@@ -1985,6 +2513,231 @@ free_large_strings (void)
 }
 
 
+/* Free the shared sdata that no live string uses any more.  */
+
+static void
+free_shared_sdata (void)
+{
+  struct string_block *b;
+  ptrdiff_t i;
+
+  if (!shared_sdata_count)
+    return;
+
+  /* Find the shared sdata that live strings use.  This is not done in
+     sweep_string_block, which may run in several threads at once.  */
+  for (b = string_blocks; b; b = b->next)
+    for (i = 0; i < STRING_BLOCK_SIZE; i++)
+      {
+	struct Lisp_String *s = b->strings + i;
+	if (s->data && STRING_DATA_SHARED_P (s))
+	  SHARED_OF_SDATA (SDATA_OF_STRING (s))->used = true;
+      }
+
+  for (i = 0; i < shared_sdata_table_size; i++)
+    {
+      struct shared_sdata **prev = &shared_sdata_table[i], *p;
+
+      while ((p = *prev))
+	if (p->used)
+	  {
+	    p->used = false;
+	    prev = &p->next;
+	  }
+	else
+	  {
+	    *prev = p->next;
+	    shared_sdata_count--;
+	    free (p);
+	  }
+    }
+}
+
+/* Return the shared sdata holding the NBYTES bytes at DATA, whose hash
+   code is HASH, or a null pointer if there is none.  */
+
+static struct shared_sdata *
+find_shared_sdata (unsigned char const *data, ptrdiff_t nbytes,
+		   EMACS_UINT hash)
+{
+  struct shared_sdata *p;
+
+  if (!shared_sdata_table_size)
+    return NULL;
+  for (p = shared_sdata_table[hash & (shared_sdata_table_size - 1)];
+       p; p = p->next)
+    if (p->hash == hash && p->nbytes == nbytes
+	&& memcmp (SDATA_DATA (SDATA_OF_SHARED (p)), data, nbytes) == 0)
+      return p;
+  return NULL;
+}
+
+/* Return new shared sdata holding a copy of the NBYTES bytes at DATA,
+   whose hash code is HASH, or a null pointer if memory is exhausted.
+   This runs during GC, so it must not signal.  */
+
+static struct shared_sdata *
+make_shared_sdata (unsigned char const *data, ptrdiff_t nbytes,
+		   EMACS_UINT hash)
+{
+  struct shared_sdata *p, **table;
+  sdata *d;
+  ptrdiff_t i;
+
+  if (shared_sdata_count == shared_sdata_table_size
+      && (table = calloc (max (64, 2 * shared_sdata_table_size),
+			  sizeof *table)))
+    {
+      /* Double the number of buckets, and rehash.  */
+      ptrdiff_t old_size = shared_sdata_table_size;
+      struct shared_sdata **old = shared_sdata_table;
+
+      shared_sdata_table = table;
+      shared_sdata_table_size = max (64, 2 * old_size);
+      for (i = 0; i < old_size; i++)
+	while (old[i])
+	  {
+	    struct shared_sdata *q = old[i];
+	    struct shared_sdata **bucket
+	      = &shared_sdata_table[q->hash & (shared_sdata_table_size - 1)];
+	    old[i] = q->next;
+	    q->next = *bucket;
+	    *bucket = q;
+	  }
+      free (old);
+    }
+
+  if (!shared_sdata_table_size)
+    return NULL;
+  p = malloc (shared_sdata_offset + SDATA_SIZE (nbytes));
+  if (!p)
+    return NULL;
+  d = SDATA_OF_SHARED (p);
+  p->hash = hash;
+  p->nbytes = nbytes;
+  p->used = false;
+  d->string = &shared_string;
+#ifdef GC_CHECK_STRING_BYTES
+  SDATA_NBYTES (d) = nbytes;
+#endif
+  memcpy (SDATA_DATA (d), data, nbytes + 1);
+
+  i = hash & (shared_sdata_table_size - 1);
+  p->next = shared_sdata_table[i];
+  shared_sdata_table[i] = p;
+  shared_sdata_count++;
+  return p;
+}
+
+/* Make live string S use the data of P instead of its own.  */
+
+static void
+share_string_data (struct Lisp_String *s, struct shared_sdata *p)
+{
+  sdata *data = SDATA_OF_STRING (s);
+
+#ifndef GC_CHECK_STRING_BYTES
+  data->n.nbytes = STRING_BYTES (s);
+#endif
+  data->string = NULL;
+  s->data = SDATA_DATA (SDATA_OF_SHARED (p));
+}
+
+/* Make live strings with the same contents share them.  Only small
+   strings are considered, since the data of large ones is not
+   compacted anyway.  A string's data is shared once a second string
+   with the same contents is found, in this collection or a later one.  */
+
+static void
+deduplicate_strings (void)
+{
+  /* Strings with data of their own seen so far, by hash code, in an
+     open-addressed table of NCANDIDATES entries, a power of 2.  */
+  struct candidate
+  {
+    struct Lisp_String *s;
+    EMACS_UINT hash;
+  } *candidates;
+  ptrdiff_t ncandidates = 64;
+  struct string_block *b;
+  int i;
+
+  while (ncandidates < 2 * total_strings)
+    ncandidates *= 2;
+  candidates = calloc (ncandidates, sizeof *candidates);
+  if (!candidates)
+    return;
+
+  for (b = string_blocks; b; b = b->next)
+    for (i = 0; i < STRING_BLOCK_SIZE; i++)
+      {
+	struct Lisp_String *s = b->strings + i;
+	ptrdiff_t nbytes, j;
+	EMACS_UINT hash;
+	struct shared_sdata *p;
+
+	if (!s->data || STRING_DATA_SHARED_P (s))
+	  continue;
+	nbytes = STRING_BYTES (s);
+	if (nbytes > LARGE_STRING_BYTES)
+	  continue;
+
+	hash = hash_string ((char *) s->data, nbytes);
+	p = find_shared_sdata (s->data, nbytes, hash);
+	if (p)
+	  {
+	    share_string_data (s, p);
+	    continue;
+	  }
+
+	for (j = hash & (ncandidates - 1); candidates[j].s;
+	     j = (j + 1) & (ncandidates - 1))
+	  {
+	    struct Lisp_String *c = candidates[j].s;
+	    if (candidates[j].hash == hash && !STRING_DATA_SHARED_P (c)
+		&& STRING_BYTES (c) == nbytes
+		&& memcmp (c->data, s->data, nbytes) == 0)
+	      {
+		p = make_shared_sdata (s->data, nbytes, hash);
+		if (p)
+		  {
+		    share_string_data (c, p);
+		    share_string_data (s, p);
+		  }
+		break;
+	      }
+	  }
+	if (!candidates[j].s)
+	  {
+	    candidates[j].s = s;
+	    candidates[j].hash = hash;
+	  }
+      }
+
+  free (candidates);
+}
+
+/* Give STRING a copy of its contents of its own if it shares them
+   with other strings, so that they can be modified.  Primitives that
+   change the contents of an existing string must call this first.  */
+
+void
+unshare_string_data (Lisp_Object string)
+{
+  struct Lisp_String *s = XSTRING (string);
+
+  if (shared_sdata_count && !PURE_POINTER_P (s) && STRING_DATA_SHARED_P (s))
+    {
+      unsigned char *data = s->data;
+      ptrdiff_t nbytes = STRING_BYTES (s), size_byte = s->size_byte;
+
+      s->data = NULL;
+      allocate_string_data (s, s->size, nbytes);
+      memcpy (s->data, data, nbytes);
+      s->size_byte = size_byte;
+    }
+}
+
 /* Compact data of small strings.  Free sblocks that don't contain
    data of live strings after compaction.  */
 
@@ -2356,13 +3109,20 @@ make_formatted_string (char *buf, const char *format, ...)
 /* We store float cells inside of float_blocks, allocating a new
    float_block with malloc whenever necessary.  Float cells reclaimed
    by GC are put on a free list to be reallocated before allocating
-   any new float cells from the latest float_block.  */
+   any new float cells from the latest float_block.
+
+   GC does not build that free list itself: it only records which
+   cells survived, in the `livebits' of each block.  The blocks are
+   then swept lazily, one at a time, whenever the free list runs dry.
+   See sweep_floats and lazy_sweep_floats.  */
 
 #define FLOAT_BLOCK_SIZE					\
   (((BLOCK_BYTES - sizeof (struct float_block *)		\
      /* The compiler might add padding at the end.  */		\
-     - (sizeof (struct Lisp_Float) - sizeof (bits_word))) * CHAR_BIT) \
-   / (sizeof (struct Lisp_Float) * CHAR_BIT + 1))
+     - (sizeof (struct Lisp_Float) - sizeof (bits_word))	\
+     /* Two bit vectors, each with one extra word.  */		\
+     - sizeof (bits_word)) * CHAR_BIT)				\
+   / (sizeof (struct Lisp_Float) * CHAR_BIT + 2))
 
 #define GETMARKBIT(block,n)				\
   (((block)->gcmarkbits[(n) / BITS_PER_BITS_WORD]	\
@@ -2377,6 +3137,21 @@ make_formatted_string (char *buf, const char *format, ...)
   ((block)->gcmarkbits[(n) / BITS_PER_BITS_WORD]	\
    &= ~((bits_word) 1 << ((n) % BITS_PER_BITS_WORD)))
 
+/* Likewise for the bits saying which cells of a block are in use.  */
+
+#define GETLIVEBIT(block,n)				\
+  (((block)->livebits[(n) / BITS_PER_BITS_WORD]		\
+    >> ((n) % BITS_PER_BITS_WORD))			\
+   & 1)
+
+#define SETLIVEBIT(block,n)				\
+  ((block)->livebits[(n) / BITS_PER_BITS_WORD]		\
+   |= (bits_word) 1 << ((n) % BITS_PER_BITS_WORD))
+
+#define UNSETLIVEBIT(block,n)				\
+  ((block)->livebits[(n) / BITS_PER_BITS_WORD]		\
+   &= ~((bits_word) 1 << ((n) % BITS_PER_BITS_WORD)))
+
 #define FLOAT_BLOCK(fptr) \
   ((struct float_block *) (((uintptr_t) (fptr)) & ~(BLOCK_ALIGN - 1)))
 
@@ -2388,9 +3163,14 @@ struct float_block
   /* Place `floats' at the beginning, to ease up FLOAT_INDEX's job.  */
   struct Lisp_Float floats[FLOAT_BLOCK_SIZE];
   bits_word gcmarkbits[1 + FLOAT_BLOCK_SIZE / BITS_PER_BITS_WORD];
+  /* Bit N is set if floats[N] is in use, i.e. it has been allocated
+     and was not found to be garbage by the last GC.  */
+  bits_word livebits[1 + FLOAT_BLOCK_SIZE / BITS_PER_BITS_WORD];
   struct float_block *next;
 };
 
+verify (sizeof (struct float_block) <= BLOCK_BYTES);
+
 #define FLOAT_MARKED_P(fptr) \
   GETMARKBIT (FLOAT_BLOCK (fptr), FLOAT_INDEX ((fptr)))
 
@@ -2400,6 +3180,9 @@ struct float_block
 #define FLOAT_UNMARK(fptr) \
   UNSETMARKBIT (FLOAT_BLOCK (fptr), FLOAT_INDEX ((fptr)))
 
+#define FLOAT_LIVE_P(fptr) \
+  GETLIVEBIT (FLOAT_BLOCK (fptr), FLOAT_INDEX ((fptr)))
+
 /* Current float_block.  */
 
 static struct float_block *float_block;
@@ -2412,6 +3195,40 @@ static int float_block_index = FLOAT_BLOCK_SIZE;
 
 static struct Lisp_Float *float_free_list;
 
+/* Next float_block still to be swept since the last GC, or NULL if
+   all of them have been.  */
+
+static struct float_block *float_sweep_block;
+
+/* Put the free floats of the next unswept float block on the free
+   list.  */
+
+static void
+sweep_next_float_block (void)
+{
+  struct float_block *fblk = float_sweep_block;
+  int lim = fblk == float_block ? float_block_index : FLOAT_BLOCK_SIZE;
+  int i;
+
+  float_sweep_block = fblk->next;
+  for (i = 0; i < lim; i++)
+    if (!GETLIVEBIT (fblk, i))
+      {
+	fblk->floats[i].u.chain = float_free_list;
+	float_free_list = &fblk->floats[i];
+      }
+}
+
+/* Sweep float blocks that were left unswept by the last GC, until
+   some free floats turn up or no unswept block remains.  */
+
+static void
+lazy_sweep_floats (void)
+{
+  while (!float_free_list && float_sweep_block)
+    sweep_next_float_block ();
+}
+
 /* Return a new float object with value FLOAT_VALUE.  */
 
 Lisp_Object
@@ -2421,6 +3238,9 @@ make_float (double float_value)
 
   MALLOC_BLOCK_INPUT;
 
+  if (!float_free_list)
+    lazy_sweep_floats ();
+
   if (float_free_list)
     {
       /* We use the data field for chaining the free list
@@ -2436,6 +3256,7 @@ make_float (double float_value)
 	    = lisp_align_malloc (sizeof *new, MEM_TYPE_FLOAT);
 	  new->next = float_block;
 	  memset (new->gcmarkbits, 0, sizeof new->gcmarkbits);
+	  memset (new->livebits, 0, sizeof new->livebits);
 	  float_block = new;
 	  float_block_index = 0;
 	  total_free_floats += FLOAT_BLOCK_SIZE;
@@ -2448,7 +3269,10 @@ make_float (double float_value)
 
   XFLOAT_INIT (val, float_value);
   eassert (!FLOAT_MARKED_P (XFLOAT (val)));
+  eassert (!FLOAT_LIVE_P (XFLOAT (val)));
+  SETLIVEBIT (FLOAT_BLOCK (XFLOAT (val)), FLOAT_INDEX (XFLOAT (val)));
   consing_since_gc += sizeof (struct Lisp_Float);
+  ALLOC_PROBE (Qfloats, sizeof (struct Lisp_Float));
   floats_consed++;
   total_free_floats--;
   return val;
@@ -2463,13 +3287,16 @@ make_float (double float_value)
 /* We store cons cells inside of cons_blocks, allocating a new
    cons_block with malloc whenever necessary.  Cons cells reclaimed by
    GC are put on a free list to be reallocated before allocating
-   any new cons cells from the latest cons_block.  */
+   any new cons cells from the latest cons_block.  As for floats, the
+   free list is built lazily from the `livebits' left by GC.  */
 
 #define CONS_BLOCK_SIZE						\
   (((BLOCK_BYTES - sizeof (struct cons_block *)			\
      /* The compiler might add padding at the end.  */		\
-     - (sizeof (struct Lisp_Cons) - sizeof (bits_word))) * CHAR_BIT)	\
-   / (sizeof (struct Lisp_Cons) * CHAR_BIT + 1))
+     - (sizeof (struct Lisp_Cons) - sizeof (bits_word))		\
+     /* Two bit vectors, each with one extra word.  */		\
+     - sizeof (bits_word)) * CHAR_BIT)				\
+   / (sizeof (struct Lisp_Cons) * CHAR_BIT + 2))
 
 #define CONS_BLOCK(fptr) \
   ((struct cons_block *) ((uintptr_t) (fptr) & ~(BLOCK_ALIGN - 1)))
@@ -2482,9 +3309,13 @@ struct cons_block
   /* Place `conses' at the beginning, to ease up CONS_INDEX's job.  */
   struct Lisp_Cons conses[CONS_BLOCK_SIZE];
   bits_word gcmarkbits[1 + CONS_BLOCK_SIZE / BITS_PER_BITS_WORD];
+  /* Bit N is set if conses[N] is in use.  */
+  bits_word livebits[1 + CONS_BLOCK_SIZE / BITS_PER_BITS_WORD];
   struct cons_block *next;
 };
 
+verify (sizeof (struct cons_block) <= BLOCK_BYTES);
+
 #define CONS_MARKED_P(fptr) \
   GETMARKBIT (CONS_BLOCK (fptr), CONS_INDEX ((fptr)))
 
@@ -2494,6 +3325,9 @@ struct cons_block
 #define CONS_UNMARK(fptr) \
   UNSETMARKBIT (CONS_BLOCK (fptr), CONS_INDEX ((fptr)))
 
+#define CONS_LIVE_P(fptr) \
+  GETLIVEBIT (CONS_BLOCK (fptr), CONS_INDEX ((fptr)))
+
 /* Current cons_block.  */
 
 static struct cons_block *cons_block;
@@ -2506,16 +3340,73 @@ static int cons_block_index = CONS_BLOCK_SIZE;
 
 static struct Lisp_Cons *cons_free_list;
 
-/* Explicitly free a cons cell by putting it on the free-list.  */
+/* Next cons_block still to be swept since the last GC, or NULL if
+   all of them have been.  */
+
+static struct cons_block *cons_sweep_block;
+
+/* Put the free conses of the next unswept cons block on the free
+   list.  */
+
+static void
+sweep_next_cons_block (void)
+{
+  struct cons_block *cblk = cons_sweep_block;
+  int lim = cblk == cons_block ? cons_block_index : CONS_BLOCK_SIZE;
+  int ilim = (lim + BITS_PER_BITS_WORD - 1) / BITS_PER_BITS_WORD;
+  int i;
+
+  cons_sweep_block = cblk->next;
+
+  /* Scan the live bits a word at a time.  */
+  for (i = 0; i < ilim; i++)
+    {
+      int start, pos, stop;
+
+      /* Fast path - all cons cells for this word are in use.  */
+      if (cblk->livebits[i] == BITS_WORD_MAX)
+	continue;
+
+      start = i * BITS_PER_BITS_WORD;
+      stop = min (lim - start, BITS_PER_BITS_WORD) + start;
+      for (pos = start; pos < stop; pos++)
+	if (!GETLIVEBIT (cblk, pos))
+	  {
+	    cblk->conses[pos].u.chain = cons_free_list;
+	    cons_free_list = &cblk->conses[pos];
+#if GC_MARK_STACK
+	    cons_free_list->car = Vdead;
+#endif
+	  }
+    }
+}
+
+/* Sweep cons blocks that were left unswept by the last GC, until
+   some free conses turn up or no unswept block remains.  */
+
+static void
+lazy_sweep_conses (void)
+{
+  while (!cons_free_list && cons_sweep_block)
+    sweep_next_cons_block ();
+}
+
+/* Explicitly free a cons cell.  If every block has been swept since
+   the last GC, put it on the free-list; otherwise its block may be
+   swept later, so leave it to be reclaimed then or by the next GC.  */
 
 void
 free_cons (struct Lisp_Cons *ptr)
 {
-  ptr->u.chain = cons_free_list;
+  UNSETLIVEBIT (CONS_BLOCK (ptr), CONS_INDEX (ptr));
 #if GC_MARK_STACK
   ptr->car = Vdead;
 #endif
-  cons_free_list = ptr;
+  if (!cons_sweep_block)
+    {
+      ptr->u.chain = cons_free_list;
+      cons_free_list = ptr;
+    }
   consing_since_gc -= sizeof *ptr;
   total_free_conses++;
 }
@@ -2528,6 +3419,9 @@ DEFUN ("cons", Fcons, Scons, 2, 2, 0,
 
   MALLOC_BLOCK_INPUT;
 
+  if (!cons_free_list)
+    lazy_sweep_conses ();
+
   if (cons_free_list)
     {
       /* We use the cdr for chaining the free list
@@ -2542,6 +3436,7 @@ DEFUN ("cons", Fcons, Scons, 2, 2, 0,
 	  struct cons_block *new
 	    = lisp_align_malloc (sizeof *new, MEM_TYPE_CONS);
 	  memset (new->gcmarkbits, 0, sizeof new->gcmarkbits);
+	  memset (new->livebits, 0, sizeof new->livebits);
 	  new->next = cons_block;
 	  cons_block = new;
 	  cons_block_index = 0;
@@ -2556,9 +3451,12 @@ DEFUN ("cons", Fcons, Scons, 2, 2, 0,
   XSETCAR (val, car);
   XSETCDR (val, cdr);
   eassert (!CONS_MARKED_P (XCONS (val)));
+  eassert (!CONS_LIVE_P (XCONS (val)));
+  SETLIVEBIT (CONS_BLOCK (XCONS (val)), CONS_INDEX (XCONS (val)));
   consing_since_gc += sizeof (struct Lisp_Cons);
   total_free_conses--;
   cons_cells_consed++;
+  ALLOC_PROBE (Qconses, sizeof (struct Lisp_Cons));
   return val;
 }
 
@@ -2808,6 +3706,9 @@ verify (VECTOR_BLOCK_SIZE <= (1 << PSEUDOVECTOR_SIZE_BITS));
 struct large_vector
 {
   struct large_vector *next;
+
+  /* The number of bytes mapped for this vector by lisp_malloc_large.  */
+  size_t mapped;
 };
 
 enum
@@ -2998,6 +3899,12 @@ cleanup_vector (struct Lisp_Vector *vector)
 	  drv->close ((struct font *) vector);
 	}
     }
+  else if (PSEUDOVECTOR_TYPEP (&vector->header, PVEC_THREAD))
+    finalize_one_thread ((struct thread_state *) vector);
+  else if (PSEUDOVECTOR_TYPEP (&vector->header, PVEC_MUTEX))
+    finalize_one_mutex ((struct Lisp_Mutex *) vector);
+  else if (PSEUDOVECTOR_TYPEP (&vector->header, PVEC_CONDVAR))
+    finalize_one_condvar ((struct Lisp_CondVar *) vector);
 }
 
 /* Reclaim space used by unmarked vectors.  */
@@ -3075,6 +3982,7 @@ sweep_vectors (void)
 	  mem_delete (mem_find (block->data));
 #endif
 	  xfree (block);
+	  heap_freed = true;
 	}
       else
 	bprev = &block->next;
@@ -3105,7 +4013,7 @@ sweep_vectors (void)
       else
 	{
 	  *lvprev = lv->next;
-	  lisp_free (lv);
+	  lisp_free_large (lv, lv->mapped);
 	}
     }
 }
@@ -3135,10 +4043,12 @@ allocate_vectorlike (ptrdiff_t len)
 	p = allocate_vector_from_block (vroundup (nbytes));
       else
 	{
+	  size_t mapped;
 	  struct large_vector *lv
-	    = lisp_malloc ((large_vector_offset + header_size
-			    + len * word_size),
-			   MEM_TYPE_VECTORLIKE);
+	    = lisp_malloc_large ((large_vector_offset + header_size
+				  + len * word_size),
+				 MEM_TYPE_VECTORLIKE, &mapped);
+	  lv->mapped = mapped;
 	  lv->next = large_vectors;
 	  large_vectors = lv;
 	  p = large_vector_vec (lv);
@@ -3154,10 +4064,13 @@ allocate_vectorlike (ptrdiff_t len)
 
       consing_since_gc += nbytes;
       vector_cells_consed += len;
+      vector_bytes_consed += nbytes;
     }
 
   MALLOC_UNBLOCK_INPUT;
 
+  if (len)
+    ALLOC_PROBE (Qvectors, header_size + len * word_size);
   return p;
 }
 
@@ -3204,6 +4117,8 @@ allocate_buffer (void)
 {
   struct buffer *b = lisp_malloc (sizeof *b, MEM_TYPE_BUFFER);
 
+  buffers_consed++;
+  ALLOC_PROBE (Qbuffers, sizeof *b);
   BUFFER_PVEC_INIT (b);
   /* Put B on the chain of all buffers including killed ones.  */
   b->next = all_buffers;
@@ -3460,6 +4375,7 @@ Its value is void, and its function definition and property list are nil.  */)
   consing_since_gc += sizeof (struct Lisp_Symbol);
   symbols_consed++;
   total_free_symbols--;
+  ALLOC_PROBE (Qsymbols, sizeof (struct Lisp_Symbol));
   return val;
 }
 
@@ -3532,6 +4448,7 @@ allocate_misc (enum Lisp_Misc_Type type)
   --total_free_markers;
   consing_since_gc += sizeof (union Lisp_Misc);
   misc_objects_consed++;
+  ALLOC_PROBE (Qmiscs, sizeof (union Lisp_Misc));
   XMISCANY (val)->type = type;
   XMISCANY (val)->gcmarkbit = 0;
   return val;
@@ -3874,7 +4791,13 @@ refill_memory_reserve (void)
    lisp_free removes it with mem_delete.  Functions live_string_p etc
    call mem_find to lookup information about a given pointer in the
    tree, and use that to determine if the pointer points to a Lisp
-   object or not.  */
+   object or not.
+
+   Since most words on the stack are not pointers to Lisp data, and
+   most Lisp data is in blocks that do not share pages of memory with
+   other blocks, mem_find first looks the pointer up in the page map
+   (see mem_page_root), and searches the tree only for pages shared by
+   several blocks.  */
 
 /* Initialize this part of alloc.c.  */
 
@@ -3889,6 +4812,105 @@ mem_init (void)
 }
 
 
+/* Allocate SIZE bytes of zeroed memory for the page map.  */
+
+static void *
+mem_page_alloc (size_t size)
+{
+#ifdef GC_MALLOC_CHECK
+  void *p = calloc (1, size);
+  if (p == NULL)
+    emacs_abort ();
+  return p;
+#else
+  return xzalloc (size);
+#endif
+}
+
+/* Return the leaf of the page map containing the page of address P,
+   which must satisfy MEM_PAGE_MAPPED_P, and store into *I the index
+   of that page in the leaf.  If there is no such leaf yet, create it
+   if CREATE, and otherwise return NULL.  */
+
+static struct mem_page_leaf *
+mem_page_leaf (void *p, bool create, int *i)
+{
+  uintptr_t page = (uintptr_t) p >> MEM_PAGE_BITS;
+  struct mem_page_mid **mid
+    = &mem_page_root[page >> (MEM_LEAF_BITS + MEM_MID_BITS)];
+  struct mem_page_leaf **leaf;
+
+  if (!*mid)
+    {
+      if (!create)
+	return NULL;
+      *mid = mem_page_alloc (sizeof **mid);
+    }
+  leaf = &(*mid)->leaf[(page >> MEM_LEAF_BITS) & ((1 << MEM_MID_BITS) - 1)];
+  if (!*leaf && create)
+    *leaf = mem_page_alloc (sizeof **leaf);
+  *i = page & ((1 << MEM_LEAF_BITS) - 1);
+  return *leaf;
+}
+
+/* Return a node of the tree overlapping the region from START to END,
+   or NULL if there is none.  */
+
+static struct mem_node *
+mem_find_overlap (void *start, void *end)
+{
+  struct mem_node *p = mem_root;
+
+  while (p != MEM_NIL)
+    if (p->end <= start)
+      p = p->right;
+    else if (end <= p->start)
+      p = p->left;
+    else
+      return p;
+  return NULL;
+}
+
+/* Update the page map for the block from START to END.  If DELTA is
+   1, node X has just been inserted into the tree for it; if DELTA is
+   -1, its node has just been removed from the tree; if DELTA is 0,
+   its node is now X.  */
+
+static void
+mem_page_map_update (void *start, void *end, struct mem_node *x, int delta)
+{
+  uintptr_t page = (uintptr_t) start >> MEM_PAGE_BITS;
+  uintptr_t last = ((uintptr_t) end - 1) >> MEM_PAGE_BITS;
+
+  for (; page <= last; page++)
+    {
+      char *p = (char *) (page << MEM_PAGE_BITS);
+      struct mem_page_leaf *leaf;
+      int i;
+
+      if (!MEM_PAGE_MAPPED_P (p))
+	break;
+      leaf = mem_page_leaf (p, delta > 0, &i);
+      eassert (leaf);
+
+      if (delta > 0)
+	{
+	  eassert (leaf->count[i] < USHRT_MAX);
+	  leaf->node[i] = leaf->count[i]++ ? NULL : x;
+	}
+      else if (delta < 0)
+	{
+	  eassert (leaf->count[i] > 0);
+	  leaf->count[i]--;
+	  leaf->node[i] = (leaf->count[i] == 1
+			   ? mem_find_overlap (p, p + (1 << MEM_PAGE_BITS))
+			   : NULL);
+	}
+      else if (leaf->count[i] == 1)
+	leaf->node[i] = x;
+    }
+}
+
 /* Value is a pointer to the mem_node containing START.  Value is
    MEM_NIL if there is no node in the tree containing START.  */
 
@@ -3900,6 +4922,20 @@ mem_find (void *start)
   if (start < min_heap_address || start > max_heap_address)
     return MEM_NIL;
 
+  if (MEM_PAGE_MAPPED_P (start))
+    {
+      int i;
+      struct mem_page_leaf *leaf = mem_page_leaf (start, false, &i);
+
+      if (!leaf || leaf->count[i] == 0)
+	return MEM_NIL;
+      if (leaf->count[i] == 1)
+	{
+	  p = leaf->node[i];
+	  return start >= p->start && start < p->end ? p : MEM_NIL;
+	}
+    }
+
   /* Make the search always successful to speed up the loop below.  */
   mem_z.start = start;
   mem_z.end = (char *) start + 1;
@@ -3980,6 +5016,7 @@ mem_insert (void *start, void *end, enum mem_type type)
   /* Re-establish red-black tree properties.  */
   mem_insert_fixup (x);
 
+  mem_page_map_update (start, end, x, 1);
   return x;
 }
 
@@ -4137,10 +5174,14 @@ static void
 mem_delete (struct mem_node *z)
 {
   struct mem_node *x, *y;
+  void *start, *end;
 
   if (!z || z == MEM_NIL)
     return;
 
+  start = z->start;
+  end = z->end;
+
   if (z->left == MEM_NIL || z->right == MEM_NIL)
     y = z;
   else
@@ -4171,11 +5212,14 @@ mem_delete (struct mem_node *z)
       z->start = y->start;
       z->end = y->end;
       z->type = y->type;
+      mem_page_map_update (z->start, z->end, z, 0);
     }
 
   if (y->color == MEM_BLACK)
     mem_delete_fixup (x);
 
+  mem_page_map_update (start, end, NULL, -1);
+
 #ifdef GC_MALLOC_CHECK
   free (y);
 #else
@@ -4299,15 +5343,13 @@ live_cons_p (struct mem_node *m, void *p)
       struct cons_block *b = m->start;
       ptrdiff_t offset = (char *) p - (char *) &b->conses[0];
 
-      /* P must point to the start of a Lisp_Cons, not be
-	 one of the unused cells in the current cons block,
-	 and not be on the free-list.  */
+      /* P must point to the start of a Lisp_Cons that is in use,
+	 i.e. not one of the unused cells in the current cons block,
+	 not on the free-list, and not garbage still to be swept.  */
       return (offset >= 0
 	      && offset % sizeof b->conses[0] == 0
 	      && offset < (CONS_BLOCK_SIZE * sizeof b->conses[0])
-	      && (b != cons_block
-		  || offset / sizeof b->conses[0] < cons_block_index)
-	      && !EQ (((struct Lisp_Cons *) p)->car, Vdead));
+	      && GETLIVEBIT (b, offset / sizeof b->conses[0]));
     }
   else
     return 0;
@@ -4351,13 +5393,11 @@ live_float_p (struct mem_node *m, void *p)
       struct float_block *b = m->start;
       ptrdiff_t offset = (char *) p - (char *) &b->floats[0];
 
-      /* P must point to the start of a Lisp_Float and not be
-	 one of the unused cells in the current float block.  */
+      /* P must point to the start of a Lisp_Float that is in use.  */
       return (offset >= 0
 	      && offset % sizeof b->floats[0] == 0
 	      && offset < (FLOAT_BLOCK_SIZE * sizeof b->floats[0])
-	      && (b != float_block
-		  || offset / sizeof b->floats[0] < float_block_index));
+	      && GETLIVEBIT (b, offset / sizeof b->floats[0]));
     }
   else
     return 0;
@@ -4898,16 +5938,18 @@ dump_zombies (void)
    pass starting at the start of the stack + 2.  Likewise, if the
    minimal alignment of Lisp_Objects on the stack is 1, four passes
    would be necessary, each one starting with one byte more offset
-   from the stack start.  */
+   from the stack start.
 
-static void
-mark_stack (void *end)
-{
+   Each thread has its own stack; this marks the part of one from
+   BOTTOM to END.  */
 
+void
+mark_stack (char *bottom, char *end)
+{
   /* This assumes that the stack is a contiguous region in memory.  If
      that's not the case, something has to be done here to iterate
      over the stack segments.  */
-  mark_memory (stack_base, end);
+  mark_memory (bottom, end);
 
   /* Allow for marking a secondary stack, like the register stack on the
      ia64.  */
@@ -5535,62 +6577,273 @@ mark_pinned_symbols (void)
     }
 }
 
-/* Subroutine of Fgarbage_collect that does most of the work.  It is a
-   separate function so that we could limit mark_stack in searching
-   the stack frames below this function, thus avoiding the rare cases
-   where mark_stack finds values that look like live Lisp objects on
-   portions of stack that couldn't possibly contain such live objects.
-   For more details of this, see the discussion at
-   http://lists.gnu.org/archive/html/emacs-devel/2014-05/msg00270.html.  */
-static Lisp_Object
-garbage_collect_1 (void *end)
+/* The kinds of objects that gc_sweep sweeps, in order.  */
+
+enum gc_kind
+  {
+    GC_STRINGS, GC_CONSES, GC_FLOATS, GC_INTERVALS,
+    GC_SYMBOLS, GC_MISCS, GC_BUFFERS, GC_VECTORS,
+    GC_KINDS
+  };
+
+/* The symbols naming them in `garbage-collection-history'.  */
+
+static Lisp_Object *const gc_kind_names[GC_KINDS] =
+  {
+    &Qstrings, &Qconses, &Qfloats, &Qintervals,
+    &Qsymbols, &Qmiscs, &Qbuffers, &Qvectors
+  };
+
+/* What happened during one garbage collection.  */
+
+struct gc_record
 {
-  struct buffer *nextb;
-  char stack_top_variable;
-  ptrdiff_t i;
-  bool message_p;
-  ptrdiff_t count = SPECPDL_INDEX ();
-  struct timespec start;
-  Lisp_Object retval = Qnil;
-  size_t tot_before = 0;
+  /* The value of gcs_done when it started.  */
+  EMACS_INT number;
 
-  if (abort_on_gc)
-    emacs_abort ();
+  /* Why it happened.  */
+  enum gc_trigger trigger;
 
-  /* Can't GC if pure storage overflowed because we can't determine
-     if something is a pure object or not.  */
-  if (pure_bytes_used_before_overflow)
-    return Qnil;
+  /* Seconds spent in the whole collection, in marking (scanning the C
+     stack included), in scanning the C stack, in processing weak hash
+     tables, and in sweeping each kind of object.  */
+  double pause, mark, stack, weak, sweep[GC_KINDS];
 
-  /* Record this function, so it appears on the profiler's backtraces.  */
-  record_in_backtrace (Qautomatic_gc, &Qnil, 0);
+  /* Number of bytes reclaimed for each kind of object.  */
+  EMACS_INT reclaimed[GC_KINDS];
 
-  check_cons_list ();
+  /* Number of bytes of consing after which the next collection was
+     due, as computed by schedule_next_gc.  */
+  EMACS_INT threshold;
+};
 
-  /* Don't keep undo information around forever.
-     Do this early on, so it is no problem if the user quits.  */
-  FOR_EACH_BUFFER (nextb)
-    compact_buffer (nextb);
+/* The last GC_HISTORY_SIZE collections.  Collection number N is at
+   index N % GC_HISTORY_SIZE.  */
 
-  if (profiler_memory_running)
-    tot_before = total_bytes_of_live_objects ();
+enum { GC_HISTORY_SIZE = 64 };
+static struct gc_record gc_history[GC_HISTORY_SIZE];
 
-  start = current_timespec ();
+/* Why the next collection happens.  Callers that collect garbage for
+   some other reason than being asked to set this before they do, and
+   garbage_collect_1 resets it.  */
 
-  /* In case user calls debug_print during GC,
-     don't let that cause a recursive GC.  */
-  consing_since_gc = 0;
+enum gc_trigger gc_trigger;
 
-  /* Save what's currently displayed in the echo area.  */
-  message_p = push_message ();
-  record_unwind_protect_void (pop_message_unwind);
+/* Bytes of each kind of object found live by the last collection, and
+   bytes allocated for each kind up to then.  */
 
-  /* Save a copy of the contents of the stack, for debugging.  */
-#if MAX_SAVE_STACK > 0
-  if (NILP (Vpurify_flag))
+static EMACS_INT gc_live_bytes[GC_KINDS], gc_consed_bytes[GC_KINDS];
+
+/* Store into LIVE the number of bytes of each kind of object that the
+   last sweep found live, and into CONSED the number of bytes allocated
+   for each kind so far.  */
+
+static void
+gc_kind_bytes (EMACS_INT *live, EMACS_INT *consed)
+{
+  live[GC_STRINGS] = (total_strings * (EMACS_INT) sizeof (struct Lisp_String)
+		      + total_string_bytes);
+  consed[GC_STRINGS] = (strings_consed * (EMACS_INT) sizeof (struct Lisp_String)
+			+ string_chars_consed);
+  live[GC_CONSES] = total_conses * (EMACS_INT) sizeof (struct Lisp_Cons);
+  consed[GC_CONSES] = cons_cells_consed * (EMACS_INT) sizeof (struct Lisp_Cons);
+  live[GC_FLOATS] = total_floats * (EMACS_INT) sizeof (struct Lisp_Float);
+  consed[GC_FLOATS] = floats_consed * (EMACS_INT) sizeof (struct Lisp_Float);
+  live[GC_INTERVALS] = total_intervals * (EMACS_INT) sizeof (struct interval);
+  consed[GC_INTERVALS] = intervals_consed * (EMACS_INT) sizeof (struct interval);
+  live[GC_SYMBOLS] = total_symbols * (EMACS_INT) sizeof (struct Lisp_Symbol);
+  consed[GC_SYMBOLS] = symbols_consed * (EMACS_INT) sizeof (struct Lisp_Symbol);
+  live[GC_MISCS] = total_markers * (EMACS_INT) sizeof (union Lisp_Misc);
+  consed[GC_MISCS] = misc_objects_consed * (EMACS_INT) sizeof (union Lisp_Misc);
+  live[GC_BUFFERS] = total_buffers * (EMACS_INT) sizeof (struct buffer);
+  consed[GC_BUFFERS] = buffers_consed * (EMACS_INT) sizeof (struct buffer);
+  live[GC_VECTORS] = total_vector_slots * word_size;
+  consed[GC_VECTORS] = vector_bytes_consed;
+}
+
+/* Record into REC how many bytes of each kind of object the sweep that
+   just finished reclaimed: those live after the previous collection
+   or allocated since, but not live any more.  */
+
+static void
+gc_record_reclaimed (struct gc_record *rec)
+{
+  EMACS_INT live[GC_KINDS], consed[GC_KINDS];
+  int k;
+
+  gc_kind_bytes (live, consed);
+  for (k = 0; k < GC_KINDS; k++)
     {
-      char *stack;
-      ptrdiff_t stack_size;
+      EMACS_INT before = gc_live_bytes[k] + (consed[k] - gc_consed_bytes[k]);
+      rec->reclaimed[k] = max (0, before - live[k]);
+      gc_live_bytes[k] = live[k];
+      gc_consed_bytes[k] = consed[k];
+    }
+}
+
+/* Return the number of seconds from *T to now, and set *T to now.  */
+
+static double
+gc_lap (struct timespec *t)
+{
+  struct timespec now = current_timespec ();
+  double lap = timespectod (timespec_sub (now, *t));
+  *t = now;
+  return lap;
+}
+
+/* Scheduling of garbage collections.
+
+   Rather than collecting every time a fixed amount of consing has been
+   done, schedule_next_gc multiplies the threshold given by
+   `gc-cons-threshold' and `gc-cons-percentage' by a factor that it
+   raises when collections take more than `gc-target-overhead' of the
+   time or find that most of what was allocated is still alive, and
+   lowers again when they are cheap.  Collections that are expected to
+   take longer than `gc-pause-limit' are put off until Emacs is idle,
+   within limits, and maybe_gc_when_idle runs them then.  */
+
+/* The most that the threshold is multiplied by.  */
+
+enum { GC_ADAPTIVE_FACTOR_MAX = 64 };
+
+/* How many times the threshold consing may reach when collections are
+   put off because of `gc-pause-limit'.  */
+
+enum { GC_PAUSE_LIMIT_SLACK = 4 };
+
+/* What the threshold is multiplied by currently.  */
+
+static double gc_adaptive_factor = 1;
+
+/* Number of bytes of consing after which the next collection is due,
+   whether or not it is put off until Emacs is idle.  */
+
+static EMACS_INT gc_scheduled_threshold;
+
+/* Seconds that the last collection took per byte of heap it looked
+   at, to predict how long the next one will take.  */
+
+static double gc_pause_per_byte;
+
+/* When the last collection ended.  */
+
+static struct timespec gc_last_end;
+
+/* Compute when the next collection is due.  REC describes the one that
+   just ended, which started at START after CONSED bytes had been
+   allocated since the previous one.  Store the threshold into REC.  */
+
+static void
+schedule_next_gc (struct gc_record *rec, struct timespec start,
+		  EMACS_INT consed)
+{
+  double live = total_bytes_of_live_objects ();
+  double reclaimed = 0, threshold = gc_cons_threshold;
+  int k;
+
+  for (k = 0; k < GC_KINDS; k++)
+    reclaimed += rec->reclaimed[k];
+  gc_pause_per_byte = rec->pause / max (live + reclaimed, 1);
+
+  if (FLOATP (Vgc_cons_percentage))
+    threshold = max (threshold, live * XFLOAT_DATA (Vgc_cons_percentage));
+
+  if (NUMBERP (Vgc_target_overhead) && timespec_valid_p (gc_last_end))
+    {
+      double target = extract_float (Vgc_target_overhead);
+      double between = timespectod (timespec_sub (start, gc_last_end));
+      double overhead = rec->pause / (rec->pause + max (between, 0));
+      double survival = 0 < consed ? 1 - min (reclaimed / consed, 1) : 0;
+
+      if (target < overhead || 0.9 < survival)
+	gc_adaptive_factor = min (2 * gc_adaptive_factor,
+				  GC_ADAPTIVE_FACTOR_MAX);
+      else if (overhead < target / 4)
+	gc_adaptive_factor = max (gc_adaptive_factor / 2, 1);
+    }
+  else
+    gc_adaptive_factor = 1;
+
+  /* Don't let the heap grow by more than its size before the next
+     collection, beyond what the user asked for.  */
+  threshold = min (threshold * gc_adaptive_factor, max (threshold, live));
+  gc_scheduled_threshold = min (threshold, TYPE_MAXIMUM (EMACS_INT));
+
+  if (NUMBERP (Vgc_pause_limit) && !noninteractive
+      && extract_float (Vgc_pause_limit) < gc_pause_per_byte * (live
+								+ threshold))
+    threshold *= GC_PAUSE_LIMIT_SLACK;
+  gc_relative_threshold = min (threshold, TYPE_MAXIMUM (EMACS_INT));
+
+  rec->threshold = gc_relative_threshold;
+  gc_last_end = current_timespec ();
+}
+
+/* Subroutine of Fgarbage_collect that does most of the work.  It is a
+   separate function so that we could limit mark_stack in searching
+   the stack frames below this function, thus avoiding the rare cases
+   where mark_stack finds values that look like live Lisp objects on
+   portions of stack that couldn't possibly contain such live objects.
+   For more details of this, see the discussion at
+   http://lists.gnu.org/archive/html/emacs-devel/2014-05/msg00270.html.  */
+static Lisp_Object
+garbage_collect_1 (void)
+{
+  struct buffer *nextb;
+  char stack_top_variable;
+  ptrdiff_t i;
+  bool message_p;
+  ptrdiff_t count = SPECPDL_INDEX ();
+  struct timespec start, phase;
+  Lisp_Object retval = Qnil;
+  size_t tot_before = 0;
+  EMACS_INT consed;
+  struct gc_record rec;
+
+  if (abort_on_gc)
+    emacs_abort ();
+
+  memset (&rec, 0, sizeof rec);
+  rec.number = gcs_done;
+  rec.trigger = gc_trigger;
+  gc_trigger = GC_TRIGGER_EXPLICIT;
+
+  /* Can't GC if pure storage overflowed because we can't determine
+     if something is a pure object or not.  */
+  if (pure_bytes_used_before_overflow)
+    return Qnil;
+
+  /* Record this function, so it appears on the profiler's backtraces.  */
+  record_in_backtrace (Qautomatic_gc, &Qnil, 0);
+
+  check_cons_list ();
+
+  /* Don't keep undo information around forever.
+     Do this early on, so it is no problem if the user quits.  */
+  FOR_EACH_BUFFER (nextb)
+    compact_buffer (nextb);
+
+  if (profiler_memory_running)
+    tot_before = total_bytes_of_live_objects ();
+
+  start = current_timespec ();
+
+  /* In case user calls debug_print during GC,
+     don't let that cause a recursive GC.  */
+  consed = consing_since_gc;
+  consing_since_gc = 0;
+
+  /* Save what's currently displayed in the echo area.  */
+  message_p = push_message ();
+  record_unwind_protect_void (pop_message_unwind);
+
+  /* Save a copy of the contents of the stack, for debugging.  */
+#if MAX_SAVE_STACK > 0
+  if (NILP (Vpurify_flag))
+    {
+      char *stack;
+      ptrdiff_t stack_size;
       if (&stack_top_variable < stack_bottom)
 	{
 	  stack = &stack_top_variable;
@@ -5621,17 +6874,22 @@ garbage_collect_1 (void *end)
   shrink_regexp_cache ();
 
   gc_in_progress = 1;
+  phase = current_timespec ();
+
+#if PARALLEL_MARK
+  mark_conses_in_parallel = gc_threads > 1;
+#endif
 
   /* Mark all the special slots that serve as the roots of accessibility.  */
 
   mark_buffer (&buffer_defaults);
   mark_buffer (&buffer_local_symbols);
+  process_mark_stack (0);
 
   for (i = 0; i < staticidx; i++)
     mark_object (*staticvec[i]);
 
   mark_pinned_symbols ();
-  mark_specpdl ();
   mark_terminals ();
   mark_kboards ();
 
@@ -5639,34 +6897,17 @@ garbage_collect_1 (void *end)
   xg_mark_data ();
 #endif
 
-#if (GC_MARK_STACK == GC_MAKE_GCPROS_NOOPS \
-     || GC_MARK_STACK == GC_MARK_STACK_CHECK_GCPROS)
-  mark_stack (end);
-#else
+  /* Mark the specpdl, handlers and stack of every thread.  */
   {
-    register struct gcpro *tail;
-    for (tail = gcprolist; tail; tail = tail->next)
-      for (i = 0; i < tail->nvars; i++)
-	mark_object (tail->var[i]);
-  }
-  mark_byte_stack ();
-#endif
-  {
-    struct handler *handler;
-    for (handler = handlerlist; handler; handler = handler->next)
-      {
-	mark_object (handler->tag_or_ch);
-	mark_object (handler->val);
-      }
+    struct timespec stack_start = current_timespec ();
+    mark_threads ();
+    rec.stack = gc_lap (&stack_start);
   }
+
 #ifdef HAVE_WINDOW_SYSTEM
   mark_fringe_data ();
 #endif
 
-#if GC_MARK_STACK == GC_USE_GCPROS_CHECK_ZOMBIES
-  mark_stack (end);
-#endif
-
   /* Everything is now marked, except for the data in font caches
      and undo lists.  They're compacted by removing an items which
      aren't reachable otherwise.  */
@@ -5682,11 +6923,15 @@ garbage_collect_1 (void *end)
       mark_object (BVAR (nextb, undo_list));
     }
 
-  gc_sweep ();
+  rec.mark = gc_lap (&phase);
+
+  gc_sweep (&rec);
+  gc_record_reclaimed (&rec);
+  trim_heap ();
 
   /* Clear the mark bits that we set in certain root slots.  */
 
-  unmark_byte_stack ();
+  unmark_threads ();
   VECTOR_UNMARK (&buffer_defaults);
   VECTOR_UNMARK (&buffer_local_symbols);
 
@@ -5704,21 +6949,6 @@ garbage_collect_1 (void *end)
   if (gc_cons_threshold < GC_DEFAULT_THRESHOLD / 10)
     gc_cons_threshold = GC_DEFAULT_THRESHOLD / 10;
 
-  gc_relative_threshold = 0;
-  if (FLOATP (Vgc_cons_percentage))
-    { /* Set gc_cons_combined_threshold.  */
-      double tot = total_bytes_of_live_objects ();
-
-      tot *= XFLOAT_DATA (Vgc_cons_percentage);
-      if (0 < tot)
-	{
-	  if (tot < TYPE_MAXIMUM (EMACS_INT))
-	    gc_relative_threshold = tot;
-	  else
-	    gc_relative_threshold = TYPE_MAXIMUM (EMACS_INT);
-	}
-    }
-
   if (garbage_collection_messages)
     {
       if (message_p || minibuf_level > 0)
@@ -5802,12 +7032,19 @@ garbage_collect_1 (void *end)
     }
 
   /* Accumulate statistics.  */
-  if (FLOATP (Vgc_elapsed))
-    {
-      struct timespec since_start = timespec_sub (current_timespec (), start);
-      Vgc_elapsed = make_float (XFLOAT_DATA (Vgc_elapsed)
-				+ timespectod (since_start));
-    }
+  {
+    double pause = timespectod (timespec_sub (current_timespec (), start));
+
+    if (FLOATP (Vgc_elapsed))
+      Vgc_elapsed = make_float (XFLOAT_DATA (Vgc_elapsed) + pause);
+    Vgc_last_pause = make_float (pause);
+    if (! (FLOATP (Vgc_max_pause) && pause <= XFLOAT_DATA (Vgc_max_pause)))
+      Vgc_max_pause = Vgc_last_pause;
+
+    rec.pause = pause;
+    schedule_next_gc (&rec, start, consed);
+    gc_history[rec.number % GC_HISTORY_SIZE] = rec;
+  }
 
   gcs_done++;
 
@@ -5824,6 +7061,12 @@ garbage_collect_1 (void *end)
   return retval;
 }
 
+static void
+garbage_collect_callback (void *result)
+{
+  *(Lisp_Object *) result = garbage_collect_1 ();
+}
+
 DEFUN ("garbage-collect", Fgarbage_collect, Sgarbage_collect, 0, 0, "",
        doc: /* Reclaim storage for Lisp objects no longer needed.
 Garbage collection happens automatically if you cons more than
@@ -5840,6 +7083,22 @@ However, if there was overflow in pure space, `garbage-collect'
 returns nil, because real GC can't be done.
 See Info node `(elisp)Garbage Collection'.  */)
   (void)
+{
+  Lisp_Object result;
+
+  flush_stack_call_func (garbage_collect_callback, &result);
+  return result;
+}
+
+/* Flush the registers of the current thread to its stack, record the
+   top of the stack in current_thread->stack_top, and call FUNC with
+   ARG.  Garbage collection scans the stack of each thread from its
+   bottom to its stack_top, so a thread does this before it collects
+   garbage, and before it releases the global lock to let other
+   threads run.  */
+
+void
+flush_stack_call_func (void (*func) (void *arg), void *arg)
 {
 #if (GC_MARK_STACK == GC_MAKE_GCPROS_NOOPS		\
      || GC_MARK_STACK == GC_MARK_STACK_CHECK_GCPROS	\
@@ -5859,7 +7118,8 @@ See Info node `(elisp)Garbage Collection'.  */)
     Lisp_Object o;
     sys_jmp_buf j;
   } j;
-  volatile bool stack_grows_down_p = (char *) &j > (char *) stack_base;
+  volatile bool stack_grows_down_p
+    = (char *) &j > current_thread->m_stack_bottom;
 #endif
   /* This trick flushes the register windows so that all the state of
      the process is contained in the stack.  */
@@ -5897,13 +7157,30 @@ See Info node `(elisp)Garbage Collection'.  */)
   end = stack_grows_down_p ? (char *) &j + sizeof j : (char *) &j;
 #endif /* not GC_SAVE_REGISTERS_ON_STACK */
 #endif /* not HAVE___BUILTIN_UNWIND_INIT */
-  return garbage_collect_1 (end);
-#elif (GC_MARK_STACK == GC_USE_GCPROS_AS_BEFORE)
-  /* Old GCPROs-based method without stack marking.  */
-  return garbage_collect_1 (NULL);
-#else
-  emacs_abort ();
-#endif /* GC_MARK_STACK */
+#else /* not GC_MARK_STACK */
+  /* The stack is not scanned, so any address will do.  */
+  void *end = &end;
+#endif /* not GC_MARK_STACK */
+
+  current_thread->stack_top = end;
+  func (arg);
+}
+
+/* Called by the command loop when Emacs is idle and no input is
+   pending.  Collections put off because of `gc-pause-limit' happen
+   now.  */
+
+void
+maybe_gc_when_idle (void)
+{
+  if (consing_since_gc > max (gc_cons_threshold, gc_scheduled_threshold)
+      && consing_since_gc <= gc_relative_threshold)
+    {
+      gc_trigger = GC_TRIGGER_IDLE;
+      Fgarbage_collect ();
+    }
+  else
+    maybe_gc ();
 }
 
 /* Mark Lisp objects in glyph matrix MATRIX.  Currently the
@@ -5932,9 +7209,523 @@ mark_glyph_matrix (struct glyph_matrix *matrix)
       }
 }
 
+/* Entries of the mark stack.  An entry with N == 0 holds a single
+   object to mark; one with N > 0 points to N objects to mark, such as
+   the slots of a vector that remain to be marked.  */
+
+struct mark_entry
+{
+  ptrdiff_t n;
+  union
+  {
+    Lisp_Object value;
+    Lisp_Object *values;
+  } u;
+};
+
+/* The mark stack holds objects found to be reachable whose contents
+   have not been marked yet.  Using it instead of recursion means that
+   deeply nested data cannot overflow the C stack.  */
+
+static struct mark_entry *mark_stack_entries;
+
+/* Number of entries allocated for the mark stack, and number in use.  */
+
+static ptrdiff_t mark_stack_size, mark_stack_sp;
+
+/* Hint that the memory at ADDR will soon be read, so that fetching it
+   can overlap with marking other objects.  */
+
+#if 3 < __GNUC__ + (1 <= __GNUC_MINOR__)
+# define PREFETCH(addr) __builtin_prefetch (addr)
+#else
+# define PREFETCH(addr) ((void) 0)
+#endif
+
+/* Push an entry for the N objects at VALUES onto the mark stack.
+   If N is 0, push VALUE alone instead.  */
+
+static void
+mark_stack_push (Lisp_Object value, Lisp_Object *values, ptrdiff_t n)
+{
+  struct mark_entry *e;
+
+  if (mark_stack_sp == mark_stack_size)
+    mark_stack_entries = xpalloc (mark_stack_entries, &mark_stack_size, 1, -1,
+				  sizeof *mark_stack_entries);
+  e = &mark_stack_entries[mark_stack_sp++];
+  e->n = n;
+  if (n)
+    e->u.values = values;
+  else
+    e->u.value = value;
+  if (gc_mark_stack_max < mark_stack_sp)
+    gc_mark_stack_max = mark_stack_sp;
+}
+
+/* Push OBJ onto the mark stack.  */
+
+static void
+mark_stack_push_value (Lisp_Object obj)
+{
+  mark_stack_push (obj, NULL, 0);
+}
+
+/* Push the N objects at VALUES onto the mark stack.  */
+
+static void
+mark_stack_push_values (Lisp_Object *values, ptrdiff_t n)
+{
+  if (n > 0)
+    mark_stack_push (Qnil, values, n);
+}
+
+/* Pop an object off the mark stack, which must not be empty.  Prefetch
+   the object that will be popped after it.  */
+
+static Lisp_Object
+mark_stack_pop (void)
+{
+  struct mark_entry *e = &mark_stack_entries[mark_stack_sp - 1];
+  Lisp_Object obj, next;
+
+  if (e->n == 0)
+    {
+      obj = e->u.value;
+      if (--mark_stack_sp == 0)
+	return obj;
+      e--;
+      next = e->n ? e->u.values[0] : e->u.value;
+    }
+  else
+    {
+      obj = *e->u.values++;
+      if (--e->n == 0)
+	{
+	  mark_stack_sp--;
+	  return obj;
+	}
+      next = e->u.values[0];
+    }
+
+  if (!INTEGERP (next))
+    PREFETCH (XPNTR (next));
+  return obj;
+}
+
+/* Ephemerons.
+
+   An entry of a weak hash table is an ephemeron while its fate
+   depends on an object that is not marked yet, its trigger: the key of
+   an entry of a `key' weak table, the value of an entry of a `value'
+   weak table, and either of them for `key-or-value' tables.  If the
+   trigger turns out to be reachable, both key and value survive.
+
+   sweep_weak_hash_tables registers these entries with add_ephemeron
+   instead of scanning all weak tables again and again until nothing
+   changes.  Each object's ephemerons are fired as it is marked,
+   pushing their keys and values, so each weak entry is looked at a
+   constant number of times however long the chains of entries keeping
+   each other alive are.  process_mark_stack and the functions it
+   calls do this with maybe_fire_ephemerons; the GC threads marking
+   conses and floats hand those with pending ephemerons back to the
+   main thread, which fires them.  */
+
+struct ephemeron
+{
+  Lisp_Object trigger, key, value;
+
+  /* Index of the next ephemeron in the same bucket, or -1.  */
+  ptrdiff_t next;
+
+  /* True if the trigger has been marked.  */
+  bool fired;
+};
+
+static struct ephemeron *ephemerons;
+static ptrdiff_t ephemerons_size, ephemerons_used;
+
+/* Number of ephemerons that have not fired.  process_mark_stack
+   looks for ephemerons only while this is nonzero.  */
+
+static ptrdiff_t ephemerons_pending;
+
+/* Index of the first ephemeron of each bucket, or -1.  The number of
+   buckets is a power of 2, at least EPHEMERONS_SIZE.  */
+
+static ptrdiff_t *ephemeron_buckets;
+static ptrdiff_t ephemeron_nbuckets;
+
+static ptrdiff_t
+ephemeron_bucket (Lisp_Object obj)
+{
+  EMACS_UINT hash = XLI (obj);
+  hash ^= hash >> 17;
+  return (hash ^ (hash >> 3)) & (ephemeron_nbuckets - 1);
+}
+
+/* Register an entry of a weak hash table with key KEY and value VALUE
+   that survives the current GC if and only if TRIGGER does.  */
+
+void
+add_ephemeron (Lisp_Object trigger, Lisp_Object key, Lisp_Object value)
+{
+  struct ephemeron *e;
+  ptrdiff_t b;
+
+  if (ephemerons_used == ephemerons_size)
+    {
+      ptrdiff_t i;
+
+      ephemerons = xpalloc (ephemerons, &ephemerons_size, 1, -1,
+			    sizeof *ephemerons);
+      if (ephemeron_nbuckets < ephemerons_size)
+	{
+	  /* Make more buckets, and rehash.  */
+	  xfree (ephemeron_buckets);
+	  if (!ephemeron_nbuckets)
+	    ephemeron_nbuckets = 64;
+	  while (ephemeron_nbuckets < ephemerons_size)
+	    ephemeron_nbuckets *= 2;
+	  ephemeron_buckets = xnmalloc (ephemeron_nbuckets,
+					sizeof *ephemeron_buckets);
+	  for (b = 0; b < ephemeron_nbuckets; b++)
+	    ephemeron_buckets[b] = -1;
+	  for (i = 0; i < ephemerons_used; i++)
+	    {
+	      b = ephemeron_bucket (ephemerons[i].trigger);
+	      ephemerons[i].next = ephemeron_buckets[b];
+	      ephemeron_buckets[b] = i;
+	    }
+	}
+    }
+
+  b = ephemeron_bucket (trigger);
+  e = &ephemerons[ephemerons_used];
+  e->trigger = trigger;
+  e->key = key;
+  e->value = value;
+  e->fired = false;
+  e->next = ephemeron_buckets[b];
+  ephemeron_buckets[b] = ephemerons_used++;
+  ephemerons_pending++;
+}
+
+/* Fire ephemeron E, whose trigger has been marked.  */
+
+static void
+fire_ephemeron (struct ephemeron *e)
+{
+  e->fired = true;
+  ephemerons_pending--;
+  mark_stack_push_value (e->key);
+  mark_stack_push_value (e->value);
+}
+
+/* Fire the ephemerons whose trigger is OBJ, which is being marked.  */
+
+static void
+fire_ephemerons (Lisp_Object obj)
+{
+  ptrdiff_t i;
+
+  for (i = ephemeron_buckets[ephemeron_bucket (obj)]; 0 <= i;
+       i = ephemerons[i].next)
+    if (!ephemerons[i].fired && EQ (ephemerons[i].trigger, obj))
+      fire_ephemeron (&ephemerons[i]);
+}
+
+/* Fire the ephemerons of OBJ if it is not marked yet.  Code that
+   marks objects must call this before it marks each of them.  */
+
+static void
+maybe_fire_ephemerons (Lisp_Object obj)
+{
+  if (ephemerons_pending && !survives_gc_p (obj))
+    fire_ephemerons (obj);
+}
+
+/* Mark everything that the ephemerons registered so far keep alive.  */
+
+void
+mark_ephemerons (void)
+{
+#ifdef ENABLE_CHECKING
+  ptrdiff_t i;
+#endif
+
+  process_mark_stack (0);
+
+#ifdef ENABLE_CHECKING
+  /* Everything that marks an object fires its ephemerons.  */
+  for (i = 0; i < ephemerons_used; i++)
+    eassert (ephemerons[i].fired || !survives_gc_p (ephemerons[i].trigger));
+#endif
+}
+
+/* Forget all ephemerons, once weak hash tables have been processed.  */
+
+void
+clear_ephemerons (void)
+{
+  xfree (ephemerons);
+  xfree (ephemeron_buckets);
+  ephemerons = NULL;
+  ephemeron_buckets = NULL;
+  ephemerons_size = ephemerons_used = ephemerons_pending = 0;
+  ephemeron_nbuckets = 0;
+}
+
+/* Marking cons cells in parallel.
+
+   When `gc-threads' is more than 1, process_mark_stack does not mark
+   the cons cells it comes across, but collects them in mark_frontier.
+   Once its stack is empty, mark_frontier_conses traces the collected
+   conses, and the conses and floats they lead to, in several threads
+   at once, setting the mark bits of cons and float blocks atomically.
+   These threads do not mark any other kind of object; they hand the
+   ones they find back to process_mark_stack, which is the only code
+   that marks them.  So the two kinds of marking never overlap.  */
+
+#if PARALLEL_MARK
+
+/* Conses found by process_mark_stack but not marked yet.  */
+
+static Lisp_Object *mark_frontier;
+static ptrdiff_t mark_frontier_size, mark_frontier_used;
+
+/* Don't bother waking up the GC threads to mark fewer conses.  */
+
+enum { MARK_PARALLEL_MIN_CONSES = 4096 };
+
+/* Number of entries in the stack and in the vector of deferred
+   objects of each thread marking conses.  */
+
+enum { MARK_WORKER_STACK_SIZE = 16384, MARK_WORKER_DEFER_SIZE = 16384 };
+
+/* The state of a thread marking conses.  */
+
+struct mark_worker
+{
+  /* Conses still to be traced.  */
+  Lisp_Object *stack;
+  ptrdiff_t sp;
+
+  /* Objects found that are neither conses nor floats, for
+     process_mark_stack to mark, and conses and floats marked by this
+     thread whose ephemerons the main thread is to fire.  */
+  Lisp_Object *deferred;
+  ptrdiff_t ndeferred;
+
+  /* The part of mark_frontier that this thread did not get to, if
+     it ran out of room.  */
+  ptrdiff_t resume, end;
+};
+
+static struct mark_worker mark_workers[GC_THREADS_MAX];
+
+/* Set mark bit N of BLOCK atomically.  ATOMIC_SETMARKBIT also returns
+   true if the bit was not already set.  */
+
+#define ATOMIC_MARKBIT_OR(block, n)					\
+  __atomic_fetch_or (&(block)->gcmarkbits[(n) / BITS_PER_BITS_WORD],	\
+		     (bits_word) 1 << ((n) % BITS_PER_BITS_WORD),	\
+		     __ATOMIC_RELAXED)
+
+#define ATOMIC_SETMARKBIT(block, n)					\
+  (! ((ATOMIC_MARKBIT_OR (block, n) >> ((n) % BITS_PER_BITS_WORD)) & 1))
+
+/* Append OBJ, a cons, to mark_frontier.  */
+
+static void
+mark_frontier_push (Lisp_Object obj)
+{
+  if (mark_frontier_used == mark_frontier_size)
+    mark_frontier = xpalloc (mark_frontier, &mark_frontier_size, 1, -1,
+			     sizeof *mark_frontier);
+  mark_frontier[mark_frontier_used++] = obj;
+}
+
+/* Return true if OBJ is the trigger of an ephemeron that has not
+   fired.  The GC threads marking conses call this while the main
+   thread waits for them, so the ephemerons do not change meanwhile.  */
+
+static bool
+ephemeron_pending_p (Lisp_Object obj)
+{
+  ptrdiff_t i;
+
+  for (i = ephemeron_buckets[ephemeron_bucket (obj)]; 0 <= i;
+       i = ephemerons[i].next)
+    if (!ephemerons[i].fired && EQ (ephemerons[i].trigger, obj))
+      return true;
+  return false;
+}
+
+/* Deal with OBJ, found by the thread whose state is W: push it if it
+   is a cons, mark it if it is a float, and defer it to the main
+   thread if it is anything else that still needs marking, or a float
+   whose ephemerons need firing.  W must have room for one more object
+   of either kind.  */
+
+static void
+mark_worker_note (struct mark_worker *w, Lisp_Object obj)
+{
+  bool marked;
+
+  switch (XTYPE (obj))
+    {
+    case Lisp_Cons:
+      w->stack[w->sp++] = obj;
+      return;
+
+    case Lisp_Float:
+      if (!PURE_POINTER_P (XFLOAT (obj))
+	  && ATOMIC_SETMARKBIT (FLOAT_BLOCK (XFLOAT (obj)),
+				FLOAT_INDEX (XFLOAT (obj)))
+	  && ephemerons_pending && ephemeron_pending_p (obj))
+	w->deferred[w->ndeferred++] = obj;
+      return;
+
+    case_Lisp_Int:
+      return;
+
+    case Lisp_Symbol:
+      marked = XSYMBOL (obj)->gcmarkbit;
+      break;
+
+    case Lisp_String:
+      marked = STRING_MARKED_P (XSTRING (obj));
+      break;
+
+    case Lisp_Vectorlike:
+      marked = VECTOR_MARKED_P (XVECTOR (obj));
+      break;
+
+    default:
+      marked = false;
+      break;
+    }
+
+  if (!marked)
+    w->deferred[w->ndeferred++] = obj;
+}
+
+/* Do the share of thread K out of NTHREADS of the conses in
+   mark_frontier.  */
+
+static void
+mark_conses_share (int k, int nthreads)
+{
+  struct mark_worker *w = &mark_workers[k];
+  ptrdiff_t i = mark_frontier_used * k / nthreads;
+
+  w->sp = 0;
+  w->ndeferred = 0;
+  w->end = mark_frontier_used * (k + 1) / nthreads;
+
+  for (; i < w->end; i++)
+    {
+      Lisp_Object obj = mark_frontier[i];
+
+      for (;;)
+	{
+	  /* If there may not be room for what this step finds, stop
+	     and leave the rest to the main thread.  A step may defer
+	     the cons it marks as well as its car.  */
+	  if (w->sp >= MARK_WORKER_STACK_SIZE - 1
+	      || w->ndeferred >= MARK_WORKER_DEFER_SIZE - 2)
+	    {
+	      w->stack[w->sp++] = obj;
+	      w->resume = i + 1;
+	      return;
+	    }
+
+	  if (CONSP (obj))
+	    {
+	      struct Lisp_Cons *ptr = XCONS (obj);
+
+	      if (!PURE_POINTER_P (ptr)
+		  && ATOMIC_SETMARKBIT (CONS_BLOCK (ptr), CONS_INDEX (ptr)))
+		{
+		  if (ephemerons_pending && ephemeron_pending_p (obj))
+		    w->deferred[w->ndeferred++] = obj;
+		  mark_worker_note (w, ptr->car);
+		  obj = ptr->u.cdr;
+		  continue;
+		}
+	    }
+	  else
+	    mark_worker_note (w, obj);
+
+	  if (w->sp == 0)
+	    break;
+	  obj = w->stack[--w->sp];
+	}
+    }
+
+  w->resume = w->end;
+}
+
+/* Mark the conses in mark_frontier and the conses and floats they
+   lead to, using the GC threads if there are enough of them.  Push
+   the other objects found onto the mark stack.  */
+
+static void
+mark_frontier_conses (void)
+{
+  int k, nthreads = 1;
+  ptrdiff_t i, used;
+
+  if (mark_frontier_used >= MARK_PARALLEL_MIN_CONSES)
+    nthreads = start_gc_threads (min (gc_threads, GC_THREADS_MAX));
+
+  for (k = 0; k < nthreads; k++)
+    if (!mark_workers[k].stack)
+      {
+	mark_workers[k].stack
+	  = xmalloc (MARK_WORKER_STACK_SIZE * sizeof (Lisp_Object));
+	mark_workers[k].deferred
+	  = xmalloc (MARK_WORKER_DEFER_SIZE * sizeof (Lisp_Object));
+      }
+
+  if (nthreads > 1)
+    run_gc_job (mark_conses_share, nthreads);
+  else
+    mark_conses_share (0, 1);
+
+  /* Keep what the threads did not get to for the next round.  */
+  used = 0;
+  for (k = 0; k < nthreads; k++)
+    for (i = mark_workers[k].resume; i < mark_workers[k].end; i++)
+      mark_frontier[used++] = mark_frontier[i];
+  mark_frontier_used = used;
+
+  for (k = 0; k < nthreads; k++)
+    {
+      struct mark_worker *w = &mark_workers[k];
+
+      for (i = 0; i < w->sp; i++)
+	mark_frontier_push (w->stack[i]);
+      for (i = 0; i < w->ndeferred; i++)
+	{
+	  Lisp_Object obj = w->deferred[i];
+
+	  /* The conses and floats deferred are marked already, and
+	     only their ephemerons remain to be fired.  */
+	  if (CONSP (obj) || FLOATP (obj))
+	    fire_ephemerons (obj);
+	  else
+	    mark_stack_push_value (obj);
+	}
+    }
+}
+
+#endif /* PARALLEL_MARK */
+
 /* Mark reference to a Lisp_Object.
-   If the object referred to has not been seen yet, recursively mark
-   all the references contained in it.  */
+   If the object referred to has not been seen yet, mark all the
+   references contained in it, using the mark stack.  */
 
 #define LAST_MARKED_SIZE 500
 static Lisp_Object last_marked[LAST_MARKED_SIZE];
@@ -5950,7 +7741,6 @@ static void
 mark_vectorlike (struct Lisp_Vector *ptr)
 {
   ptrdiff_t size = ptr->header.size;
-  ptrdiff_t i;
 
   eassert (!VECTOR_MARKED_P (ptr));
   VECTOR_MARK (ptr);		/* Else mark it.  */
@@ -5961,8 +7751,7 @@ mark_vectorlike (struct Lisp_Vector *ptr)
      the number of Lisp_Object fields that we should trace.
      The distinction is used e.g. by Lisp_Process which places extra
      non-Lisp_Object fields at the end of the structure...  */
-  for (i = 0; i < size; i++) /* ...and then mark its elements.  */
-    mark_object (ptr->contents[i]);
+  mark_stack_push_values (ptr->contents, size); /* ...and then its elements.  */
 }
 
 /* Like mark_vectorlike but optimized for char-tables (and
@@ -5987,24 +7776,31 @@ mark_char_table (struct Lisp_Vector *ptr, enum pvec_type pvectype)
       if (SUB_CHAR_TABLE_P (val))
 	{
 	  if (! VECTOR_MARKED_P (XVECTOR (val)))
-	    mark_char_table (XVECTOR (val), PVEC_SUB_CHAR_TABLE);
+	    {
+	      maybe_fire_ephemerons (val);
+	      mark_char_table (XVECTOR (val), PVEC_SUB_CHAR_TABLE);
+	    }
 	}
       else
 	mark_object (val);
     }
 }
 
-NO_INLINE /* To reduce stack depth in mark_object.  */
 static Lisp_Object
 mark_compiled (struct Lisp_Vector *ptr)
 {
-  int i, size = ptr->header.size & PSEUDOVECTOR_SIZE_MASK;
+  int size = ptr->header.size & PSEUDOVECTOR_SIZE_MASK;
 
   VECTOR_MARK (ptr);
-  for (i = 0; i < size; i++)
-    if (i != COMPILED_CONSTANTS)
-      mark_object (ptr->contents[i]);
-  return size > COMPILED_CONSTANTS ? ptr->contents[COMPILED_CONSTANTS] : Qnil;
+  if (size <= COMPILED_CONSTANTS)
+    {
+      mark_stack_push_values (ptr->contents, size);
+      return Qnil;
+    }
+  mark_stack_push_values (ptr->contents, COMPILED_CONSTANTS);
+  mark_stack_push_values (ptr->contents + COMPILED_CONSTANTS + 1,
+			  size - COMPILED_CONSTANTS - 1);
+  return ptr->contents[COMPILED_CONSTANTS];
 }
 
 /* Mark the chain of overlays starting at PTR.  */
@@ -6014,11 +7810,17 @@ mark_overlay (struct Lisp_Overlay *ptr)
 {
   for (; ptr && !ptr->gcmarkbit; ptr = ptr->next)
     {
+      Lisp_Object overlay;
+
+      XSETMISC (overlay, ptr);
+      maybe_fire_ephemerons (overlay);
       ptr->gcmarkbit = 1;
       /* These two are always markers and can be marked fast.  */
+      maybe_fire_ephemerons (ptr->start);
       XMARKER (ptr->start)->gcmarkbit = 1;
+      maybe_fire_ephemerons (ptr->end);
       XMARKER (ptr->end)->gcmarkbit = 1;
-      mark_object (ptr->plist);
+      mark_stack_push_value (ptr->plist);
     }
 }
 
@@ -6043,18 +7845,23 @@ mark_buffer (struct buffer *buffer)
 
   /* If this is an indirect buffer, mark its base buffer.  */
   if (buffer->base_buffer && !VECTOR_MARKED_P (buffer->base_buffer))
-    mark_buffer (buffer->base_buffer);
+    {
+      Lisp_Object base;
+
+      XSETBUFFER (base, buffer->base_buffer);
+      maybe_fire_ephemerons (base);
+      mark_buffer (buffer->base_buffer);
+    }
 }
 
 /* Mark Lisp faces in the face cache C.  */
 
-NO_INLINE /* To reduce stack depth in mark_object.  */
 static void
 mark_face_cache (struct face_cache *c)
 {
   if (c)
     {
-      int i, j;
+      int i;
       for (i = 0; i < c->used; ++i)
 	{
 	  struct face *face = FACE_FROM_ID (c->f, i);
@@ -6062,16 +7869,20 @@ mark_face_cache (struct face_cache *c)
 	  if (face)
 	    {
 	      if (face->font && !VECTOR_MARKED_P (face->font))
-		mark_vectorlike ((struct Lisp_Vector *) face->font);
+		{
+		  Lisp_Object font;
+
+		  XSETVECTOR (font, face->font);
+		  maybe_fire_ephemerons (font);
+		  mark_vectorlike ((struct Lisp_Vector *) face->font);
+		}
 
-	      for (j = 0; j < LFACE_VECTOR_SIZE; ++j)
-		mark_object (face->lface[j]);
+	      mark_stack_push_values (face->lface, LFACE_VECTOR_SIZE);
 	    }
 	}
     }
 }
 
-NO_INLINE /* To reduce stack depth in mark_object.  */
 static void
 mark_localized_symbol (struct Lisp_Symbol *ptr)
 {
@@ -6084,12 +7895,11 @@ mark_localized_symbol (struct Lisp_Symbol *ptr)
   if ((BUFFERP (where) && !BUFFER_LIVE_P (XBUFFER (where)))
       || (FRAMEP (where) && !FRAME_LIVE_P (XFRAME (where))))
     swap_in_global_binding (ptr);
-  mark_object (blv->where);
-  mark_object (blv->valcell);
-  mark_object (blv->defcell);
+  mark_stack_push_value (blv->where);
+  mark_stack_push_value (blv->valcell);
+  mark_stack_push_value (blv->defcell);
 }
 
-NO_INLINE /* To reduce stack depth in mark_object.  */
 static void
 mark_save_value (struct Lisp_Save_Value *ptr)
 {
@@ -6109,7 +7919,7 @@ mark_save_value (struct Lisp_Save_Value *ptr)
       int i;
       for (i = 0; i < SAVE_VALUE_SLOTS; i++)
 	if (save_type (ptr, i) == SAVE_OBJECT)
-	  mark_object (ptr->data[i].object);
+	  mark_stack_push_value (ptr->data[i].object);
     }
 }
 
@@ -6131,6 +7941,7 @@ mark_discard_killed_buffers (Lisp_Object list)
 	*prev = XCDR (tail);
       else
 	{
+	  maybe_fire_ephemerons (tail);
 	  CONS_MARK (XCONS (tail));
 	  mark_object (XCAR (tail));
 	  prev = xcdr_addr (tail);
@@ -6140,28 +7951,45 @@ mark_discard_killed_buffers (Lisp_Object list)
   return list;
 }
 
-/* Determine type of generic Lisp_Object and mark it accordingly.
+/* Pop objects off the mark stack and mark them, pushing the objects
+   they reference, until the stack is back down to BASE_SP entries.
 
-   This function implements a straightforward depth-first marking
-   algorithm and so the recursion depth may be very high (a few
-   tens of thousands is not uncommon).  To minimize stack usage,
-   a few cold paths are moved out to NO_INLINE functions above.
-   In general, inlining them doesn't help you to gain more speed.  */
+   The functions above push the contents of the objects they mark,
+   rather than marking them recursively, so the depth of the C stack
+   does not depend on the shape of the data.  */
 
-void
-mark_object (Lisp_Object arg)
+static void
+process_mark_stack (ptrdiff_t base_sp)
 {
-  register Lisp_Object obj = arg;
+  Lisp_Object obj;
 #ifdef GC_CHECK_MARKED_OBJECTS
   void *po;
   struct mem_node *m;
 #endif
-  ptrdiff_t cdr_count = 0;
+  ptrdiff_t cdr_count;
+
+ next:
+
+  if (mark_stack_sp <= base_sp)
+    {
+#if PARALLEL_MARK
+      if (mark_frontier_used)
+	{
+	  mark_frontier_conses ();
+	  goto next;
+	}
+#endif
+      return;
+    }
+  obj = mark_stack_pop ();
+  cdr_count = 0;
 
  loop:
 
   if (PURE_POINTER_P (XPNTR (obj)))
-    return;
+    goto next;
+
+  maybe_fire_ephemerons (obj);
 
   last_marked[last_marked_index++] = obj;
   if (last_marked_index == LAST_MARKED_SIZE)
@@ -6233,7 +8061,7 @@ mark_object (Lisp_Object arg)
 
 #ifdef GC_CHECK_MARKED_OBJECTS
 	m = mem_find (po);
-	if (m == MEM_NIL && !SUBRP (obj))
+	if (m == MEM_NIL && !SUBRP (obj) && !main_thread_p (po))
 	  emacs_abort ();
 #endif /* GC_CHECK_MARKED_OBJECTS */
 
@@ -6265,8 +8093,9 @@ mark_object (Lisp_Object arg)
 	  case PVEC_COMPILED:
 	    /* Although we could treat this just like a vector, mark_compiled
 	       returns the COMPILED_CONSTANTS element, which is marked at the
-	       next iteration of goto-loop here.  This is done to avoid a few
-	       recursive calls to mark_object.  */
+	       next iteration of goto-loop here.  This keeps the often large
+	       constants vector, and so its contents, near the top of the
+	       mark stack.  */
 	    obj = mark_compiled (ptr);
 	    if (!NILP (obj))
 	      goto loop;
@@ -6284,7 +8113,13 @@ mark_object (Lisp_Object arg)
 		  struct font *font = FRAME_FONT (f);
 
 		  if (font && !VECTOR_MARKED_P (font))
-		    mark_vectorlike ((struct Lisp_Vector *) font);
+		    {
+		      Lisp_Object font_object;
+
+		      XSETVECTOR (font_object, font);
+		      maybe_fire_ephemerons (font_object);
+		      mark_vectorlike ((struct Lisp_Vector *) font);
+		    }
 		}
 #endif
 	    }
@@ -6321,15 +8156,18 @@ mark_object (Lisp_Object arg)
 	      struct Lisp_Hash_Table *h = (struct Lisp_Hash_Table *) ptr;
 
 	      mark_vectorlike (ptr);
-	      mark_object (h->test.name);
-	      mark_object (h->test.user_hash_function);
-	      mark_object (h->test.user_cmp_function);
+	      mark_stack_push_value (h->test.name);
+	      mark_stack_push_value (h->test.user_hash_function);
+	      mark_stack_push_value (h->test.user_cmp_function);
 	      /* If hash table is not weak, mark all keys and values.
 		 For weak tables, mark only the vector.  */
 	      if (NILP (h->weak))
-		mark_object (h->key_and_value);
+		mark_stack_push_value (h->key_and_value);
 	      else
-		VECTOR_MARK (XVECTOR (h->key_and_value));
+		{
+		  maybe_fire_ephemerons (h->key_and_value);
+		  VECTOR_MARK (XVECTOR (h->key_and_value));
+		}
 	    }
 	    break;
 
@@ -6362,19 +8200,26 @@ mark_object (Lisp_Object arg)
 	if (ptr->gcmarkbit)
 	  break;
 	CHECK_ALLOCATED_AND_LIVE (live_symbol_p);
+	if (ptr != XSYMBOL (obj))
+	  {
+	    /* The next symbol in the bucket of an obarray.  */
+	    Lisp_Object sym;
+	    XSETSYMBOL (sym, ptr);
+	    maybe_fire_ephemerons (sym);
+	  }
 	ptr->gcmarkbit = 1;
 	/* Attempt to catch bogus objects.  */
         eassert (valid_lisp_object_p (ptr->function) >= 1);
-	mark_object (ptr->function);
-	mark_object (ptr->plist);
+	mark_stack_push_value (ptr->function);
+	mark_stack_push_value (ptr->plist);
 	switch (ptr->redirect)
 	  {
-	  case SYMBOL_PLAINVAL: mark_object (SYMBOL_VAL (ptr)); break;
+	  case SYMBOL_PLAINVAL: mark_stack_push_value (SYMBOL_VAL (ptr)); break;
 	  case SYMBOL_VARALIAS:
 	    {
 	      Lisp_Object tem;
 	      XSETSYMBOL (tem, SYMBOL_ALIAS (ptr));
-	      mark_object (tem);
+	      mark_stack_push_value (tem);
 	      break;
 	    }
 	  case SYMBOL_LOCALIZED:
@@ -6389,7 +8234,10 @@ mark_object (Lisp_Object arg)
 	  default: emacs_abort ();
 	  }
 	if (!PURE_POINTER_P (XSTRING (ptr->name)))
-	  MARK_STRING (XSTRING (ptr->name));
+	  {
+	    maybe_fire_ephemerons (ptr->name);
+	    MARK_STRING (XSTRING (ptr->name));
+	  }
 	MARK_INTERVAL_TREE (string_intervals (ptr->name));
 	/* Inner loop to mark next symbol in this bucket, if any.  */
 	ptr = ptr->next;
@@ -6433,15 +8281,22 @@ mark_object (Lisp_Object arg)
 	if (CONS_MARKED_P (ptr))
 	  break;
 	CHECK_ALLOCATED_AND_LIVE (live_cons_p);
+#if PARALLEL_MARK
+	if (mark_conses_in_parallel)
+	  {
+	    mark_frontier_push (obj);
+	    break;
+	  }
+#endif
 	CONS_MARK (ptr);
-	/* If the cdr is nil, avoid recursion for the car.  */
+	/* If the cdr is nil, avoid pushing the car.  */
 	if (EQ (ptr->u.cdr, Qnil))
 	  {
 	    obj = ptr->car;
 	    cdr_count = 0;
 	    goto loop;
 	  }
-	mark_object (ptr->car);
+	mark_stack_push_value (ptr->car);
 	obj = ptr->u.cdr;
 	cdr_count++;
 	if (cdr_count == mark_object_loop_halt)
@@ -6460,11 +8315,22 @@ mark_object (Lisp_Object arg)
     default:
       emacs_abort ();
     }
+  goto next;
 
 #undef CHECK_LIVE
 #undef CHECK_ALLOCATED
 #undef CHECK_ALLOCATED_AND_LIVE
 }
+
+/* Mark OBJ and everything reachable from it.  */
+
+void
+mark_object (Lisp_Object obj)
+{
+  ptrdiff_t base_sp = mark_stack_sp;
+  mark_stack_push_value (obj);
+  process_mark_stack (base_sp);
+}
 /* Mark the Lisp pointers in the terminal objects.
    Called by Fgarbage_collect.  */
 
@@ -6482,7 +8348,11 @@ mark_terminals (void)
       mark_image_cache (t->image_cache);
 #endif /* HAVE_WINDOW_SYSTEM */
       if (!VECTOR_MARKED_P (t))
-	mark_vectorlike ((struct Lisp_Vector *)t);
+	{
+	  ptrdiff_t base_sp = mark_stack_sp;
+	  mark_vectorlike ((struct Lisp_Vector *)t);
+	  process_mark_stack (base_sp);
+	}
     }
 }
 
@@ -6534,179 +8404,209 @@ survives_gc_p (Lisp_Object obj)
 }
 
 
+
 
 
+/* The mark bits of a cons or float block become its live bits: the
+   cells that were not marked are garbage, and are put on the free
+   list when lazy_sweep_conses or lazy_sweep_floats gets to the block.
+   All that is done here is to count the survivors and to release
+   blocks that are entirely free.  */
+
+static void
+sweep_cons_block (struct block_sweep *sweep)
+{
+  struct cons_block *cblk = sweep->block;
+  int lim = cblk == cons_block ? cons_block_index : CONS_BLOCK_SIZE;
+  int i, nused = 0;
+
+  for (i = 0; i < 1 + CONS_BLOCK_SIZE / BITS_PER_BITS_WORD; i++)
+    {
+      bits_word w = cblk->gcmarkbits[i];
+      cblk->livebits[i] = w;
+      cblk->gcmarkbits[i] = 0;
+      if (w)
+	nused += count_one_bits_word (w);
+    }
+  sweep->nused = nused;
+  sweep->nfree = lim - nused;
+}
+
 NO_INLINE /* For better stack traces */
 static void
 sweep_conses (void)
 {
   struct cons_block *cblk;
   struct cons_block **cprev = &cons_block;
-  int lim = cons_block_index;
+  struct block_sweep *sweeps, one;
+  ptrdiff_t i;
   EMACS_INT num_free = 0, num_used = 0;
 
   cons_free_list = 0;
 
-  for (cblk = cons_block; cblk; cblk = *cprev)
-    {
-      int i = 0;
-      int this_free = 0;
-      int ilim = (lim + BITS_PER_BITS_WORD - 1) / BITS_PER_BITS_WORD;
+  sweeps = sweep_blocks (cons_block, offsetof (struct cons_block, next),
+			 sweep_cons_block);
 
-      /* Scan the mark bits an int at a time.  */
-      for (i = 0; i < ilim; i++)
-        {
-          if (cblk->gcmarkbits[i] == BITS_WORD_MAX)
-            {
-              /* Fast path - all cons cells for this int are marked.  */
-              cblk->gcmarkbits[i] = 0;
-              num_used += BITS_PER_BITS_WORD;
-            }
-          else
-            {
-              /* Some cons cells for this int are not marked.
-                 Find which ones, and free them.  */
-              int start, pos, stop;
-
-              start = i * BITS_PER_BITS_WORD;
-              stop = lim - start;
-              if (stop > BITS_PER_BITS_WORD)
-                stop = BITS_PER_BITS_WORD;
-              stop += start;
-
-              for (pos = start; pos < stop; pos++)
-                {
-                  if (!CONS_MARKED_P (&cblk->conses[pos]))
-                    {
-                      this_free++;
-                      cblk->conses[pos].u.chain = cons_free_list;
-                      cons_free_list = &cblk->conses[pos];
-#if GC_MARK_STACK
-                      cons_free_list->car = Vdead;
-#endif
-                    }
-                  else
-                    {
-                      num_used++;
-                      CONS_UNMARK (&cblk->conses[pos]);
-                    }
-                }
-            }
-        }
+  for (cblk = cons_block, i = 0; cblk; cblk = *cprev, i++)
+    {
+      struct block_sweep *sweep
+	= sweep_one_block (sweeps, i, cblk, sweep_cons_block, &one);
 
-      lim = CONS_BLOCK_SIZE;
       /* If this block contains only free conses and we have already
-         seen more than two blocks worth of free conses then deallocate
-         this block.  */
-      if (this_free == CONS_BLOCK_SIZE && num_free > CONS_BLOCK_SIZE)
+         seen more than `gc-spare-blocks' blocks worth of free conses
+         then deallocate this block.  */
+      if (sweep->nfree == CONS_BLOCK_SIZE
+	  && num_free > spare_objects (CONS_BLOCK_SIZE))
         {
           *cprev = cblk->next;
-          /* Unhook from the free list.  */
-          cons_free_list = cblk->conses[0].u.chain;
           lisp_align_free (cblk);
         }
       else
         {
-          num_free += this_free;
+	  num_used += sweep->nused;
+          num_free += sweep->nfree;
           cprev = &cblk->next;
         }
     }
+  cons_sweep_block = cons_block;
   total_conses = num_used;
   total_free_conses = num_free;
 }
 
+/* Likewise for floats.  */
+
+static void
+sweep_float_block (struct block_sweep *sweep)
+{
+  struct float_block *fblk = sweep->block;
+  int lim = fblk == float_block ? float_block_index : FLOAT_BLOCK_SIZE;
+  int i, nused = 0;
+
+  for (i = 0; i < 1 + FLOAT_BLOCK_SIZE / BITS_PER_BITS_WORD; i++)
+    {
+      bits_word w = fblk->gcmarkbits[i];
+      fblk->livebits[i] = w;
+      fblk->gcmarkbits[i] = 0;
+      if (w)
+	nused += count_one_bits_word (w);
+    }
+  sweep->nused = nused;
+  sweep->nfree = lim - nused;
+}
+
 NO_INLINE /* For better stack traces */
 static void
 sweep_floats (void)
 {
-  register struct float_block *fblk;
+  struct float_block *fblk;
   struct float_block **fprev = &float_block;
-  register int lim = float_block_index;
+  struct block_sweep *sweeps, one;
+  ptrdiff_t i;
   EMACS_INT num_free = 0, num_used = 0;
 
   float_free_list = 0;
 
-  for (fblk = float_block; fblk; fblk = *fprev)
+  sweeps = sweep_blocks (float_block, offsetof (struct float_block, next),
+			 sweep_float_block);
+
+  for (fblk = float_block, i = 0; fblk; fblk = *fprev, i++)
     {
-      register int i;
-      int this_free = 0;
-      for (i = 0; i < lim; i++)
-        if (!FLOAT_MARKED_P (&fblk->floats[i]))
-          {
-            this_free++;
-            fblk->floats[i].u.chain = float_free_list;
-            float_free_list = &fblk->floats[i];
-          }
-        else
-          {
-            num_used++;
-            FLOAT_UNMARK (&fblk->floats[i]);
-          }
-      lim = FLOAT_BLOCK_SIZE;
+      struct block_sweep *sweep
+	= sweep_one_block (sweeps, i, fblk, sweep_float_block, &one);
+
       /* If this block contains only free floats and we have already
-         seen more than two blocks worth of free floats then deallocate
-         this block.  */
-      if (this_free == FLOAT_BLOCK_SIZE && num_free > FLOAT_BLOCK_SIZE)
+         seen more than `gc-spare-blocks' blocks worth of free floats
+         then deallocate this block.  */
+      if (sweep->nfree == FLOAT_BLOCK_SIZE
+	  && num_free > spare_objects (FLOAT_BLOCK_SIZE))
         {
           *fprev = fblk->next;
-          /* Unhook from the free list.  */
-          float_free_list = fblk->floats[0].u.chain;
           lisp_align_free (fblk);
         }
       else
         {
-          num_free += this_free;
+	  num_used += sweep->nused;
+          num_free += sweep->nfree;
           fprev = &fblk->next;
         }
     }
+  float_sweep_block = float_block;
   total_floats = num_used;
   total_free_floats = num_free;
 }
 
+/* Sweep the interval block of SWEEP: unmark its live intervals and
+   chain the others together.  */
+
+static void
+sweep_interval_block (struct block_sweep *sweep)
+{
+  struct interval_block *iblk = sweep->block;
+  int lim = (iblk == interval_block
+	     ? interval_block_index : INTERVAL_BLOCK_SIZE);
+  INTERVAL free_head = NULL, free_tail = NULL;
+  int i, nused = 0;
+
+  for (i = 0; i < lim; i++)
+    {
+      if (!iblk->intervals[i].gcmarkbit)
+	{
+	  set_interval_parent (&iblk->intervals[i], free_head);
+	  free_head = &iblk->intervals[i];
+	  if (!free_tail)
+	    free_tail = free_head;
+	}
+      else
+	{
+	  nused++;
+	  iblk->intervals[i].gcmarkbit = 0;
+	}
+    }
+  sweep->nused = nused;
+  sweep->nfree = lim - nused;
+  sweep->free_head = free_head;
+  sweep->free_tail = free_tail;
+}
+
 NO_INLINE /* For better stack traces */
 static void
 sweep_intervals (void)
 {
-  register struct interval_block *iblk;
+  struct interval_block *iblk;
   struct interval_block **iprev = &interval_block;
-  register int lim = interval_block_index;
+  struct block_sweep *sweeps, one;
+  ptrdiff_t i;
   EMACS_INT num_free = 0, num_used = 0;
 
   interval_free_list = 0;
 
-  for (iblk = interval_block; iblk; iblk = *iprev)
+  sweeps = sweep_blocks (interval_block,
+			 offsetof (struct interval_block, next),
+			 sweep_interval_block);
+
+  for (iblk = interval_block, i = 0; iblk; iblk = *iprev, i++)
     {
-      register int i;
-      int this_free = 0;
+      struct block_sweep *sweep
+	= sweep_one_block (sweeps, i, iblk, sweep_interval_block, &one);
 
-      for (i = 0; i < lim; i++)
-        {
-          if (!iblk->intervals[i].gcmarkbit)
-            {
-              set_interval_parent (&iblk->intervals[i], interval_free_list);
-              interval_free_list = &iblk->intervals[i];
-              this_free++;
-            }
-          else
-            {
-              num_used++;
-              iblk->intervals[i].gcmarkbit = 0;
-            }
-        }
-      lim = INTERVAL_BLOCK_SIZE;
       /* If this block contains only free intervals and we have already
-         seen more than two blocks worth of free intervals then
-         deallocate this block.  */
-      if (this_free == INTERVAL_BLOCK_SIZE && num_free > INTERVAL_BLOCK_SIZE)
+         seen more than `gc-spare-blocks' blocks worth of free intervals
+         then deallocate this block.  */
+      if (sweep->nfree == INTERVAL_BLOCK_SIZE
+	  && num_free > spare_objects (INTERVAL_BLOCK_SIZE))
         {
           *iprev = iblk->next;
-          /* Unhook from the free list.  */
-          interval_free_list = INTERVAL_PARENT (&iblk->intervals[0]);
           lisp_free (iblk);
         }
       else
         {
-          num_free += this_free;
+	  if (sweep->free_head)
+	    {
+	      set_interval_parent (sweep->free_tail, interval_free_list);
+	      interval_free_list = sweep->free_head;
+	    }
+	  num_used += sweep->nused;
+          num_free += sweep->nfree;
           iprev = &iblk->next;
         }
     }
@@ -6755,9 +8655,10 @@ sweep_symbols (void)
 
       lim = SYMBOL_BLOCK_SIZE;
       /* If this block contains only free symbols and we have already
-         seen more than two blocks worth of free symbols then deallocate
-         this block.  */
-      if (this_free == SYMBOL_BLOCK_SIZE && num_free > SYMBOL_BLOCK_SIZE)
+         seen more than `gc-spare-blocks' blocks worth of free symbols
+         then deallocate this block.  */
+      if (this_free == SYMBOL_BLOCK_SIZE
+	  && num_free > spare_objects (SYMBOL_BLOCK_SIZE))
         {
           *sprev = sblk->next;
           /* Unhook from the free list.  */
@@ -6815,9 +8716,10 @@ sweep_misc (void)
         }
       lim = MARKER_BLOCK_SIZE;
       /* If this block contains only free markers and we have already
-         seen more than two blocks worth of free markers then deallocate
-         this block.  */
-      if (this_free == MARKER_BLOCK_SIZE && num_free > MARKER_BLOCK_SIZE)
+         seen more than `gc-spare-blocks' blocks worth of free markers
+         then deallocate this block.  */
+      if (this_free == MARKER_BLOCK_SIZE
+	  && num_free > spare_objects (MARKER_BLOCK_SIZE))
         {
           *mprev = mblk->next;
           /* Unhook from the free list.  */
@@ -6858,24 +8760,466 @@ sweep_buffers (void)
       }
 }
 
-/* Sweep: find all structures not marked, and free them.  */
+#ifdef DOUG_LEA_MALLOC
+
+/* Return the number of bytes of free heap that trim_heap leaves to
+   malloc: as much as `gc-spare-blocks' blocks of each type take, so
+   that allocating them again does not have to grow the heap.  */
+
+static size_t
+spare_heap_bytes (void)
+{
+  size_t block_bytes = (ABLOCKS_BYTES + sizeof (struct string_block)
+			+ SBLOCK_SIZE + sizeof (struct vector_block)
+			+ sizeof (struct symbol_block)
+			+ sizeof (struct marker_block)
+			+ sizeof (struct interval_block));
+  return (gc_spare_blocks <= 0 ? 0
+	  : gc_spare_blocks < SIZE_MAX / block_bytes
+	  ? gc_spare_blocks * block_bytes
+	  : SIZE_MAX);
+}
+
+#endif
+
+/* If memory was given back to malloc since the last call, and malloc
+   holds more free memory than `gc-spare-blocks' asks to keep, ask
+   malloc to return the rest to the system.  Other mallocs than Doug
+   Lea's do this by themselves, if at all.  */
+
+static void
+trim_heap (void)
+{
+#ifdef DOUG_LEA_MALLOC
+  if (heap_freed)
+    {
+      size_t pad = spare_heap_bytes ();
+
+      /* malloc_trim walks the whole heap, so do not bother it for
+	 less than the pad; fordblks wraps around like an unsigned int.  */
+      if ((unsigned int) mallinfo ().fordblks > pad)
+	malloc_trim (pad);
+    }
+#endif
+  heap_freed = false;
+}
+
+/* Sweep: find all structures not marked, and free them.  Record the
+   time each step takes into REC.  */
 static void
-gc_sweep (void)
+gc_sweep (struct gc_record *rec)
 {
+  struct timespec t = current_timespec ();
+
   /* Remove or mark entries in weak hash tables.
      This must be done before any object is unmarked.  */
   sweep_weak_hash_tables ();
+  rec->weak = gc_lap (&t);
+#if PARALLEL_MARK
+  /* That was the last of the marking.  */
+  mark_conses_in_parallel = false;
+#endif
 
   sweep_strings ();
   check_string_bytes (!noninteractive);
+  rec->sweep[GC_STRINGS] = gc_lap (&t);
   sweep_conses ();
+  rec->sweep[GC_CONSES] = gc_lap (&t);
   sweep_floats ();
+  rec->sweep[GC_FLOATS] = gc_lap (&t);
   sweep_intervals ();
+  rec->sweep[GC_INTERVALS] = gc_lap (&t);
   sweep_symbols ();
+  rec->sweep[GC_SYMBOLS] = gc_lap (&t);
   sweep_misc ();
+  rec->sweep[GC_MISCS] = gc_lap (&t);
   sweep_buffers ();
+  rec->sweep[GC_BUFFERS] = gc_lap (&t);
   sweep_vectors ();
   check_string_bytes (!noninteractive);
+  rec->sweep[GC_VECTORS] = gc_lap (&t);
+}
+
+DEFUN ("garbage-collection-history", Fgarbage_collection_history,
+       Sgarbage_collection_history, 0, 0, 0,
+       doc: /* Return statistics about recent garbage collections.
+The value is a list with an element for each of the last 64 garbage
+collections or fewer, most recent first.  Each element is an alist:
+
+  ((number . N) (trigger . TRIGGER) (pause . SECONDS) (mark . SECONDS)
+   (stack-scan . SECONDS) (weak-tables . SECONDS)
+   (sweep . ((KIND . SECONDS) ...)) (reclaimed . ((KIND . BYTES) ...))
+   (threshold . BYTES))
+
+N is the value of `gcs-done' when the collection started.  TRIGGER is
+`threshold' if it started because of `gc-cons-threshold' or
+`gc-cons-percentage', `memory-full' if Emacs was short of memory,
+`idle' if it was put off until Emacs was idle because of
+`gc-pause-limit', and `explicit' otherwise, for instance when
+`garbage-collect' was called.
+
+`pause' is the time the whole collection took.  `mark' is the time
+spent marking live objects, which includes the time spent scanning the
+C stack and the other state of each thread for references to them,
+`stack-scan'.  `weak-tables' is the time spent processing weak hash
+tables.  `sweep' gives the time spent sweeping each KIND of object, and
+`reclaimed' the number of bytes reclaimed for it.  KIND is one of
+`strings', `conses', `floats', `intervals', `symbols', `miscs',
+`buffers' and `vectors'.
+`threshold' is the number of bytes of consing after which the next
+collection was due; see `gc-target-overhead'.  */)
+  (void)
+{
+  Lisp_Object result = Qnil;
+  EMACS_INT n;
+
+  for (n = max (0, gcs_done - GC_HISTORY_SIZE); n < gcs_done; n++)
+    {
+      struct gc_record *rec = &gc_history[n % GC_HISTORY_SIZE];
+      Lisp_Object sweep = Qnil, reclaimed = Qnil, trigger;
+      int k;
+
+      if (rec->number != n)
+	continue;
+
+      for (k = GC_KINDS - 1; k >= 0; k--)
+	{
+	  Lisp_Object kind = *gc_kind_names[k];
+	  sweep = Fcons (Fcons (kind, make_float (rec->sweep[k])), sweep);
+	  reclaimed = Fcons (Fcons (kind, bounded_number (rec->reclaimed[k])),
+			     reclaimed);
+	}
+
+      switch (rec->trigger)
+	{
+	case GC_TRIGGER_THRESHOLD: trigger = Qthreshold; break;
+	case GC_TRIGGER_MEMORY_FULL: trigger = Qmemory_full; break;
+	case GC_TRIGGER_IDLE: trigger = Qidle; break;
+	default: trigger = Qexplicit; break;
+	}
+
+      result = Fcons (listn (CONSTYPE_HEAP, 9,
+			     Fcons (Qnumber, make_number (n)),
+			     Fcons (Qtrigger, trigger),
+			     Fcons (Qpause, make_float (rec->pause)),
+			     Fcons (Qmark, make_float (rec->mark)),
+			     Fcons (Qstack_scan, make_float (rec->stack)),
+			     Fcons (Qweak_tables, make_float (rec->weak)),
+			     Fcons (Qsweep, sweep),
+			     Fcons (Qreclaimed, reclaimed),
+			     Fcons (Qthreshold,
+				    bounded_number (rec->threshold))),
+		      result);
+    }
+  return result;
+}
+
+/* Heap census.  */
+
+/* The names of the types of vector-like objects in `heap-census',
+   indexed by enum pvec_type.  */
+
+static char const *const pvec_type_names[] =
+  {
+    "vector", "free", "process", "frame", "window", "bool-vector",
+    "buffer", "hash-table", "terminal", "window-configuration", "subr",
+    "other", "coroutine", "thread", "mutex", "condition-variable",
+    "compiled-function", "char-table", "sub-char-table", "font"
+  };
+verify (ARRAYELTS (pvec_type_names) == PVEC_FONT + 1);
+
+/* What `heap-census' has found so far.  */
+
+struct census
+{
+  /* Number and total size of the objects of each type of vector-like
+     object, and of strings.  */
+  EMACS_INT count[PVEC_FONT + 1], bytes[PVEC_FONT + 1];
+  EMACS_INT string_count, string_bytes;
+
+  /* A list with an element for each hash table.  */
+  Lisp_Object hash_tables;
+
+  /* The largest strings and vectors, largest first, and their sizes.
+     There are N of each of them, at most SIZE.  */
+  ptrdiff_t size, nstrings, nvectors;
+  Lisp_Object *strings, *vectors;
+  EMACS_INT *string_sizes, *vector_sizes;
+};
+
+/* Add OBJ, which is NBYTES large, to the N largest objects in OBJS,
+   whose sizes are SIZES, if it is large enough.  Keep at most SIZE of
+   them, largest first.  */
+
+static void
+census_top (Lisp_Object *objs, EMACS_INT *sizes, ptrdiff_t *n,
+	    ptrdiff_t size, Lisp_Object obj, EMACS_INT nbytes)
+{
+  ptrdiff_t i;
+
+  if (*n == size)
+    {
+      if (size == 0 || nbytes <= sizes[size - 1])
+	return;
+    }
+  else
+    (*n)++;
+
+  for (i = *n - 1; 0 < i && sizes[i - 1] < nbytes; i--)
+    {
+      objs[i] = objs[i - 1];
+      sizes[i] = sizes[i - 1];
+    }
+  objs[i] = obj;
+  sizes[i] = nbytes;
+}
+
+/* Return a list of (OBJ . SIZE) for the N objects in OBJS.  */
+
+static Lisp_Object
+census_top_list (Lisp_Object *objs, EMACS_INT *sizes, ptrdiff_t n)
+{
+  Lisp_Object list = Qnil;
+
+  while (0 < n--)
+    list = Fcons (Fcons (objs[n], bounded_number (sizes[n])), list);
+  return list;
+}
+
+/* Count V, which occupies NBYTES, into C.  */
+
+static void
+census_vector (struct census *c, struct Lisp_Vector *v, ptrdiff_t nbytes)
+{
+  enum pvec_type type = PVEC_NORMAL_VECTOR;
+  Lisp_Object obj;
+
+  if (v->header.size & PSEUDOVECTOR_FLAG)
+    type = ((v->header.size & PVEC_TYPE_MASK) >> PSEUDOVECTOR_AREA_BITS);
+  if (type == PVEC_FREE)
+    return;
+
+  c->count[type]++;
+  c->bytes[type] += nbytes;
+  XSETVECTOR (obj, v);
+  census_top (c->vectors, c->vector_sizes, &c->nvectors, c->size,
+	      obj, nbytes);
+
+  if (type == PVEC_HASH_TABLE)
+    {
+      struct Lisp_Hash_Table *h = (struct Lisp_Hash_Table *) v;
+      Lisp_Object parts[4];
+      EMACS_INT total = nbytes;
+      int i;
+
+      parts[0] = h->key_and_value;
+      parts[1] = h->hash;
+      parts[2] = h->next;
+      parts[3] = h->index;
+      for (i = 0; i < 4; i++)
+	if (VECTORP (parts[i]) && ! PURE_POINTER_P (XVECTOR (parts[i])))
+	  total += vector_nbytes (XVECTOR (parts[i]));
+
+      c->hash_tables
+	= Fcons (Fcons (obj, Fcons (make_number (h->count),
+				    Fcons (make_number (HASH_TABLE_SIZE (h)),
+					   bounded_number (total)))),
+		 c->hash_tables);
+    }
+}
+
+/* Count the intervals in the tree I.  */
+
+static EMACS_INT
+census_intervals (INTERVAL i)
+{
+  return i ? 1 + census_intervals (i->left) + census_intervals (i->right) : 0;
+}
+
+/* Return (COUNT . BYTES) for COUNT objects of SIZE bytes each.  */
+
+static Lisp_Object
+census_count (EMACS_INT count, EMACS_INT size)
+{
+  return Fcons (bounded_number (count), bounded_number (count * size));
+}
+
+/* Return a description of the memory B uses for its text, intervals,
+   markers and overlays.  */
+
+static Lisp_Object
+census_buffer (struct buffer *b)
+{
+  EMACS_INT text = 0, intervals = 0, markers = 0, overlays = 0;
+  struct Lisp_Marker *m;
+  struct Lisp_Overlay *ov;
+
+  if (BUFFER_LIVE_P (b))
+    {
+      /* An indirect buffer shares the text and intervals of its base
+	 buffer, which they are counted for.  */
+      if (! b->base_buffer)
+	{
+	  text = BUF_Z_BYTE (b) - BUF_BEG_BYTE (b) + BUF_GAP_SIZE (b);
+	  intervals = census_intervals (buffer_intervals (b));
+	}
+      for (m = BUF_MARKERS (b); m; m = m->next)
+	if (m->buffer == b)
+	  markers++;
+    }
+  for (ov = b->overlays_before; ov; ov = ov->next)
+    overlays++;
+  for (ov = b->overlays_after; ov; ov = ov->next)
+    overlays++;
+
+  return list4 (Fcons (Qtext, bounded_number (text)),
+		Fcons (Qintervals,
+		       census_count (intervals, sizeof (struct interval))),
+		Fcons (Qmarkers, census_count (markers, sizeof (union Lisp_Misc))),
+		Fcons (Qoverlays,
+		       census_count (overlays, sizeof (union Lisp_Misc))));
+}
+
+DEFUN ("heap-census", Fheap_census, Sheap_census, 0, 1, 0,
+       doc: /* Collect garbage and describe the objects left in the heap.
+The value is an alist:
+
+  ((types (TYPE COUNT . BYTES) ...)
+   (buffers (BUFFER (text . BYTES) (intervals COUNT . BYTES)
+                    (markers COUNT . BYTES) (overlays COUNT . BYTES)) ...)
+   (hash-tables (TABLE COUNT SIZE . BYTES) ...)
+   (strings (STRING . BYTES) ...)
+   (vectors (VECTOR . BYTES) ...)
+   (large-vectors COUNT BYTES . MAPPED))
+
+`types' gives the number of strings and of each type of vector-like
+object, such as `vector', `buffer', `hash-table' or `compiled-function',
+and the number of bytes they occupy.
+
+`buffers' describes each buffer, killed ones included: the size of its
+text including the gap, and the number and size of its text property
+intervals, markers and overlays.  The text and intervals of an indirect
+buffer are counted for its base buffer.
+
+`hash-tables' gives the number of entries COUNT and the SIZE of each
+hash table, and the bytes used by it and its internal vectors.
+
+`strings' and `vectors' list the N largest strings and vector-like
+objects, largest first.  N defaults to 10.
+
+`large-vectors' gives the number of vector-like objects too large for
+the blocks smaller vectors share, the bytes they occupy, and how many
+of these bytes are in memory mappings of their own, which go back to
+the system as soon as the vectors are collected.
+
+Objects in pure storage are not included.  */)
+  (Lisp_Object n)
+{
+  struct census c;
+  struct vector_block *block;
+  struct large_vector *lv;
+  struct string_block *sb;
+  struct buffer *b;
+  Lisp_Object types = Qnil, buffers = Qnil, result;
+  EMACS_INT large_count = 0, large_bytes = 0, large_mapped = 0;
+  ptrdiff_t count;
+  int i;
+  USE_SAFE_ALLOCA;
+
+  if (NILP (n))
+    c.size = 10;
+  else
+    {
+      CHECK_NATNUM (n);
+      c.size = min (XFASTINT (n), PTRDIFF_MAX);
+    }
+
+  Fgarbage_collect ();
+  count = inhibit_garbage_collection ();
+
+  memset (c.count, 0, sizeof c.count);
+  memset (c.bytes, 0, sizeof c.bytes);
+  c.string_count = c.string_bytes = 0;
+  c.hash_tables = Qnil;
+  c.nstrings = c.nvectors = 0;
+  SAFE_NALLOCA (c.strings, 2, c.size);
+  c.vectors = c.strings + c.size;
+  SAFE_NALLOCA (c.string_sizes, 2, c.size);
+  c.vector_sizes = c.string_sizes + c.size;
+
+  for (block = vector_blocks; block; block = block->next)
+    {
+      struct Lisp_Vector *v = (struct Lisp_Vector *) block->data;
+
+      while (VECTOR_IN_BLOCK (v, block))
+	{
+	  ptrdiff_t nbytes = vector_nbytes (v);
+	  census_vector (&c, v, nbytes);
+	  v = ADVANCE (v, nbytes);
+	}
+    }
+  for (lv = large_vectors; lv; lv = lv->next)
+    {
+      struct Lisp_Vector *v = large_vector_vec (lv);
+      ptrdiff_t nbytes = vector_nbytes (v);
+      census_vector (&c, v, nbytes);
+      large_count++;
+      large_bytes += nbytes;
+      large_mapped += lv->mapped;
+    }
+
+  for (sb = string_blocks; sb; sb = sb->next)
+    for (i = 0; i < STRING_BLOCK_SIZE; i++)
+      {
+	struct Lisp_String *s = sb->strings + i;
+
+	if (s->data)
+	  {
+	    EMACS_INT nbytes = sizeof *s + STRING_BYTES (s);
+	    Lisp_Object obj;
+
+	    c.string_count++;
+	    c.string_bytes += nbytes;
+	    XSETSTRING (obj, s);
+	    census_top (c.strings, c.string_sizes, &c.nstrings, c.size,
+			obj, nbytes);
+	  }
+      }
+
+  FOR_EACH_BUFFER (b)
+    {
+      Lisp_Object buffer;
+
+      c.count[PVEC_BUFFER]++;
+      c.bytes[PVEC_BUFFER] += sizeof *b;
+      XSETBUFFER (buffer, b);
+      buffers = Fcons (Fcons (buffer, census_buffer (b)), buffers);
+    }
+
+  for (i = PVEC_FONT; i >= 0; i--)
+    if (c.count[i])
+      types = Fcons (Fcons (intern_c_string (pvec_type_names[i]),
+			    Fcons (bounded_number (c.count[i]),
+				   bounded_number (c.bytes[i]))),
+		     types);
+  types = Fcons (Fcons (intern_c_string ("string"),
+			Fcons (bounded_number (c.string_count),
+			       bounded_number (c.string_bytes))),
+		 types);
+
+  result = listn (CONSTYPE_HEAP, 6, Fcons (Qtypes, types),
+		  Fcons (Qbuffers, Fnreverse (buffers)),
+		  Fcons (Qhash_tables, Fnreverse (c.hash_tables)),
+		  Fcons (Qstrings, census_top_list (c.strings, c.string_sizes,
+						    c.nstrings)),
+		  Fcons (Qvectors, census_top_list (c.vectors, c.vector_sizes,
+						    c.nvectors)),
+		  Fcons (Qlarge_vectors,
+			 Fcons (bounded_number (large_count),
+				Fcons (bounded_number (large_bytes),
+				       bounded_number (large_mapped)))));
+  SAFE_FREE ();
+  return unbind_to (count, result);
 }
 
 DEFUN ("memory-info", Fmemory_info, Smemory_info, 0, 0, 0,
@@ -7186,8 +9530,18 @@ init_alloc (void)
 #endif
 #endif
   Vgc_elapsed = make_float (0.0);
+  Vgc_last_pause = make_float (0.0);
+  Vgc_max_pause = make_float (0.0);
   gcs_done = 0;
 
+#ifdef HAVE_PTHREAD
+  /* GC threads do not survive dumping.  */
+  gc_threads_started = 0;
+  pthread_mutex_init (&gc_job_mutex, NULL);
+  pthread_cond_init (&gc_job_start, NULL);
+  pthread_cond_init (&gc_job_done, NULL);
+#endif
+
 #if USE_VALGRIND
   valgrind_p = RUNNING_ON_VALGRIND != 0;
 #endif
@@ -7282,6 +9636,23 @@ do hash-consing of the objects allocated to pure space.  */);
   DEFSYM (Qvector_slots, "vector-slots");
   DEFSYM (Qheap, "heap");
   DEFSYM (Qautomatic_gc, "Automatic GC");
+  DEFSYM (Qnumber, "number");
+  DEFSYM (Qtrigger, "trigger");
+  DEFSYM (Qpause, "pause");
+  DEFSYM (Qmark, "mark");
+  DEFSYM (Qstack_scan, "stack-scan");
+  DEFSYM (Qweak_tables, "weak-tables");
+  DEFSYM (Qsweep, "sweep");
+  DEFSYM (Qreclaimed, "reclaimed");
+  DEFSYM (Qexplicit, "explicit");
+  DEFSYM (Qthreshold, "threshold");
+  DEFSYM (Qmemory_full, "memory-full");
+  DEFSYM (Qidle, "idle");
+  DEFSYM (Qtypes, "types");
+  DEFSYM (Qlarge_vectors, "large-vectors");
+  DEFSYM (Qmarkers, "markers");
+  DEFSYM (Qoverlays, "overlays");
+  DEFSYM (Qhash_tables, "hash-tables");
 
   DEFSYM (Qgc_cons_threshold, "gc-cons-threshold");
   DEFSYM (Qchar_table_extra_slots, "char-table-extra-slots");
@@ -7292,6 +9663,79 @@ The time is in seconds as a floating point value.  */);
   DEFVAR_INT ("gcs-done", gcs_done,
 	      doc: /* Accumulated number of garbage collections done.  */);
 
+  DEFVAR_LISP ("gc-last-pause", Vgc_last_pause,
+	       doc: /* Time taken by the most recent garbage collection.
+The time is in seconds as a floating point value.
+`garbage-collection-history' has the times of earlier collections.  */);
+  DEFVAR_LISP ("gc-max-pause", Vgc_max_pause,
+	       doc: /* Longest time taken by a single garbage collection.
+The time is in seconds as a floating point value.  Set this to 0.0
+to start measuring afresh.  */);
+
+  DEFVAR_LISP ("gc-target-overhead", Vgc_target_overhead,
+	       doc: /* Portion of the time that garbage collection should take at most.
+After each garbage collection, Emacs compares the time it took with
+the time elapsed since the previous one.  If it took more than this
+fraction of the total, or found that most of the objects allocated
+since the previous collection are still in use, Emacs waits for more
+consing than `gc-cons-threshold' and `gc-cons-percentage' say before
+the next one, up to 64 times as much as long as the heap does not grow
+by more than its size; when collections are cheap again, it goes back
+to the usual amount.  `garbage-collection-history' shows the amount
+used for each collection.
+If nil, the amount of consing between collections is not adjusted.  */);
+  Vgc_target_overhead = make_float (0.05);
+
+  DEFVAR_LISP ("gc-pause-limit", Vgc_pause_limit,
+	       doc: /* Longest pause for automatic garbage collection while Emacs is busy.
+If a number of seconds, and the next garbage collection is expected to
+take longer, Emacs puts it off until it is idle, until 4 times the
+usual amount of consing has been done.  If nil, collections are not
+put off.  This has no effect in batch mode.  */);
+  Vgc_pause_limit = Qnil;
+
+  DEFVAR_INT ("gc-sweep-threads", gc_sweep_threads,
+	      doc: /* Number of threads that sweep the heap during garbage collection.
+If greater than 1, garbage collection uses up to this many threads,
+including the main one, to sweep cons cells, floats, strings and
+intervals, which can shorten it on machines with several processors.
+Has no effect if Emacs was built without thread support.  */);
+  gc_sweep_threads = 1;
+
+  DEFVAR_INT ("gc-spare-blocks", gc_spare_blocks,
+	      doc: /* Number of blocks of free objects of each type to keep.
+When garbage collection finds blocks of cons cells, floats, strings,
+symbols, markers or intervals that contain free objects only, it
+keeps this many blocks' worth of free objects of each type for future
+allocations, and gives the rest of these blocks back to the system.
+Lower values make Emacs return more memory after a collection, at the
+cost of allocating it again if it is needed soon afterwards.  */);
+  gc_spare_blocks = 1;
+
+  DEFVAR_BOOL ("gc-deduplicate-strings", gc_deduplicate_strings,
+	       doc: /* Non-nil means garbage collection makes equal strings share memory.
+When two or more live strings have the same contents, byte for byte,
+garbage collection stores a single copy of these contents for all of
+them.  Changing the contents of one of the strings, for instance with
+`aset', gives it a copy of its own first.  This saves memory when many
+strings hold the same text, at the cost of slower collections.  */);
+  gc_deduplicate_strings = false;
+
+  DEFVAR_INT ("gc-threads", gc_threads,
+	      doc: /* Number of threads that mark cons cells during garbage collection.
+If greater than 1, garbage collection follows lists and the cons cells
+and floats they contain using up to this many threads, including the
+main one, while the main thread marks all other objects.  This can
+shorten collections of large heaps on machines with several processors.
+Has no effect if Emacs was built without thread support.  */);
+  gc_threads = 1;
+
+  DEFVAR_INT ("gc-mark-stack-max", gc_mark_stack_max,
+	      doc: /* Largest number of entries the GC mark stack has held.
+Garbage collection keeps the objects it has yet to scan on a stack of
+its own rather than the C stack.  This is the deepest that stack has
+been so far.  */);
+
   defsubr (&Scons);
   defsubr (&Slist);
   defsubr (&Svector);
@@ -7306,6 +9750,8 @@ The time is in seconds as a floating point value.  */);
   defsubr (&Spurecopy);
   defsubr (&Sgarbage_collect);
   defsubr (&Smemory_limit);
+  defsubr (&Sgarbage_collection_history);
+  defsubr (&Sheap_census);
   defsubr (&Smemory_info);
   defsubr (&Smemory_use_counts);
   defsubr (&Ssuspicious_object);
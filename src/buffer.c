@@ -45,8 +45,6 @@ along with GNU Emacs.  If not, see <http://www.gnu.org/licenses/>.  */
 #include "w32heap.h"		/* for mmap_* */
 #endif
 
-struct buffer *current_buffer;		/* The current buffer.  */
-
 /* First buffer in chain of all buffers (in reverse order of creation).
    Threaded through ->header.next.buffer.  */
 
@@ -289,6 +287,11 @@ bset_left_fringe_width (struct buffer *b, Lisp_Object val)
   b->INTERNAL_FIELD (left_fringe_width) = val;
 }
 static void
+bset_local_var_slots (struct buffer *b, Lisp_Object val)
+{
+  b->INTERNAL_FIELD (local_var_slots) = val;
+}
+static void
 bset_major_mode (struct buffer *b, Lisp_Object val)
 {
   b->INTERNAL_FIELD (major_mode) = val;
@@ -1052,6 +1055,7 @@ reset_buffer_local_variables (struct buffer *b, bool permanent_too)
 	  bset_local_var_alist (b, XCDR (tmp));
 	else
 	  XSETCDR (last, XCDR (tmp));
+      bset_local_var_slots (b, Qnil);
     }
 
   for (i = 0; i < last_per_buffer_idx; ++i)
@@ -1196,7 +1200,7 @@ buffer_local_value (Lisp_Object variable, Lisp_Object buffer)
       { /* Look in local_var_alist.  */
 	struct Lisp_Buffer_Local_Value *blv = SYMBOL_BLV (sym);
 	XSETSYMBOL (variable, sym); /* Update In case of aliasing.  */
-	result = Fassoc (variable, BVAR (buf, local_var_alist));
+	result = buffer_local_binding (buf, variable);
 	if (!NILP (result))
 	  {
 	    if (blv->fwd)
@@ -1233,6 +1237,121 @@ buffer_local_value (Lisp_Object variable, Lisp_Object buffer)
   return result;
 }
 
+/* The slot table of a buffer lets the binding of a localized variable
+   be found without searching local_var_alist.  It is a vector whose
+   size is a power of two, holding the cells (SYMBOL . VALUE) of the
+   alist at positions derived from the `index' of each variable's
+   struct Lisp_Buffer_Local_Value, with linear probing and nil for an
+   empty slot.  The table is built lazily, kept at most half full, and
+   simply dropped by bset_local_var_alist whenever the alist is
+   changed other than by add_buffer_local_binding.  */
+
+/* Store CELL, a binding of a localized variable, in the slot table
+   SLOTS, replacing any binding of the same variable there.  Return
+   true if CELL took a previously empty slot.  */
+
+static bool
+put_local_var_slot (Lisp_Object slots, Lisp_Object cell)
+{
+  Lisp_Object symbol = XCAR (cell);
+  ptrdiff_t mask = ASIZE (slots) - 1;
+  ptrdiff_t i = SYMBOL_BLV (XSYMBOL (symbol))->index & mask;
+
+  for (;; i = (i + 1) & mask)
+    {
+      Lisp_Object tem = AREF (slots, i);
+      if (NILP (tem) || EQ (XCAR (tem), symbol))
+	{
+	  ASET (slots, i, cell);
+	  return NILP (tem);
+	}
+    }
+}
+
+/* Rebuild the slot table of buffer B from its local_var_alist, and
+   return it.  */
+
+static Lisp_Object
+rebuild_local_var_slots (struct buffer *b)
+{
+  Lisp_Object tail, slots;
+  ptrdiff_t size = 8, count = 0;
+
+  for (tail = BVAR (b, local_var_alist); CONSP (tail); tail = XCDR (tail))
+    count++;
+  while (size < 2 * count)
+    size *= 2;
+
+  slots = Fmake_vector (make_number (size), Qnil);
+  b->local_var_slots_used = 0;
+
+  /* Walk the alist in reverse, so that when a variable occurs twice
+     the binding that assq would find is the one that stays.  */
+  for (tail = Freverse (BVAR (b, local_var_alist));
+       CONSP (tail); tail = XCDR (tail))
+    {
+      Lisp_Object cell = XCAR (tail);
+      if (CONSP (cell) && SYMBOLP (XCAR (cell))
+	  && XSYMBOL (XCAR (cell))->redirect == SYMBOL_LOCALIZED
+	  && put_local_var_slot (slots, cell))
+	b->local_var_slots_used++;
+    }
+
+  bset_local_var_slots (b, slots);
+  return slots;
+}
+
+/* Return the binding (SYMBOL . VALUE) of the localized variable
+   SYMBOL in buffer B, or nil if it has none there.  This is what
+   assq of SYMBOL in the local_var_alist of B would return, but it
+   takes constant time.  */
+
+Lisp_Object
+buffer_local_binding (struct buffer *b, Lisp_Object symbol)
+{
+  Lisp_Object slots = BVAR (b, local_var_slots);
+  ptrdiff_t mask, i;
+
+  eassert (XSYMBOL (symbol)->redirect == SYMBOL_LOCALIZED);
+
+  if (NILP (slots))
+    {
+      if (NILP (BVAR (b, local_var_alist)))
+	return Qnil;
+      slots = rebuild_local_var_slots (b);
+    }
+
+  mask = ASIZE (slots) - 1;
+  for (i = SYMBOL_BLV (XSYMBOL (symbol))->index & mask;;
+       i = (i + 1) & mask)
+    {
+      Lisp_Object cell = AREF (slots, i);
+      if (NILP (cell) || EQ (XCAR (cell), symbol))
+	return cell;
+    }
+}
+
+/* Give buffer B the new binding CELL, of the form (SYMBOL . VALUE),
+   for the localized variable SYMBOL.  */
+
+void
+add_buffer_local_binding (struct buffer *b, Lisp_Object cell)
+{
+  Lisp_Object slots = BVAR (b, local_var_slots);
+
+  /* Don't use bset_local_var_alist, which would drop the slot table.  */
+  b->INTERNAL_FIELD (local_var_alist)
+    = Fcons (cell, BVAR (b, local_var_alist));
+
+  if (!NILP (slots))
+    {
+      if (2 * (b->local_var_slots_used + 1) > ASIZE (slots))
+	bset_local_var_slots (b, Qnil);
+      else if (put_local_var_slot (slots, cell))
+	b->local_var_slots_used++;
+    }
+}
+
 /* Return an alist of the Lisp-level buffer-local bindings of
    buffer BUF.  That is, don't include the variables maintained
    in special slots in the buffer object.
@@ -1683,6 +1802,10 @@ cleaning up all windows currently displaying the buffer to be killed. */)
   if (!BUFFER_LIVE_P (b))
     return Qnil;
 
+  /* Don't kill the current buffer of another thread.  */
+  if (thread_check_current_buffer (b))
+    return Qnil;
+
   /* Run hooks with the buffer to be killed the current buffer.  */
   {
     ptrdiff_t count = SPECPDL_INDEX ();
@@ -2068,7 +2191,6 @@ void
 set_buffer_internal_1 (register struct buffer *b)
 {
   register struct buffer *old_buf;
-  register Lisp_Object tail;
 
 #ifdef USE_MMAP_FOR_BUFFERS
   if (b->text->beg == NULL)
@@ -2082,6 +2204,20 @@ set_buffer_internal_1 (register struct buffer *b)
 
   old_buf = current_buffer;
   current_buffer = b;
+  set_buffer_internal_2 (old_buf);
+}
+
+/* Finish making current_buffer current, after OLD_BUF was.  This is
+   the part of set_buffer_internal_1 that is also needed when a
+   thread switch changes current_buffer; OLD_BUF may then be the same
+   buffer, or NULL.  */
+
+void
+set_buffer_internal_2 (struct buffer *old_buf)
+{
+  struct buffer *b = current_buffer;
+  Lisp_Object tail;
+
   last_known_column_point = -1;   /* Invalidate indentation cache.  */
 
   if (old_buf)
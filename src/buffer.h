@@ -529,6 +529,12 @@ struct buffer
      symbols, just the symbol appears as the element.  */
   Lisp_Object INTERNAL_FIELD (local_var_alist);
 
+  /* Open-addressed hash table of the elements of local_var_alist,
+     keyed by the `index' of each variable's Lisp_Buffer_Local_Value,
+     or nil if it must be rebuilt before use.  See
+     buffer_local_binding.  */
+  Lisp_Object INTERNAL_FIELD (local_var_slots);
+
   /* Symbol naming major mode (e.g., lisp-mode).  */
   Lisp_Object INTERNAL_FIELD (major_mode);
 
@@ -796,6 +802,10 @@ struct buffer
 #define MAX_PER_BUFFER_VARS 50
   char local_flags[MAX_PER_BUFFER_VARS];
 
+  /* Number of bindings stored in local_var_slots.  Meaningless when
+     local_var_slots is nil.  */
+  ptrdiff_t local_var_slots_used;
+
   /* Set to the modtime of the visited file when read or written.
      modtime.tv_nsec == NONEXISTENT_MODTIME_NSECS means
      visited file was nonexistent.  modtime.tv_nsec ==
@@ -942,6 +952,8 @@ INLINE void
 bset_local_var_alist (struct buffer *b, Lisp_Object val)
 {
   b->INTERNAL_FIELD (local_var_alist) = val;
+  /* The slot table may now be out of date.  */
+  b->INTERNAL_FIELD (local_var_slots) = Qnil;
 }
 INLINE void
 bset_mark_active (struct buffer *b, Lisp_Object val)
@@ -1034,10 +1046,6 @@ extern struct buffer *all_buffers;
 #define FOR_EACH_BUFFER(b) \
   for ((b) = all_buffers; (b); (b) = (b)->next)
 
-/* This points to the current buffer.  */
-
-extern struct buffer *current_buffer;
-
 /* This structure holds the default values of the buffer-local variables
    that have special slots in each buffer.
    The default value occupies the same slot in this structure
@@ -1080,8 +1088,11 @@ extern void recenter_overlay_lists (struct buffer *, ptrdiff_t);
 extern ptrdiff_t overlay_strings (ptrdiff_t, struct window *, unsigned char **);
 extern void validate_region (Lisp_Object *, Lisp_Object *);
 extern void set_buffer_internal_1 (struct buffer *);
+extern void set_buffer_internal_2 (struct buffer *);
 extern void set_buffer_temp (struct buffer *);
 extern Lisp_Object buffer_local_value (Lisp_Object, Lisp_Object);
+extern Lisp_Object buffer_local_binding (struct buffer *, Lisp_Object);
+extern void add_buffer_local_binding (struct buffer *, Lisp_Object);
 extern void record_buffer (Lisp_Object);
 extern void fix_overlays_before (struct buffer *, ptrdiff_t, ptrdiff_t);
 extern void mmap_set_vars (bool);
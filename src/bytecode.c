@@ -59,32 +59,40 @@ by Hallvard:
 
 /* If BYTE_CODE_THREADED is defined, then the interpreter will be
    indirect threaded, using GCC's computed goto extension.  This code,
-   as currently implemented, is incompatible with BYTE_CODE_SAFE and
-   BYTE_CODE_METER.  */
+   as currently implemented, is incompatible with BYTE_CODE_SAFE.
+   Metering costs the threaded interpreter next to nothing while
+   `byte-metering-on' is nil, so it is always enabled there.  */
 #if (defined __GNUC__ && !defined __STRICT_ANSI__ \
-     && !defined BYTE_CODE_SAFE && !defined BYTE_CODE_METER)
+     && !defined BYTE_CODE_SAFE)
 #define BYTE_CODE_THREADED
+#ifndef BYTE_CODE_METER
+#define BYTE_CODE_METER
+#endif
 #endif
 
 
 #ifdef BYTE_CODE_METER
 
 Lisp_Object Qbyte_code_meter;
-#define METER_2(code1, code2) AREF (AREF (Vbyte_code_meter, code1), code2)
-#define METER_1(code) METER_2 (0, code)
+
+/* Increment element CODE2 of element CODE1 of byte-code-meter.  */
+
+static void
+meter_increment (int code1, int code2)
+{
+  Lisp_Object counts = AREF (Vbyte_code_meter, code1);
+
+  if (XFASTINT (AREF (counts, code2)) < MOST_POSITIVE_FIXNUM)
+    ASET (counts, code2, make_number (XFASTINT (AREF (counts, code2)) + 1));
+}
 
 #define METER_CODE(last_code, this_code)				\
 {									\
   if (byte_metering_on)							\
     {									\
-      if (XFASTINT (METER_1 (this_code)) < MOST_POSITIVE_FIXNUM)	\
-        XSETFASTINT (METER_1 (this_code),				\
-		     XFASTINT (METER_1 (this_code)) + 1);		\
-      if (last_code							\
-	  && (XFASTINT (METER_2 (last_code, this_code))			\
-	      < MOST_POSITIVE_FIXNUM))					\
-        XSETFASTINT (METER_2 (last_code, this_code),			\
-		     XFASTINT (METER_2 (last_code, this_code)) + 1);	\
+      meter_increment (0, this_code);					\
+      if (last_code)							\
+	meter_increment (last_code, this_code);				\
     }									\
 }
 
@@ -146,6 +154,7 @@ DEFINE (Bunbind7, 057)							\
 DEFINE (Bpophandler, 060)						\
 DEFINE (Bpushconditioncase, 061)					\
 DEFINE (Bpushcatch, 062)						\
+DEFINE (Byield, 063)							\
 									\
 DEFINE (Bnth, 070)							\
 DEFINE (Bsymbolp, 071)							\
@@ -298,6 +307,7 @@ enum byte_code_op
 
 /* Whether to maintain a `top' and `bottom' field in the stack frame.  */
 #define BYTE_MAINTAIN_TOP (BYTE_CODE_SAFE || BYTE_MARK_STACK)
+
 
 /* Structure describing a value stack used during byte-code execution
    in Fbyte_code.  */
@@ -326,6 +336,10 @@ struct byte_stack
   Lisp_Object constants;
 #endif
 
+  /* The entry of the byte-code profiler's log for this code, or nil if
+     the profiler was not running when it started.  */
+  Lisp_Object profile;
+
   /* Next entry in byte_stack_list.  */
   struct byte_stack *next;
 };
@@ -334,21 +348,19 @@ struct byte_stack
    Fbyte_code adds an entry to the head of this list before it starts
    processing byte-code, and it removes the entry again when it is
    done.  Signaling an error truncates the list analogous to
-   gcprolist.  */
-
-struct byte_stack *byte_stack_list;
+   gcprolist.  Each thread has its own list; byte_stack_list is
+   defined in thread.h.  */
 
 
-/* Mark objects on byte_stack_list.  Called during GC.  */
+/* Mark objects on the byte stack list STACK.  Called during GC.  */
 
 #if BYTE_MARK_STACK
 void
-mark_byte_stack (void)
+mark_byte_stack (struct byte_stack *stack)
 {
-  struct byte_stack *stack;
   Lisp_Object *obj;
 
-  for (stack = byte_stack_list; stack; stack = stack->next)
+  for (; stack; stack = stack->next)
     {
       /* If STACK->top is null here, this means there's an opcode in
 	 Fbyte_code that wasn't expected to GC, but did.  To find out
@@ -364,19 +376,18 @@ mark_byte_stack (void)
 
       mark_object (stack->byte_string);
       mark_object (stack->constants);
+      mark_object (stack->profile);
     }
 }
 #endif
 
-/* Unmark objects in the stacks on byte_stack_list.  Relocate program
+/* Unmark objects in the byte stack list STACK.  Relocate program
    counters.  Called when GC has completed.  */
 
 void
-unmark_byte_stack (void)
+unmark_byte_stack (struct byte_stack *stack)
 {
-  struct byte_stack *stack;
-
-  for (stack = byte_stack_list; stack; stack = stack->next)
+  for (; stack; stack = stack->next)
     {
       if (stack->byte_string_start != SDATA (stack->byte_string))
 	{
@@ -401,6 +412,10 @@ unmark_byte_stack (void)
 
 #define FETCH2 (op = FETCH, op + (FETCH << 8))
 
+/* The opcode of the next instruction.  */
+
+#define PEEK_OPCODE (*stack.pc)
+
 /* Push x onto the execution stack.  This used to be #define PUSH(x)
    (*++stackp = (x)) This oddity is necessary because Alliant can't be
    bothered to compile the preincrement operator properly, as of 4/91.
@@ -474,6 +489,201 @@ unmark_byte_stack (void)
       process_pending_signals ();			\
   } while (0)
 
+/* The byte-code profiler.  It counts how often each instruction of
+   byte-code runs, and which functions it calls.  */
+
+/* Whether the byte-code profiler is running.  */
+static bool profiler_byte_code_running;
+
+/* The log of the byte-code profiler, a hash table.  Its keys are
+   byte-code strings, and its values vectors whose elements are given
+   by enum byte_code_profile_index.  */
+static Lisp_Object byte_code_log;
+
+enum byte_code_profile_index
+  {
+    /* The function being called when the code first ran.  */
+    PROFILE_FUNCTION,
+
+    /* The vector of constants of the code.  */
+    PROFILE_CONSTANTS,
+
+    /* A vector of counts, one per byte of the code, of the runs of
+       the instruction that starts there.  */
+    PROFILE_COUNTS,
+
+    /* A hash table counting the calls to each function.  */
+    PROFILE_CALLS,
+
+    PROFILE_SIZE
+  };
+
+/* Return a new hash table that compares keys with eq.  */
+
+static Lisp_Object
+make_eq_hash_table (void)
+{
+  return make_hash_table (hashtest_eq, make_number (DEFAULT_HASH_SIZE),
+			  make_float (DEFAULT_REHASH_SIZE),
+			  make_float (DEFAULT_REHASH_THRESHOLD),
+			  Qnil);
+}
+
+/* Return the entry of the byte-code profiler's log for the code
+   BYTESTR, whose vector of constants is VECTOR.  */
+
+static Lisp_Object
+byte_code_profile (Lisp_Object bytestr, Lisp_Object vector)
+{
+  struct Lisp_Hash_Table *h = XHASH_TABLE (byte_code_log);
+  EMACS_UINT hash;
+  ptrdiff_t i = hash_lookup (h, bytestr, &hash);
+  Lisp_Object profile;
+  ptrdiff_t nbytes;
+
+  if (0 <= i)
+    return HASH_VALUE (h, i);
+
+  /* See exec_byte_code.  */
+  if (STRING_MULTIBYTE (bytestr))
+    nbytes = SBYTES (Fstring_as_unibyte (bytestr));
+  else
+    nbytes = SBYTES (bytestr);
+  profile = Fmake_vector (make_number (PROFILE_SIZE), Qnil);
+  ASET (profile, PROFILE_FUNCTION, backtrace_top_function ());
+  ASET (profile, PROFILE_CONSTANTS, vector);
+  ASET (profile, PROFILE_COUNTS,
+	Fmake_vector (make_number (nbytes), make_number (0)));
+  ASET (profile, PROFILE_CALLS, make_eq_hash_table ());
+  hash_put (h, bytestr, profile, hash);
+  return profile;
+}
+
+/* Count a run of the instruction of STACK at INDEX.  */
+
+static void
+profile_insn (struct byte_stack *stack, ptrdiff_t index)
+{
+  if (!NILP (stack->profile))
+    {
+      Lisp_Object counts = AREF (stack->profile, PROFILE_COUNTS);
+      EMACS_INT n = XFASTINT (AREF (counts, index));
+      if (n < MOST_POSITIVE_FIXNUM)
+	ASET (counts, index, make_number (n + 1));
+    }
+}
+
+/* Count a call of FUNCTION from STACK.  */
+
+static void
+profile_call (struct byte_stack *stack, Lisp_Object function)
+{
+  if (!NILP (stack->profile))
+    {
+      Lisp_Object calls = AREF (stack->profile, PROFILE_CALLS);
+      Lisp_Object n = Fgethash (function, calls, make_number (0));
+      if (XFASTINT (n) < MOST_POSITIVE_FIXNUM)
+	Fputhash (function, make_number (XFASTINT (n) + 1), calls);
+    }
+}
+
+DEFUN ("profiler-byte-code-start", Fprofiler_byte_code_start,
+       Sprofiler_byte_code_start, 0, 0, 0,
+       doc: /* Start the byte-code profiler.
+It counts how often each instruction of byte-code runs, and which
+functions the code calls.  Return t if successful, nil if the profiler
+was already running.  */)
+  (void)
+{
+  if (profiler_byte_code_running)
+    return Qnil;
+
+  if (NILP (byte_code_log))
+    byte_code_log = make_eq_hash_table ();
+  profiler_byte_code_running = true;
+  return Qt;
+}
+
+DEFUN ("profiler-byte-code-stop", Fprofiler_byte_code_stop,
+       Sprofiler_byte_code_stop, 0, 0, 0,
+       doc: /* Stop the byte-code profiler.  The profiler log is not affected.
+Return non-nil if the profiler was running.  */)
+  (void)
+{
+  bool was_running = profiler_byte_code_running;
+  profiler_byte_code_running = false;
+  return was_running ? Qt : Qnil;
+}
+
+DEFUN ("profiler-byte-code-running-p", Fprofiler_byte_code_running_p,
+       Sprofiler_byte_code_running_p, 0, 0, 0,
+       doc: /* Return non-nil if the byte-code profiler is running.  */)
+  (void)
+{
+  return profiler_byte_code_running ? Qt : Qnil;
+}
+
+/* Return a list of the elements of the hash table TABLE, as conses
+   (KEY . VALUE).  */
+
+static Lisp_Object
+hash_table_alist (Lisp_Object table)
+{
+  struct Lisp_Hash_Table *h = XHASH_TABLE (table);
+  Lisp_Object alist = Qnil;
+  ptrdiff_t i;
+
+  for (i = 0; i < HASH_TABLE_SIZE (h); i++)
+    if (!NILP (HASH_HASH (h, i)))
+      alist = Fcons (Fcons (HASH_KEY (h, i), HASH_VALUE (h, i)), alist);
+  return alist;
+}
+
+DEFUN ("profiler-byte-code-log", Fprofiler_byte_code_log,
+       Sprofiler_byte_code_log, 0, 0, 0,
+       doc: /* Return the current byte-code profiler log.
+The log is a list of vectors [FUNCTION BYTESTR CONSTANTS COUNTS CALLS],
+one for each piece of byte-code that ran while the profiler was
+running.  FUNCTION is the function that was being called when it first
+ran, BYTESTR and CONSTANTS are its string of byte-code and its vector
+of constants, and COUNTS is a vector as long as BYTESTR, whose element
+at the offset of each instruction in BYTESTR says how often that
+instruction ran.  CALLS is an alist whose elements (CALLEE . COUNT) say
+how often the code called CALLEE.
+Before returning, a new log is allocated for future counts.  */)
+  (void)
+{
+  Lisp_Object log = Qnil, entries;
+  struct thread_state *thread;
+  struct byte_stack *stack;
+
+  if (NILP (byte_code_log))
+    return Qnil;
+
+  for (entries = hash_table_alist (byte_code_log); CONSP (entries);
+       entries = XCDR (entries))
+    {
+      Lisp_Object bytestr = XCAR (XCAR (entries));
+      Lisp_Object profile = XCDR (XCAR (entries));
+      Lisp_Object entry = Fmake_vector (make_number (5), Qnil);
+      ASET (entry, 0, AREF (profile, PROFILE_FUNCTION));
+      ASET (entry, 1, bytestr);
+      ASET (entry, 2, AREF (profile, PROFILE_CONSTANTS));
+      ASET (entry, 3, AREF (profile, PROFILE_COUNTS));
+      ASET (entry, 4, hash_table_alist (AREF (profile, PROFILE_CALLS)));
+      log = Fcons (entry, log);
+    }
+
+  /* Code that is running stops counting, rather than count in the
+     old log.  */
+  byte_code_log = (profiler_byte_code_running
+		   ? make_eq_hash_table () : Qnil);
+  for (thread = all_threads; thread; thread = thread->next_thread)
+    for (stack = thread->m_byte_stack_list; stack; stack = stack->next)
+      stack->profile = Qnil;
+  return log;
+}
+
 
 DEFUN ("byte-code", Fbyte_code, Sbyte_code, 3, 3, 0,
        doc: /* Function used internally in byte-compiled code.
@@ -483,7 +693,7 @@ the third, MAXDEPTH, the maximum stack depth used in this function.
 If the third argument is incorrect, Emacs may crash.  */)
   (Lisp_Object bytestr, Lisp_Object vector, Lisp_Object maxdepth)
 {
-  return exec_byte_code (bytestr, vector, maxdepth, Qnil, 0, NULL);
+  return exec_byte_code (bytestr, vector, maxdepth, Qnil, 0, NULL, Qnil);
 }
 
 static void
@@ -492,19 +702,305 @@ bcall0 (Lisp_Object f)
   Ffuncall (1, &f);
 }
 
+/* If A and B are numbers, not markers, and at least one of them is
+   a float, store their values in *X and *Y and return true.  This is
+   when Fplus and the like do float arithmetic on A and B, which
+   exec_byte_code can then do itself.  */
+
+static bool
+float_operands (Lisp_Object a, Lisp_Object b, double *x, double *y)
+{
+  if (FLOATP (a))
+    {
+      if (FLOATP (b))
+	*y = XFLOAT_DATA (b);
+      else if (INTEGERP (b))
+	*y = XINT (b);
+      else
+	return false;
+      *x = XFLOAT_DATA (a);
+      return true;
+    }
+  else if (FLOATP (b) && INTEGERP (a))
+    {
+      *x = XINT (a);
+      *y = XFLOAT_DATA (b);
+      return true;
+    }
+  else
+    return false;
+}
+
+/* A direct-mapped cache of the definitions of the functions that
+   byte-code calls, which stay valid as long as no function cell
+   changes.  Calls are told apart by the function called and the number
+   of arguments passed.  Each entry takes CALL_CACHE_ENTRY_SIZE slots
+   of the vector call_cache.  */
+
+#define CALL_CACHE_SIZE 256
+static Lisp_Object call_cache;
+
+enum call_cache_index
+  {
+    /* The function called.  */
+    CALL_CACHE_FUNCTION,
+
+    /* The number of arguments passed.  */
+    CALL_CACHE_NARGS,
+
+    /* The definition of the function, a subr or byte-code function.  */
+    CALL_CACHE_DEFINITION,
+
+    /* The value of function_epoch when the definition was found.  */
+    CALL_CACHE_EPOCH,
+
+    /* Non-nil if the definition is a subr that takes exactly that many
+       arguments, or any number, so that funcall_subr_exact can call it
+       without checking the number of arguments again.  */
+    CALL_CACHE_EXACT,
+
+    CALL_CACHE_ENTRY_SIZE
+  };
+
+/* Call ARGS[0] with the NARGS - 1 arguments that follow it, like
+   Ffuncall, using the definition call_cache has for it if any.  */
+
+static Lisp_Object
+funcall_cached (ptrdiff_t nargs, Lisp_Object *args)
+{
+  Lisp_Object fun = args[0];
+  ptrdiff_t numargs = nargs - 1;
+  Lisp_Object *entry
+    = (XVECTOR (call_cache)->contents
+       + (CALL_CACHE_ENTRY_SIZE
+	  * (((XHASH (fun) >> GCTYPEBITS) ^ numargs) % CALL_CACHE_SIZE)));
+
+  if (! (EQ (entry[CALL_CACHE_FUNCTION], fun)
+	 && EQ (entry[CALL_CACHE_NARGS], make_number (numargs))
+	 && EQ (entry[CALL_CACHE_EPOCH], make_number (function_epoch))))
+    {
+      /* Look up the definition the way Ffuncall does, and leave
+	 anything but subrs that evaluate their arguments and byte-code
+	 to it.  */
+      Lisp_Object definition = fun;
+      if (SYMBOLP (definition) && !NILP (definition)
+	  && (definition = XSYMBOL (definition)->function,
+	      SYMBOLP (definition)))
+	definition = indirect_function (definition);
+      if (! ((SUBRP (definition)
+	      && XSUBR (definition)->max_args != UNEVALLED)
+	     || COMPILEDP (definition)))
+	return Ffuncall (nargs, args);
+      entry[CALL_CACHE_FUNCTION] = fun;
+      entry[CALL_CACHE_NARGS] = make_number (numargs);
+      entry[CALL_CACHE_DEFINITION] = definition;
+      entry[CALL_CACHE_EPOCH] = make_number (function_epoch);
+      entry[CALL_CACHE_EXACT]
+	= ((SUBRP (definition)
+	    && XSUBR (definition)->min_args <= numargs
+	    && (XSUBR (definition)->max_args == MANY
+		|| (XSUBR (definition)->max_args == numargs
+		    && numargs <= 4)))
+	   ? Qt : Qnil);
+    }
+
+  if (NILP (entry[CALL_CACHE_EXACT]))
+    return funcall_definition (entry[CALL_CACHE_DEFINITION], nargs, args);
+  else
+    return funcall_subr_exact (entry[CALL_CACHE_DEFINITION], nargs, args);
+}
+
+/* Return the definition of FUNCTION if exec_byte_code can call it in
+   place of the code it is running, as a tail call, and nil otherwise.
+   COUNT and ARGS_TEMPLATE are what exec_byte_code started with, and
+   STACK_SIZE is the size of its stack.
+
+   The definition must be byte-code that takes its arguments on the
+   stack and fits in the stack, nothing may be left to unbind, and the
+   frame must be one that funcall_lambda made, whose record is the
+   innermost one in the backtrace.  */
+
+static Lisp_Object
+tail_call_definition (Lisp_Object function, ptrdiff_t count,
+		      Lisp_Object args_template, ptrdiff_t stack_size)
+{
+  Lisp_Object definition = function;
+
+  if (!INTEGERP (args_template) || SPECPDL_INDEX () != count
+      || debug_on_next_call)
+    return Qnil;
+
+  if (SYMBOLP (definition) && !NILP (definition)
+      && (definition = XSYMBOL (definition)->function, SYMBOLP (definition)))
+    definition = indirect_function (definition);
+  if (! (COMPILEDP (definition)
+	 && INTEGERP (AREF (definition, COMPILED_ARGLIST))))
+    return Qnil;
+
+  if (CONSP (AREF (definition, COMPILED_BYTECODE)))
+    Ffetch_bytecode (definition);
+  if (! (NATNUMP (AREF (definition, COMPILED_STACK_DEPTH))
+	 && XFASTINT (AREF (definition, COMPILED_STACK_DEPTH)) <= stack_size))
+    return Qnil;
+
+  return definition;
+}
+
+/* The states of a coroutine.  */
+
+enum coroutine_state
+{
+  /* Not started yet, or suspended by Byield.  */
+  COROUTINE_SUSPENDED,
+  /* Being run by coroutine-resume.  */
+  COROUTINE_RUNNING,
+  /* Returned, exited nonlocally, or closed.  */
+  COROUTINE_DEAD
+};
+
+/* A coroutine runs a lexically bound byte-code function in a frame of
+   its own, which Byield can suspend and coroutine-resume resumes.
+   While the coroutine is suspended, what is left of the frame once the
+   C stack is gone is kept here.  */
+
+struct Lisp_Coroutine
+{
+  struct vectorlike_header header;
+
+  /* The function the coroutine runs.  */
+  Lisp_Object function;
+
+  /* Until the coroutine starts, a vector of the arguments to call
+     FUNCTION with.  After it suspends itself, a vector of its value
+     stack, bottom first, and a last slot for the value it is resumed
+     with.  */
+  Lisp_Object stack;
+
+  /* The code the coroutine was running when it suspended itself, which
+     is nil until it starts.  */
+  Lisp_Object code;
+
+  /* The handlers the coroutine had established, outermost first.  See
+     enum saved_handler_index.  */
+  Lisp_Object handlers;
+
+  /* What suspend_specpdl made of the bindings and unwind forms the
+     coroutine had pending.  */
+  Lisp_Object bindings;
+
+  /* Where in CODE the coroutine goes on.  */
+  ptrdiff_t pc;
+
+  enum coroutine_state state;
+};
+
+/* The slots of the vectors that stand for the handlers of a suspended
+   coroutine.  TOP is relative to the bottom of the value stack, minus
+   one, and PDLCOUNT relative to where the specpdl of the coroutine
+   starts.  */
+
+enum saved_handler_index
+  {
+    SAVED_HANDLER_TYPE,
+    SAVED_HANDLER_TAG,
+    SAVED_HANDLER_DEST,
+    SAVED_HANDLER_TOP,
+    SAVED_HANDLER_PDLCOUNT,
+    SAVED_HANDLER_SIZE
+  };
+
+static struct Lisp_Coroutine *
+XCOROUTINE (Lisp_Object a)
+{
+  eassert (COROUTINEP (a));
+  return XUNTAG (a, Lisp_Vectorlike);
+}
+
+static Lisp_Object Qcoroutinep;
+
+/* Suspend COROUTINE, whose frame of byte-code STACK has its value
+   stack from BASE + 1 to TOP, and started when the specpdl had COUNT
+   entries and the innermost handler was HANDLERS.  Save what the frame
+   needs to go on in COROUTINE, and take its bindings, unwind forms and
+   handlers off the specpdl and handlerlist.  */
+
+static void
+suspend_coroutine (Lisp_Object coroutine, struct byte_stack *stack,
+		   Lisp_Object *base, Lisp_Object *top, ptrdiff_t count,
+		   struct handler *handlers)
+{
+  struct Lisp_Coroutine *co = XCOROUTINE (coroutine);
+  /* This signals an error if the frame cannot be suspended, so it
+     comes before anything else.  */
+  Lisp_Object specpdl_entries = suspend_specpdl (count);
+  Lisp_Object saved_handlers = Qnil;
+  ptrdiff_t depth = top - base;
+  struct handler *c;
+
+  for (c = handlerlist; c != handlers; c = c->next)
+    {
+      Lisp_Object h = make_uninit_vector (SAVED_HANDLER_SIZE);
+      ASET (h, SAVED_HANDLER_TYPE, make_number (c->type));
+      ASET (h, SAVED_HANDLER_TAG, c->tag_or_ch);
+      ASET (h, SAVED_HANDLER_DEST, make_number (c->bytecode_dest));
+      ASET (h, SAVED_HANDLER_TOP, make_number (c->bytecode_top - base));
+      ASET (h, SAVED_HANDLER_PDLCOUNT, make_number (c->pdlcount - count));
+      saved_handlers = Fcons (h, saved_handlers);
+    }
+  handlerlist = handlers;
+
+  /* A coroutine that yields over and over again from the same depth
+     can keep using the same vector.  */
+  if (! (VECTORP (co->stack) && ASIZE (co->stack) == depth + 1))
+    co->stack = make_uninit_vector (depth + 1);
+  memcpy (XVECTOR (co->stack)->contents, base + 1, depth * word_size);
+  ASET (co->stack, depth, Qnil);
+  co->code = stack->byte_string;
+  co->handlers = saved_handlers;
+  co->bindings = specpdl_entries;
+  co->pc = stack->pc - stack->byte_string_start;
+  co->state = COROUTINE_SUSPENDED;
+}
+
 /* Execute the byte-code in BYTESTR.  VECTOR is the constant vector, and
    MAXDEPTH is the maximum stack depth used (if MAXDEPTH is incorrect,
    emacs may crash!).  If ARGS_TEMPLATE is non-nil, it should be a lisp
    argument list (including &rest, &optional, etc.), and ARGS, of size
    NARGS, should be a vector of the actual arguments.  The arguments in
    ARGS are pushed on the stack according to ARGS_TEMPLATE before
-   executing BYTESTR.  */
+   executing BYTESTR.
+
+   If COROUTINE is non-nil, the code is that of the function of that
+   coroutine, which Byield may suspend.  If the coroutine has been
+   suspended before, ARGS_TEMPLATE is nil, and it goes on from where it
+   stopped.  */
 
 Lisp_Object
 exec_byte_code (Lisp_Object bytestr, Lisp_Object vector, Lisp_Object maxdepth,
-		Lisp_Object args_template, ptrdiff_t nargs, Lisp_Object *args)
+		Lisp_Object args_template, ptrdiff_t nargs, Lisp_Object *args,
+		Lisp_Object coroutine)
 {
   ptrdiff_t count = SPECPDL_INDEX ();
+  /* The innermost handler when the code started.  */
+  struct handler *base_handler = handlerlist;
+  /* The stack, which tail calls reuse, and its size.  */
+  Lisp_Object *stack_base = NULL;
+  ptrdiff_t stack_size;
+  /* Where tail calls keep their arguments, which the backtrace shows.  */
+  Lisp_Object *tail_call_args = NULL;
+  /* Where unwind_to_catch jumps back into this frame, for any of the
+     handlers it pushed.  It is set up by the first of them.  */
+  sys_jmp_buf catch_jmp;
+  bool catch_jmp_set;
+  /* The float that the last arithmetic instruction made for its
+     result, and the offset in the code just after that instruction.
+     Only the stack refers to the float until the next instruction
+     runs, so if that instruction is arithmetic too, it may store its
+     own result there instead of consing a new float.  The offset is
+     kept rather than a pointer because GC may move the code.  */
+  Lisp_Object fresh_float;
+  ptrdiff_t fresh_float_offset;
+  double d1, d2;
 #ifdef BYTE_CODE_METER
   int volatile this_op = 0;
   int prev_op;
@@ -532,6 +1028,53 @@ exec_byte_code (Lisp_Object bytestr, Lisp_Object vector, Lisp_Object maxdepth,
  }
 #endif
 
+#ifdef BYTE_CODE_THREADED
+
+  /* A convenience define that saves us a lot of typing and makes
+     the table clearer.  */
+#define LABEL(OP) [OP] = &&insn_ ## OP
+
+#if 4 < __GNUC__ + (6 <= __GNUC_MINOR__)
+# pragma GCC diagnostic push
+# pragma GCC diagnostic ignored "-Woverride-init"
+#elif defined __clang__
+# pragma GCC diagnostic push
+# pragma GCC diagnostic ignored "-Winitializer-overrides"
+#endif
+
+  /* This is the dispatch table for the threaded interpreter.  */
+  static const void *const targets[256] =
+    {
+      [0 ... (Bconstant - 1)] = &&insn_default,
+      [Bconstant ... 255] = &&insn_Bconstant,
+
+#define DEFINE(name, value) LABEL (name) ,
+      BYTE_CODES
+#undef DEFINE
+    };
+
+#if 4 < __GNUC__ + (6 <= __GNUC_MINOR__) || defined __clang__
+# pragma GCC diagnostic pop
+#endif
+
+  /* The dispatch table for code that is metered or profiled.  It sends
+     every instruction through insn_instrument first, so that other
+     code need not check whether it should be.  */
+  static const void *const instrumented_targets[256] =
+    {
+      [0 ... 255] = &&insn_instrument
+    };
+
+  /* Which of the two tables the code runs with.  */
+  const void *const *dispatch;
+
+#endif
+
+  /* A tail call starts over here, with the definition it calls.  */
+ start:
+  catch_jmp_set = false;
+  fresh_float = Qnil;
+  fresh_float_offset = -1;
   CHECK_STRING (bytestr);
   CHECK_VECTOR (vector);
   CHECK_NATNUM (maxdepth);
@@ -540,6 +1083,14 @@ exec_byte_code (Lisp_Object bytestr, Lisp_Object vector, Lisp_Object maxdepth,
   const_length = ASIZE (vector);
 #endif
 
+  /* The profiler's log is keyed by the string the code came in.  */
+  stack.profile = (profiler_byte_code_running
+		   ? byte_code_profile (bytestr, vector) : Qnil);
+#ifdef BYTE_CODE_THREADED
+  dispatch = (byte_metering_on || !NILP (stack.profile)
+	      ? instrumented_targets : targets);
+#endif
+
   if (STRING_MULTIBYTE (bytestr))
     /* BYTESTR must have been produced by Emacs 20.2 or the earlier
        because they produced a raw 8-bit string for byte-code and now
@@ -558,15 +1109,21 @@ exec_byte_code (Lisp_Object bytestr, Lisp_Object vector, Lisp_Object maxdepth,
 #if BYTE_MARK_STACK
   stack.constants = vector;
 #endif
-  if (MAX_ALLOCA / word_size <= XFASTINT (maxdepth))
-    memory_full (SIZE_MAX);
-  top = alloca ((XFASTINT (maxdepth) + 1) * sizeof *top);
+  if (stack_base)
+    top = stack_base;
+  else
+    {
+      if (MAX_ALLOCA / word_size <= XFASTINT (maxdepth))
+	memory_full (SIZE_MAX);
+      stack_size = XFASTINT (maxdepth);
+      top = stack_base = alloca ((stack_size + 1) * sizeof *top);
 #if BYTE_MAINTAIN_TOP
-  stack.bottom = top + 1;
-  stack.top = NULL;
+      stack.bottom = top + 1;
+      stack.top = NULL;
 #endif
-  stack.next = byte_stack_list;
-  byte_stack_list = &stack;
+      stack.next = byte_stack_list;
+      byte_stack_list = &stack;
+    }
 
 #ifdef BYTE_CODE_SAFE
   stacke = stack.bottom - 1 + XFASTINT (maxdepth);
@@ -617,6 +1174,51 @@ exec_byte_code (Lisp_Object bytestr, Lisp_Object vector, Lisp_Object maxdepth,
       error ("Unknown args template!");
     }
 
+  if (!NILP (coroutine))
+    {
+      struct Lisp_Coroutine *co = XCOROUTINE (coroutine);
+
+      /* A tail call would replace the frame of coroutine-resume.  */
+      args_template = Qnil;
+
+      if (!NILP (co->code))
+	{
+	  /* Go on from where Byield suspended the coroutine.  */
+	  Lisp_Object tail;
+	  ptrdiff_t i;
+
+	  eassert (ASIZE (co->stack) <= stack_size);
+	  for (i = 0; i < ASIZE (co->stack); i++)
+	    PUSH (AREF (co->stack, i));
+	  stack.byte_string = co->code;
+	  stack.byte_string_start = SDATA (stack.byte_string);
+	  stack.pc = stack.byte_string_start + co->pc;
+
+	  resume_specpdl (co->bindings);
+	  for (tail = co->handlers; CONSP (tail); tail = XCDR (tail))
+	    {
+	      Lisp_Object h = XCAR (tail);
+	      struct handler *c;
+
+	      PUSH_HANDLER (c, AREF (h, SAVED_HANDLER_TAG),
+			    XFASTINT (AREF (h, SAVED_HANDLER_TYPE)));
+	      c->bytecode_dest = XFASTINT (AREF (h, SAVED_HANDLER_DEST));
+	      c->bytecode_top
+		= stack_base + XFASTINT (AREF (h, SAVED_HANDLER_TOP));
+	      c->pdlcount = count + XFASTINT (AREF (h, SAVED_HANDLER_PDLCOUNT));
+	      c->frame_jmp = &catch_jmp;
+	    }
+	  if (CONSP (co->handlers))
+	    {
+	      co->handlers = Qnil;
+	      catch_jmp_set = true;
+	      if (sys_setjmp (catch_jmp))
+		goto caught;
+	    }
+	  co->bindings = Qnil;
+	}
+    }
+
   while (1)
     {
 #ifdef BYTE_CODE_SAFE
@@ -626,12 +1228,14 @@ exec_byte_code (Lisp_Object bytestr, Lisp_Object vector, Lisp_Object maxdepth,
 	emacs_abort ();
 #endif
 
+#ifndef BYTE_CODE_THREADED
+      if (profiler_byte_code_running)
+	profile_insn (&stack, stack.pc - stack.byte_string_start);
 #ifdef BYTE_CODE_METER
       prev_op = this_op;
       this_op = op = FETCH;
       METER_CODE (prev_op, op);
 #else
-#ifndef BYTE_CODE_THREADED
       op = FETCH;
 #endif
 #endif
@@ -649,7 +1253,7 @@ exec_byte_code (Lisp_Object bytestr, Lisp_Object vector, Lisp_Object maxdepth,
       /* NEXT is invoked at the end of an instruction to go to the
 	 next instruction.  It is either a computed goto, or a
 	 plain break.  */
-#define NEXT goto *(targets[op = FETCH])
+#define NEXT goto *(dispatch[op = FETCH])
       /* FIRST is like NEXT, but is only used at the start of the
 	 interpreter body.  In the switch-based interpreter it is the
 	 switch, so the threaded definition must include a semicolon.  */
@@ -669,37 +1273,6 @@ exec_byte_code (Lisp_Object bytestr, Lisp_Object vector, Lisp_Object maxdepth,
 #define FIRST switch (op)
 #define CASE_DEFAULT case 255: default:
 #define CASE_ABORT case 0
-#endif
-
-#ifdef BYTE_CODE_THREADED
-
-      /* A convenience define that saves us a lot of typing and makes
-	 the table clearer.  */
-#define LABEL(OP) [OP] = &&insn_ ## OP
-
-#if 4 < __GNUC__ + (6 <= __GNUC_MINOR__)
-# pragma GCC diagnostic push
-# pragma GCC diagnostic ignored "-Woverride-init"
-#elif defined __clang__
-# pragma GCC diagnostic push
-# pragma GCC diagnostic ignored "-Winitializer-overrides"
-#endif
-
-      /* This is the dispatch table for the threaded interpreter.  */
-      static const void *const targets[256] =
-	{
-	  [0 ... (Bconstant - 1)] = &&insn_default,
-	  [Bconstant ... 255] = &&insn_Bconstant,
-
-#define DEFINE(name, value) LABEL (name) ,
-	  BYTE_CODES
-#undef DEFINE
-	};
-
-#if 4 < __GNUC__ + (6 <= __GNUC_MINOR__) || defined __clang__
-# pragma GCC diagnostic pop
-#endif
-
 #endif
 
 
@@ -917,7 +1490,33 @@ exec_byte_code (Lisp_Object bytestr, Lisp_Object vector, Lisp_Object maxdepth,
 		  }
 	      }
 #endif
-	    TOP = Ffuncall (op + 1, &TOP);
+	    if (profiler_byte_code_running)
+	      profile_call (&stack, TOP);
+	    if (PEEK_OPCODE == Breturn)
+	      {
+		Lisp_Object definition
+		  = tail_call_definition (TOP, count, args_template,
+					  stack_size);
+		if (!NILP (definition))
+		  {
+		    if (!tail_call_args)
+		      tail_call_args = alloca (stack_size * sizeof *top);
+		    memcpy (tail_call_args, top + 1, op * sizeof *top);
+		    if (backtrace_replace_call (count, TOP, tail_call_args, op))
+		      {
+			MAYBE_GC ();
+			BYTE_CODE_QUIT;
+			bytestr = AREF (definition, COMPILED_BYTECODE);
+			vector = AREF (definition, COMPILED_CONSTANTS);
+			maxdepth = AREF (definition, COMPILED_STACK_DEPTH);
+			args_template = AREF (definition, COMPILED_ARGLIST);
+			nargs = op;
+			args = tail_call_args;
+			goto start;
+		      }
+		  }
+	      }
+	    TOP = funcall_cached (op + 1, &TOP);
 	    AFTER_POTENTIAL_GC ();
 	    NEXT;
 	  }
@@ -1120,19 +1719,32 @@ exec_byte_code (Lisp_Object bytestr, Lisp_Object vector, Lisp_Object maxdepth,
 	    PUSH_HANDLER (c, tag, type);
 	    c->bytecode_dest = dest;
 	    c->bytecode_top = top;
+	    c->frame_jmp = &catch_jmp;
 
-	    if (sys_setjmp (c->jmp))
+	    /* Only the first handler of the frame pays for a setjmp.
+	       The others record, like it, where to resume, and
+	       unwind_to_catch leaves the one it caught with in
+	       handlerlist.  */
+	    if (!catch_jmp_set)
 	      {
-		struct handler *c = handlerlist;
-		int dest;
-		top = c->bytecode_top;
-		dest = c->bytecode_dest;
-		handlerlist = c->next;
-		PUSH (c->val);
-		CHECK_RANGE (dest);
-		/* Might have been re-set by longjmp!  */
-		stack.byte_string_start = SDATA (stack.byte_string);
-		stack.pc = stack.byte_string_start + dest;
+		catch_jmp_set = true;
+		if (sys_setjmp (catch_jmp))
+		  {
+		    struct handler *c;
+		    int dest;
+		    /* The handlers of a resumed coroutine catch here too.  */
+		  caught:
+		    c = handlerlist;
+		    fresh_float = Qnil;
+		    top = c->bytecode_top;
+		    dest = c->bytecode_dest;
+		    handlerlist = c->next;
+		    PUSH (c->val);
+		    CHECK_RANGE (dest);
+		    /* Might have been re-set by longjmp!  */
+		    stack.byte_string_start = SDATA (stack.byte_string);
+		    stack.pc = stack.byte_string_start + dest;
+		  }
 	      }
 
 	    NEXT;
@@ -1144,6 +1756,15 @@ exec_byte_code (Lisp_Object bytestr, Lisp_Object vector, Lisp_Object maxdepth,
 	    NEXT;
 	  }
 
+	CASE (Byield):
+	  BEFORE_POTENTIAL_GC ();
+	  if (NILP (coroutine))
+	    error ("`coroutine-yield' used outside a coroutine");
+	  result = POP;
+	  suspend_coroutine (coroutine, &stack, stack_base, top, count,
+			     base_handler);
+	  goto exit;
+
 	CASE (Bunwind_protect):	/* FIXME: avoid closure for lexbind.  */
 	  {
 	    Lisp_Object handler = POP;
@@ -1376,6 +1997,11 @@ exec_byte_code (Lisp_Object bytestr, Lisp_Object vector, Lisp_Object maxdepth,
 		XSETINT (v1, XINT (v1) - 1);
 		TOP = v1;
 	      }
+	    else if (FLOATP (v1))
+	      {
+		d1 = XFLOAT_DATA (v1) - 1;
+		goto float_result;
+	      }
 	    else
 	      {
 		BEFORE_POTENTIAL_GC ();
@@ -1394,6 +2020,11 @@ exec_byte_code (Lisp_Object bytestr, Lisp_Object vector, Lisp_Object maxdepth,
 		XSETINT (v1, XINT (v1) + 1);
 		TOP = v1;
 	      }
+	    else if (FLOATP (v1))
+	      {
+		d1 = XFLOAT_DATA (v1) + 1;
+		goto float_result;
+	      }
 	    else
 	      {
 		BEFORE_POTENTIAL_GC ();
@@ -1465,7 +2096,13 @@ exec_byte_code (Lisp_Object bytestr, Lisp_Object vector, Lisp_Object maxdepth,
 	  }
 
 	CASE (Bdiff):
+	  if (float_operands (top[-1], TOP, &d1, &d2))
+	    {
+	      d1 -= d2;
+	      goto float_result2;
+	    }
 	  BEFORE_POTENTIAL_GC ();
+	  fresh_float = Qnil;
 	  DISCARD (1);
 	  TOP = Fminus (2, &TOP);
 	  AFTER_POTENTIAL_GC ();
@@ -1480,6 +2117,11 @@ exec_byte_code (Lisp_Object bytestr, Lisp_Object vector, Lisp_Object maxdepth,
 		XSETINT (v1, - XINT (v1));
 		TOP = v1;
 	      }
+	    else if (FLOATP (v1))
+	      {
+		d1 = - XFLOAT_DATA (v1);
+		goto float_result;
+	      }
 	    else
 	      {
 		BEFORE_POTENTIAL_GC ();
@@ -1490,7 +2132,13 @@ exec_byte_code (Lisp_Object bytestr, Lisp_Object vector, Lisp_Object maxdepth,
 	  }
 
 	CASE (Bplus):
+	  if (float_operands (top[-1], TOP, &d1, &d2))
+	    {
+	      d1 += d2;
+	      goto float_result2;
+	    }
 	  BEFORE_POTENTIAL_GC ();
+	  fresh_float = Qnil;
 	  DISCARD (1);
 	  TOP = Fplus (2, &TOP);
 	  AFTER_POTENTIAL_GC ();
@@ -1511,19 +2159,62 @@ exec_byte_code (Lisp_Object bytestr, Lisp_Object vector, Lisp_Object maxdepth,
 	  NEXT;
 
 	CASE (Bmult):
+	  if (float_operands (top[-1], TOP, &d1, &d2))
+	    {
+	      d1 *= d2;
+	      goto float_result2;
+	    }
 	  BEFORE_POTENTIAL_GC ();
+	  fresh_float = Qnil;
 	  DISCARD (1);
 	  TOP = Ftimes (2, &TOP);
 	  AFTER_POTENTIAL_GC ();
 	  NEXT;
 
 	CASE (Bquo):
+	  if (float_operands (top[-1], TOP, &d1, &d2)
+	      && (IEEE_FLOATING_POINT || d2 != 0))
+	    {
+	      d1 /= d2;
+	      goto float_result2;
+	    }
 	  BEFORE_POTENTIAL_GC ();
+	  fresh_float = Qnil;
 	  DISCARD (1);
 	  TOP = Fquo (2, &TOP);
 	  AFTER_POTENTIAL_GC ();
 	  NEXT;
 
+	  /* An arithmetic instruction on floats comes here with its
+	     result in D1, to replace the two operands on the stack with
+	     it, or just the one operand at FLOAT_RESULT.  The float the
+	     previous instruction made can only be the top operand.  */
+	float_result2:
+	  {
+	    Lisp_Object v1 = POP;
+	    if (EQ (v1, fresh_float)
+		&& stack.pc - 1 - stack.byte_string_start == fresh_float_offset)
+	      XFLOAT (v1)->u.data = d1;
+	    else
+	      v1 = make_float (d1);
+	    TOP = fresh_float = v1;
+	    fresh_float_offset = stack.pc - stack.byte_string_start;
+	    NEXT;
+	  }
+
+	float_result:
+	  {
+	    Lisp_Object v1 = TOP;
+	    if (EQ (v1, fresh_float)
+		&& stack.pc - 1 - stack.byte_string_start == fresh_float_offset)
+	      XFLOAT (v1)->u.data = d1;
+	    else
+	      v1 = make_float (d1);
+	    TOP = fresh_float = v1;
+	    fresh_float_offset = stack.pc - stack.byte_string_start;
+	    NEXT;
+	  }
+
 	CASE (Brem):
 	  {
 	    Lisp_Object v1;
@@ -1997,6 +2688,18 @@ exec_byte_code (Lisp_Object bytestr, Lisp_Object vector, Lisp_Object maxdepth,
 	  DISCARD (op);
 	  NEXT;
 
+#ifdef BYTE_CODE_THREADED
+	  /* Code that is metered or profiled goes through here to each
+	     instruction; see instrumented_targets.  */
+	insn_instrument:
+	  if (profiler_byte_code_running)
+	    profile_insn (&stack, stack.pc - 1 - stack.byte_string_start);
+	  prev_op = this_op;
+	  this_op = op;
+	  METER_CODE (prev_op, op);
+	  goto *targets[op];
+#endif
+
 	CASE_DEFAULT
 	CASE (Bconstant):
 #ifdef BYTE_CODE_SAFE
@@ -2031,10 +2734,171 @@ exec_byte_code (Lisp_Object bytestr, Lisp_Object vector, Lisp_Object maxdepth,
   return result;
 }
 
+DEFUN ("make-coroutine", Fmake_coroutine, Smake_coroutine, 1, MANY, 0,
+       doc: /* Return a coroutine that calls FUNCTION with ARGS.
+FUNCTION must be a lexically bound byte-code function.  The coroutine
+does not start until `coroutine-resume' resumes it.  Where the code of
+FUNCTION calls `coroutine-yield', the coroutine suspends itself until
+it is resumed again.
+usage: (make-coroutine FUNCTION &rest ARGS)  */)
+  (ptrdiff_t nargs, Lisp_Object *args)
+{
+  Lisp_Object function = args[0], coroutine;
+  struct Lisp_Coroutine *co;
+
+  if (! (COMPILEDP (function)
+	 && INTEGERP (AREF (function, COMPILED_ARGLIST))))
+    error ("Coroutines can only run lexically bound byte-code");
+  if (CONSP (AREF (function, COMPILED_BYTECODE)))
+    Ffetch_bytecode (function);
+
+  co = ALLOCATE_PSEUDOVECTOR (struct Lisp_Coroutine, pc, PVEC_COROUTINE);
+  co->function = function;
+  co->stack = Fvector (nargs - 1, args + 1);
+  co->pc = 0;
+  co->state = COROUTINE_SUSPENDED;
+  XSETPSEUDOVECTOR (coroutine, co, PVEC_COROUTINE);
+  return coroutine;
+}
+
+DEFUN ("coroutinep", Fcoroutinep, Scoroutinep, 1, 1, 0,
+       doc: /* Return t if OBJECT is a coroutine.  */)
+  (Lisp_Object object)
+{
+  return COROUTINEP (object) ? Qt : Qnil;
+}
+
+DEFUN ("coroutine-live-p", Fcoroutine_live_p, Scoroutine_live_p, 1, 1, 0,
+       doc: /* Return t if COROUTINE has neither returned nor been closed.  */)
+  (Lisp_Object coroutine)
+{
+  CHECK_TYPE (COROUTINEP (coroutine), Qcoroutinep, coroutine);
+  return XCOROUTINE (coroutine)->state == COROUTINE_DEAD ? Qnil : Qt;
+}
+
+/* Make COROUTINE dead, and let go of its frame.  */
+
+static void
+kill_coroutine (Lisp_Object coroutine)
+{
+  struct Lisp_Coroutine *co = XCOROUTINE (coroutine);
+  co->state = COROUTINE_DEAD;
+  co->stack = co->code = co->handlers = co->bindings = Qnil;
+}
+
+/* Kill COROUTINE if it exited nonlocally.  */
+
+static void
+unwind_coroutine (Lisp_Object coroutine)
+{
+  if (XCOROUTINE (coroutine)->state == COROUTINE_RUNNING)
+    kill_coroutine (coroutine);
+}
+
+DEFUN ("coroutine-resume", Fcoroutine_resume, Scoroutine_resume, 1, 2, 0,
+       doc: /* Run COROUTINE until it suspends itself or returns.
+Return the value it passed to `coroutine-yield', or the value it
+returned.  `coroutine-live-p' tells which.  VALUE becomes the value of
+the call of `coroutine-yield' that COROUTINE goes on from; it is
+ignored when COROUTINE starts.
+
+If COROUTINE is dead, just return nil.  If it exits nonlocally, it
+becomes dead.  */)
+  (Lisp_Object coroutine, Lisp_Object value)
+{
+  ptrdiff_t count = SPECPDL_INDEX ();
+  struct Lisp_Coroutine *co;
+  Lisp_Object function, args_template, val;
+  ptrdiff_t nargs = 0;
+  Lisp_Object *args = NULL;
+
+  CHECK_TYPE (COROUTINEP (coroutine), Qcoroutinep, coroutine);
+  co = XCOROUTINE (coroutine);
+  if (co->state == COROUTINE_DEAD)
+    return Qnil;
+  if (co->state == COROUTINE_RUNNING)
+    error ("Coroutine is already running");
+
+  function = co->function;
+  if (NILP (co->code))
+    {
+      args_template = AREF (function, COMPILED_ARGLIST);
+      nargs = ASIZE (co->stack);
+      args = XVECTOR (co->stack)->contents;
+    }
+  else
+    {
+      args_template = Qnil;
+      ASET (co->stack, ASIZE (co->stack) - 1, value);
+    }
+
+  co->state = COROUTINE_RUNNING;
+  record_unwind_protect (unwind_coroutine, coroutine);
+  val = exec_byte_code (AREF (function, COMPILED_BYTECODE),
+			AREF (function, COMPILED_CONSTANTS),
+			AREF (function, COMPILED_STACK_DEPTH),
+			args_template, nargs, args, coroutine);
+  if (co->state == COROUTINE_RUNNING)
+    kill_coroutine (coroutine);
+  return unbind_to (count, val);
+}
+
+DEFUN ("coroutine-close", Fcoroutine_close, Scoroutine_close, 1, 1, 0,
+       doc: /* Make COROUTINE dead, running the unwind forms it has pending.
+These are the unwind forms of the `unwind-protect' forms within which
+COROUTINE suspended itself.  Return nil.  */)
+  (Lisp_Object coroutine)
+{
+  ptrdiff_t count = SPECPDL_INDEX ();
+  Lisp_Object specpdl_entries;
+
+  CHECK_TYPE (COROUTINEP (coroutine), Qcoroutinep, coroutine);
+  if (XCOROUTINE (coroutine)->state == COROUTINE_RUNNING)
+    error ("Coroutine is running");
+
+  specpdl_entries = XCOROUTINE (coroutine)->bindings;
+  kill_coroutine (coroutine);
+  resume_specpdl (specpdl_entries);
+  return unbind_to (count, Qnil);
+}
+
+DEFUN ("coroutine-yield", Fcoroutine_yield, Scoroutine_yield, 1, 1, 0,
+       doc: /* Suspend the coroutine running this code, passing it VALUE.
+VALUE becomes the value of the `coroutine-resume' that ran the
+coroutine.  When the coroutine is resumed, return the value passed to
+`coroutine-resume' then.
+
+The byte compiler turns calls of this function into instructions, and
+only such instructions in the function that a coroutine runs can
+suspend it.  Calling the function itself signals an error.  */)
+  (Lisp_Object value)
+{
+  error ("`coroutine-yield' used outside a coroutine");
+}
+
 void
 syms_of_bytecode (void)
 {
+  DEFSYM (Qcoroutinep, "coroutinep");
+
   defsubr (&Sbyte_code);
+  defsubr (&Smake_coroutine);
+  defsubr (&Scoroutinep);
+  defsubr (&Scoroutine_live_p);
+  defsubr (&Scoroutine_resume);
+  defsubr (&Scoroutine_close);
+  defsubr (&Scoroutine_yield);
+  defsubr (&Sprofiler_byte_code_start);
+  defsubr (&Sprofiler_byte_code_stop);
+  defsubr (&Sprofiler_byte_code_running_p);
+  defsubr (&Sprofiler_byte_code_log);
+
+  byte_code_log = Qnil;
+  staticpro (&byte_code_log);
+  call_cache = Fmake_vector (make_number (CALL_CACHE_ENTRY_SIZE
+					  * CALL_CACHE_SIZE),
+			     Qnil);
+  staticpro (&call_cache);
 
 #ifdef BYTE_CODE_METER
 
@@ -77,7 +77,8 @@ Lisp_Object Qinteger, Qsymbol;
 static Lisp_Object Qcons, Qfloat, Qmisc, Qstring, Qvector;
 Lisp_Object Qwindow;
 static Lisp_Object Qoverlay, Qwindow_configuration;
-static Lisp_Object Qprocess, Qmarker;
+static Lisp_Object Qprocess, Qmarker, Qcoroutine;
+static Lisp_Object Qthread, Qmutex, Qcondition_variable;
 static Lisp_Object Qcompiled_function, Qframe;
 Lisp_Object Qbuffer;
 static Lisp_Object Qchar_table, Qbool_vector, Qhash_table;
@@ -89,6 +90,11 @@ static Lisp_Object Qdefun;
 Lisp_Object Qinteractive_form;
 static Lisp_Object Qdefalias_fset_function;
 
+/* A count of the changes to the function cells of symbols, which
+   wraps around to 0 after MOST_POSITIVE_FIXNUM.  Caches of function
+   definitions are valid as long as it stays the same.  */
+EMACS_INT function_epoch;
+
 static void swap_in_symval_forwarding (struct Lisp_Symbol *, struct Lisp_Buffer_Local_Value *);
 
 static bool
@@ -287,6 +293,14 @@ for example, (type-of 1) returns `integer'.  */)
 	return Qsubr;
       if (COMPILEDP (object))
 	return Qcompiled_function;
+      if (COROUTINEP (object))
+	return Qcoroutine;
+      if (THREADP (object))
+	return Qthread;
+      if (MUTEXP (object))
+	return Qmutex;
+      if (CONDVARP (object))
+	return Qcondition_variable;
       if (BUFFERP (object))
 	return Qbuffer;
       if (CHAR_TABLE_P (object))
@@ -1179,7 +1193,7 @@ swap_in_symval_forwarding (struct Lisp_Symbol *symbol, struct Lisp_Buffer_Local_
 	  }
 	else
 	  {
-	    tem1 = assq_no_quit (var, BVAR (current_buffer, local_var_alist));
+	    tem1 = buffer_local_binding (current_buffer, var);
 	    set_blv_where (blv, Fcurrent_buffer ());
 	  }
       }
@@ -1314,10 +1328,9 @@ set_internal (Lisp_Object symbol, Lisp_Object newval, Lisp_Object where,
 
 	    /* Find the new binding.  */
 	    XSETSYMBOL (symbol, sym); /* May have changed via aliasing.  */
-	    tem1 = assq_no_quit (symbol,
-				 (blv->frame_local
-				  ? XFRAME (where)->param_alist
-				  : BVAR (XBUFFER (where), local_var_alist)));
+	    tem1 = (blv->frame_local
+		    ? assq_no_quit (symbol, XFRAME (where)->param_alist)
+		    : buffer_local_binding (XBUFFER (where), symbol));
 	    set_blv_where (blv, where);
 	    blv->found = 1;
 
@@ -1348,9 +1361,7 @@ set_internal (Lisp_Object symbol, Lisp_Object newval, Lisp_Object where,
 		       bindings, not for frame-local bindings.  */
 		    eassert (!blv->frame_local);
 		    tem1 = Fcons (symbol, XCDR (blv->defcell));
-		    bset_local_var_alist
-		      (XBUFFER (where),
-		       Fcons (tem1, BVAR (XBUFFER (where), local_var_alist)));
+		    add_buffer_local_binding (XBUFFER (where), tem1);
 		  }
 	      }
 
@@ -1591,6 +1602,9 @@ union Lisp_Val_Fwd
     union Lisp_Fwd *fwd;
   };
 
+/* The `index' to give the next variable made buffer-local.  */
+static EMACS_UINT next_blv_index;
+
 static struct Lisp_Buffer_Local_Value *
 make_blv (struct Lisp_Symbol *sym, bool forwarded,
 	  union Lisp_Val_Fwd valcontents)
@@ -1609,6 +1623,7 @@ make_blv (struct Lisp_Symbol *sym, bool forwarded,
   eassert (!(forwarded && BUFFER_OBJFWDP (valcontents.fwd)));
   eassert (!(forwarded && KBOARD_OBJFWDP (valcontents.fwd)));
   blv->fwd = forwarded ? valcontents.fwd : NULL;
+  blv->index = next_blv_index++;
   set_blv_where (blv, Qnil);
   blv->frame_local = 0;
   blv->local_if_set = 0;
@@ -1775,7 +1790,7 @@ Instead, use `add-hook' and specify t for the LOCAL argument.  */)
 
   /* Make sure this buffer has its own value of symbol.  */
   XSETSYMBOL (variable, sym);	/* Update in case of aliasing.  */
-  tem = Fassq (variable, BVAR (current_buffer, local_var_alist));
+  tem = buffer_local_binding (current_buffer, variable);
   if (NILP (tem))
     {
       if (let_shadows_buffer_binding_p (sym))
@@ -1787,10 +1802,8 @@ Instead, use `add-hook' and specify t for the LOCAL argument.  */)
 	 default value.  */
       find_symbol_value (variable);
 
-      bset_local_var_alist
-	(current_buffer,
-	 Fcons (Fcons (variable, XCDR (blv->defcell)),
-		BVAR (current_buffer, local_var_alist)));
+      add_buffer_local_binding (current_buffer,
+				Fcons (variable, XCDR (blv->defcell)));
 
       /* Make sure symbol does not think it is set up for this buffer;
 	 force it to look once again for this buffer's value.  */
@@ -1854,7 +1867,7 @@ From now on the default value will apply in this buffer.  Return VARIABLE.  */)
 
   /* Get rid of this buffer's alist element, if any.  */
   XSETSYMBOL (variable, sym);	/* Propagate variable indirection.  */
-  tem = Fassq (variable, BVAR (current_buffer, local_var_alist));
+  tem = buffer_local_binding (current_buffer, variable);
   if (!NILP (tem))
     bset_local_var_alist
       (current_buffer,
@@ -1970,24 +1983,17 @@ BUFFER defaults to the current buffer.  */)
     case SYMBOL_PLAINVAL: return Qnil;
     case SYMBOL_LOCALIZED:
       {
-	Lisp_Object tail, elt, tmp;
+	Lisp_Object tmp;
 	struct Lisp_Buffer_Local_Value *blv = SYMBOL_BLV (sym);
 	XSETBUFFER (tmp, buf);
 	XSETSYMBOL (variable, sym); /* Update in case of aliasing.  */
 
 	if (EQ (blv->where, tmp)) /* The binding is already loaded.  */
 	  return blv_found (blv) ? Qt : Qnil;
+	else if (blv->frame_local)
+	  return Qnil;
 	else
-	  for (tail = BVAR (buf, local_var_alist); CONSP (tail); tail = XCDR (tail))
-	    {
-	      elt = XCAR (tail);
-	      if (EQ (variable, XCAR (elt)))
-		{
-		  eassert (!blv->frame_local);
-		  return Qt;
-		}
-	    }
-	return Qnil;
+	  return NILP (buffer_local_binding (buf, variable)) ? Qnil : Qt;
       }
     case SYMBOL_FORWARDED:
       {
@@ -2277,6 +2283,7 @@ bool-vector.  IDX starts at 0.  */)
 	args_out_of_range (array, idx);
       CHECK_CHARACTER (newelt);
       c = XFASTINT (newelt);
+      unshare_string_data (array);
 
       if (STRING_MULTIBYTE (array))
 	{
@@ -3050,7 +3057,7 @@ shift_right_ull (bits_word w)
 
 /* Return the number of 1 bits in W.  */
 
-static int
+int
 count_one_bits_word (bits_word w)
 {
   if (BITS_WORD_MAX <= UINT_MAX)
@@ -3597,6 +3604,10 @@ syms_of_data (void)
   DEFSYM (Qfloat, "float");
   DEFSYM (Qwindow_configuration, "window-configuration");
   DEFSYM (Qprocess, "process");
+  DEFSYM (Qcoroutine, "coroutine");
+  DEFSYM (Qthread, "thread");
+  DEFSYM (Qmutex, "mutex");
+  DEFSYM (Qcondition_variable, "condition-variable");
   DEFSYM (Qwindow, "window");
   DEFSYM (Qcompiled_function, "compiled-function");
   DEFSYM (Qbuffer, "buffer");
@@ -1147,12 +1147,16 @@ Using an Emacs configured with --with-x-toolkit=lucid does not have this problem
 
   noninteractive1 = noninteractive;
 
+  /* Make this the main thread, holding the global lock.  */
+  init_threads ();
+
   /* Perform basic initializations (not merely interning symbols).  */
 
   if (!initialized)
     {
       init_alloc_once ();
       init_obarray ();
+      init_threads_once ();
       init_eval_once ();
       init_charset_once ();
       init_coding_once ();
@@ -1517,6 +1521,7 @@ Using an Emacs configured with --with-x-toolkit=lucid does not have this problem
 #endif /* WINDOWSNT */
 
       syms_of_profiler ();
+      syms_of_threads ();
 
       keys_of_casefiddle ();
       keys_of_cmds ();
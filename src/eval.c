@@ -24,14 +24,12 @@ along with GNU Emacs.  If not, see <http://www.gnu.org/licenses/>.  */
 #include <stdio.h>
 #include "lisp.h"
 #include "blockinput.h"
+#include "character.h"
+#include "buffer.h"
 #include "commands.h"
 #include "keyboard.h"
 #include "dispextern.h"
 
-/* Chain of condition and catch handlers currently in effect.  */
-
-struct handler *handlerlist;
-
 #ifdef DEBUG_GCPRO
 /* Count levels of GCPRO to detect failure to UNGCPRO.  */
 int gcpro_level;
@@ -47,6 +45,13 @@ Lisp_Object Qinternal_interpreter_environment, Qclosure;
 
 static Lisp_Object Qdebug;
 
+/* A hash table, weak in its keys, of interpreted functions that have
+   been called while `interpreted-function-compile-threshold' was set.
+   Its values are how often they were called, t if they are to be
+   compiled or cannot be, or the byte-code functions that run in their
+   place.  */
+static Lisp_Object interpreted_functions;
+
 /* This holds either the symbol `run-hooks' or nil.
    It is nil at an early stage of startup, and when Emacs
    is shutting down.  */
@@ -60,24 +65,6 @@ Lisp_Object Vrun_hooks;
 
 Lisp_Object Vautoload_queue;
 
-/* Current number of specbindings allocated in specpdl, not counting
-   the dummy entry specpdl[-1].  */
-
-ptrdiff_t specpdl_size;
-
-/* Pointer to beginning of specpdl.  A dummy entry specpdl[-1] exists
-   only so that its address can be taken.  */
-
-union specbinding *specpdl;
-
-/* Pointer to first unused element in specpdl.  */
-
-union specbinding *specpdl_ptr;
-
-/* Depth in Lisp evaluations and function calls.  */
-
-EMACS_INT lisp_eval_depth;
-
 /* The value of num_nonmacro_input_events as of the last time we
    started to enter the debugger.  If we decide to enter the debugger
    again when this is still equal to num_nonmacro_input_events, then we
@@ -104,6 +91,7 @@ union specbinding *backtrace_next (union specbinding *) EXTERNALLY_VISIBLE;
 union specbinding *backtrace_top (void) EXTERNALLY_VISIBLE;
 
 static Lisp_Object funcall_lambda (Lisp_Object, ptrdiff_t, Lisp_Object *);
+static Lisp_Object count_interpreted_call (Lisp_Object);
 static Lisp_Object apply_lambda (Lisp_Object, Lisp_Object, ptrdiff_t);
 
 static Lisp_Object
@@ -127,6 +115,13 @@ set_specpdl_old_value (union specbinding *pdl, Lisp_Object val)
   pdl->let.old_value = val;
 }
 
+static Lisp_Object
+specpdl_saved_value (union specbinding *pdl)
+{
+  eassert (pdl->kind >= SPECPDL_LET);
+  return pdl->let.saved_value;
+}
+
 static Lisp_Object
 specpdl_where (union specbinding *pdl)
 {
@@ -186,6 +181,28 @@ set_backtrace_debug_on_exit (union specbinding *pdl, bool doe)
   pdl->bt.debug_on_exit = doe;
 }
 
+/* If the record of the backtrace at COUNT - 1 is the innermost one, and
+   does not ask for the debugger on exit, make it record a call of
+   FUNCTION with the NARGS arguments ARGS and return true.  Otherwise
+   return false.  This is for functions that call another one in their
+   stead, as tail calls.  */
+
+bool
+backtrace_replace_call (ptrdiff_t count, Lisp_Object function,
+			Lisp_Object *args, ptrdiff_t nargs)
+{
+  union specbinding *pdl;
+
+  if (count == 0 || specpdl_ptr != specpdl + count)
+    return false;
+  pdl = specpdl + count - 1;
+  if (pdl->kind != SPECPDL_BACKTRACE || backtrace_debug_on_exit (pdl))
+    return false;
+  pdl->bt.function = function;
+  set_backtrace_args (pdl, args, nargs);
+  return true;
+}
+
 /* Helper functions to scan the backtrace.  */
 
 bool
@@ -225,22 +242,29 @@ init_eval_once (void)
   Vrun_hooks = Qnil;
 }
 
-static struct handler handlerlist_sentinel;
+/* Put a dummy catcher at the top level of the current thread, so that
+   handlerlist is never NULL.  This is important since
+   handlerlist->nextfree holds the freelist which would otherwise leak
+   every time we unwind back to top-level.  */
+
+void
+init_handlerlist (void)
+{
+  struct handler *c;
+
+  handlerlist_sentinel = xzalloc (sizeof (struct handler));
+  handlerlist = handlerlist_sentinel->nextfree = handlerlist_sentinel;
+  PUSH_HANDLER (c, Qunbound, CATCHER);
+  eassert (c == handlerlist_sentinel);
+  handlerlist_sentinel->nextfree = NULL;
+  handlerlist_sentinel->next = NULL;
+}
 
 void
 init_eval (void)
 {
   specpdl_ptr = specpdl;
-  { /* Put a dummy catcher at top-level so that handlerlist is never NULL.
-       This is important since handlerlist->nextfree holds the freelist
-       which would otherwise leak every time we unwind back to top-level.   */
-    struct handler *c;
-    handlerlist = handlerlist_sentinel.nextfree = &handlerlist_sentinel;
-    PUSH_HANDLER (c, Qunbound, CATCHER);
-    eassert (c == &handlerlist_sentinel);
-    handlerlist_sentinel.nextfree = NULL;
-    handlerlist_sentinel.next = NULL;
-  }
+  init_handlerlist ();
   Vquit_flag = Qnil;
   debug_on_next_call = 0;
   lisp_eval_depth = 0;
@@ -1165,9 +1189,9 @@ unwind_to_catch (struct handler *catch, Lisp_Object value)
 #ifdef DEBUG_GCPRO
   gcpro_level = gcprolist ? gcprolist->level + 1 : 0;
 #endif
-  lisp_eval_depth = catch->lisp_eval_depth;
+  lisp_eval_depth = catch->f_lisp_eval_depth;
 
-  sys_longjmp (catch->jmp, 1);
+  sys_longjmp (catch->frame_jmp ? *catch->frame_jmp : catch->jmp, 1);
 }
 
 DEFUN ("throw", Fthrow, Sthrow, 2, 2, 0,
@@ -1555,7 +1579,7 @@ See also the function `condition-case'.  */)
     }
   else
     {
-      if (handlerlist != &handlerlist_sentinel)
+      if (handlerlist != handlerlist_sentinel)
 	/* FIXME: This will come right back here if there's no `top-level'
 	   catcher.  A better solution would be to abort here, and instead
 	   add a catch-all condition handler so we never come here.  */
@@ -2641,20 +2665,14 @@ DEFUN ("functionp", Ffunctionp, Sfunctionp, 1, 1, 0,
   return Qnil;
 }
 
-DEFUN ("funcall", Ffuncall, Sfuncall, 1, MANY, 0,
-       doc: /* Call first argument as a function, passing remaining arguments to it.
-Return the value that function returns.
-Thus, (funcall 'cons 'x 'y) returns (x . y).
-usage: (funcall FUNCTION &rest ARGUMENTS)  */)
-  (ptrdiff_t nargs, Lisp_Object *args)
+/* Prepare to call the function ARGS[0] with the NARGS - 1 arguments
+   that follow it, as Ffuncall does.  Return the index of its entry in
+   the backtrace.  */
+
+static ptrdiff_t
+funcall_enter (ptrdiff_t nargs, Lisp_Object *args)
 {
-  Lisp_Object fun, original_fun;
-  Lisp_Object funcar;
-  ptrdiff_t numargs = nargs - 1;
-  Lisp_Object lisp_numargs;
-  Lisp_Object val;
-  register Lisp_Object *internal_args;
-  ptrdiff_t i, count;
+  ptrdiff_t count;
 
   QUIT;
 
@@ -2676,98 +2694,143 @@ usage: (funcall FUNCTION &rest ARGUMENTS)  */)
     do_debug_on_call (Qlambda, count);
 
   check_cons_list ();
+  return count;
+}
 
-  original_fun = args[0];
+/* Finish a call that funcall_enter prepared and that returned VAL.
+   COUNT is what funcall_enter returned.  */
 
- retry:
+static Lisp_Object
+funcall_exit (ptrdiff_t count, Lisp_Object val)
+{
+  check_cons_list ();
+  lisp_eval_depth--;
+  if (backtrace_debug_on_exit (specpdl + count))
+    val = call_debugger (list2 (Qexit, val));
+  specpdl_ptr--;
+  return val;
+}
 
-  /* Optimize for no indirection.  */
-  fun = original_fun;
-  if (SYMBOLP (fun) && !NILP (fun)
-      && (fun = XSYMBOL (fun)->function, SYMBOLP (fun)))
-    fun = indirect_function (fun);
+/* Call the subr FUN, the definition of ORIGINAL_FUN, with the NUMARGS
+   arguments ARGS.  */
 
-  if (SUBRP (fun))
+static Lisp_Object
+funcall_subr (Lisp_Object fun, Lisp_Object original_fun,
+	      ptrdiff_t numargs, Lisp_Object *args)
+{
+  Lisp_Object val;
+  Lisp_Object lisp_numargs;
+  Lisp_Object *internal_args;
+  ptrdiff_t i;
+
+  if (numargs < XSUBR (fun)->min_args
+      || (XSUBR (fun)->max_args >= 0 && XSUBR (fun)->max_args < numargs))
     {
-      if (numargs < XSUBR (fun)->min_args
-	  || (XSUBR (fun)->max_args >= 0 && XSUBR (fun)->max_args < numargs))
-	{
-	  XSETFASTINT (lisp_numargs, numargs);
-	  xsignal2 (Qwrong_number_of_arguments, original_fun, lisp_numargs);
-	}
+      XSETFASTINT (lisp_numargs, numargs);
+      xsignal2 (Qwrong_number_of_arguments, original_fun, lisp_numargs);
+    }
 
-      else if (XSUBR (fun)->max_args == UNEVALLED)
-	xsignal1 (Qinvalid_function, original_fun);
+  else if (XSUBR (fun)->max_args == UNEVALLED)
+    xsignal1 (Qinvalid_function, original_fun);
 
-      else if (XSUBR (fun)->max_args == MANY)
-	val = (XSUBR (fun)->function.aMANY) (numargs, args + 1);
+  else if (XSUBR (fun)->max_args == MANY)
+    val = (XSUBR (fun)->function.aMANY) (numargs, args);
+  else
+    {
+      Lisp_Object internal_argbuf[8];
+      if (XSUBR (fun)->max_args > numargs)
+	{
+	  eassert (XSUBR (fun)->max_args <= ARRAYELTS (internal_argbuf));
+	  internal_args = internal_argbuf;
+	  memcpy (internal_args, args, numargs * word_size);
+	  for (i = numargs; i < XSUBR (fun)->max_args; i++)
+	    internal_args[i] = Qnil;
+	}
       else
+	internal_args = args;
+      switch (XSUBR (fun)->max_args)
 	{
-	  Lisp_Object internal_argbuf[8];
-	  if (XSUBR (fun)->max_args > numargs)
-	    {
-	      eassert (XSUBR (fun)->max_args <= ARRAYELTS (internal_argbuf));
-	      internal_args = internal_argbuf;
-	      memcpy (internal_args, args + 1, numargs * word_size);
-	      for (i = numargs; i < XSUBR (fun)->max_args; i++)
-		internal_args[i] = Qnil;
-	    }
-	  else
-	    internal_args = args + 1;
-	  switch (XSUBR (fun)->max_args)
-	    {
-	    case 0:
-	      val = (XSUBR (fun)->function.a0 ());
-	      break;
-	    case 1:
-	      val = (XSUBR (fun)->function.a1 (internal_args[0]));
-	      break;
-	    case 2:
-	      val = (XSUBR (fun)->function.a2
-		     (internal_args[0], internal_args[1]));
-	      break;
-	    case 3:
-	      val = (XSUBR (fun)->function.a3
-		     (internal_args[0], internal_args[1], internal_args[2]));
-	      break;
-	    case 4:
-	      val = (XSUBR (fun)->function.a4
-		     (internal_args[0], internal_args[1], internal_args[2],
-		     internal_args[3]));
-	      break;
-	    case 5:
-	      val = (XSUBR (fun)->function.a5
-		     (internal_args[0], internal_args[1], internal_args[2],
-		      internal_args[3], internal_args[4]));
-	      break;
-	    case 6:
-	      val = (XSUBR (fun)->function.a6
-		     (internal_args[0], internal_args[1], internal_args[2],
-		      internal_args[3], internal_args[4], internal_args[5]));
-	      break;
-	    case 7:
-	      val = (XSUBR (fun)->function.a7
-		     (internal_args[0], internal_args[1], internal_args[2],
-		      internal_args[3], internal_args[4], internal_args[5],
-		      internal_args[6]));
-	      break;
+	case 0:
+	  val = (XSUBR (fun)->function.a0 ());
+	  break;
+	case 1:
+	  val = (XSUBR (fun)->function.a1 (internal_args[0]));
+	  break;
+	case 2:
+	  val = (XSUBR (fun)->function.a2
+		 (internal_args[0], internal_args[1]));
+	  break;
+	case 3:
+	  val = (XSUBR (fun)->function.a3
+		 (internal_args[0], internal_args[1], internal_args[2]));
+	  break;
+	case 4:
+	  val = (XSUBR (fun)->function.a4
+		 (internal_args[0], internal_args[1], internal_args[2],
+		 internal_args[3]));
+	  break;
+	case 5:
+	  val = (XSUBR (fun)->function.a5
+		 (internal_args[0], internal_args[1], internal_args[2],
+		  internal_args[3], internal_args[4]));
+	  break;
+	case 6:
+	  val = (XSUBR (fun)->function.a6
+		 (internal_args[0], internal_args[1], internal_args[2],
+		  internal_args[3], internal_args[4], internal_args[5]));
+	  break;
+	case 7:
+	  val = (XSUBR (fun)->function.a7
+		 (internal_args[0], internal_args[1], internal_args[2],
+		  internal_args[3], internal_args[4], internal_args[5],
+		  internal_args[6]));
+	  break;
 
-	    case 8:
-	      val = (XSUBR (fun)->function.a8
-		     (internal_args[0], internal_args[1], internal_args[2],
-		      internal_args[3], internal_args[4], internal_args[5],
-		      internal_args[6], internal_args[7]));
-	      break;
+	case 8:
+	  val = (XSUBR (fun)->function.a8
+		 (internal_args[0], internal_args[1], internal_args[2],
+		  internal_args[3], internal_args[4], internal_args[5],
+		  internal_args[6], internal_args[7]));
+	  break;
 
-	    default:
+	default:
 
-	      /* If a subr takes more than 8 arguments without using MANY
-		 or UNEVALLED, we need to extend this function to support it.
-		 Until this is done, there is no way to call the function.  */
-	      emacs_abort ();
-	    }
+	  /* If a subr takes more than 8 arguments without using MANY
+	     or UNEVALLED, we need to extend this function to support it.
+	     Until this is done, there is no way to call the function.  */
+	  emacs_abort ();
 	}
     }
+  return val;
+}
+
+DEFUN ("funcall", Ffuncall, Sfuncall, 1, MANY, 0,
+       doc: /* Call first argument as a function, passing remaining arguments to it.
+Return the value that function returns.
+Thus, (funcall 'cons 'x 'y) returns (x . y).
+usage: (funcall FUNCTION &rest ARGUMENTS)  */)
+  (ptrdiff_t nargs, Lisp_Object *args)
+{
+  Lisp_Object fun, original_fun;
+  Lisp_Object funcar;
+  ptrdiff_t numargs = nargs - 1;
+  Lisp_Object val;
+  ptrdiff_t count;
+
+  count = funcall_enter (nargs, args);
+
+  original_fun = args[0];
+
+ retry:
+
+  /* Optimize for no indirection.  */
+  fun = original_fun;
+  if (SYMBOLP (fun) && !NILP (fun)
+      && (fun = XSYMBOL (fun)->function, SYMBOLP (fun)))
+    fun = indirect_function (fun);
+
+  if (SUBRP (fun))
+    val = funcall_subr (fun, original_fun, numargs, args + 1);
   else if (COMPILEDP (fun))
     val = funcall_lambda (fun, numargs, args + 1);
   else
@@ -2791,14 +2854,148 @@ usage: (funcall FUNCTION &rest ARGUMENTS)  */)
       else
 	xsignal1 (Qinvalid_function, original_fun);
     }
-  check_cons_list ();
-  lisp_eval_depth--;
-  if (backtrace_debug_on_exit (specpdl + count))
-    val = call_debugger (list2 (Qexit, val));
-  specpdl_ptr--;
-  return val;
+  return funcall_exit (count, val);
 }
 
+
+/* Call the function ARGS[0], whose definition is FUN, with the NARGS - 1
+   arguments that follow it.  This is like Ffuncall, for callers that
+   have looked up the definition already.  FUN must be a subr that
+   evaluates its arguments, or a byte-code function.  */
+
+Lisp_Object
+funcall_definition (Lisp_Object fun, ptrdiff_t nargs, Lisp_Object *args)
+{
+  ptrdiff_t count = funcall_enter (nargs, args);
+  Lisp_Object val;
+
+  if (SUBRP (fun))
+    val = funcall_subr (fun, args[0], nargs - 1, args + 1);
+  else
+    val = funcall_lambda (fun, nargs - 1, args + 1);
+  return funcall_exit (count, val);
+}
+
+/* Like funcall_definition, for a subr FUN that takes exactly the
+   NARGS - 1 arguments passed, or any number of them.  The caller
+   checks this once for many calls, so it is not checked here.  */
+
+Lisp_Object
+funcall_subr_exact (Lisp_Object fun, ptrdiff_t nargs, Lisp_Object *args)
+{
+  ptrdiff_t count = funcall_enter (nargs, args);
+  Lisp_Object val;
+
+  switch (XSUBR (fun)->max_args)
+    {
+    case MANY:
+      val = (XSUBR (fun)->function.aMANY) (nargs - 1, args + 1);
+      break;
+    case 0:
+      val = (XSUBR (fun)->function.a0 ());
+      break;
+    case 1:
+      val = (XSUBR (fun)->function.a1 (args[1]));
+      break;
+    case 2:
+      val = (XSUBR (fun)->function.a2 (args[1], args[2]));
+      break;
+    case 3:
+      val = (XSUBR (fun)->function.a3 (args[1], args[2], args[3]));
+      break;
+    case 4:
+      val = (XSUBR (fun)->function.a4 (args[1], args[2], args[3], args[4]));
+      break;
+    default:
+      /* The caller sends calls with more arguments to
+	 funcall_definition.  */
+      emacs_abort ();
+    }
+  return funcall_exit (count, val);
+}
+
+/* Return true if the interpreted function FUN can be byte-compiled
+   without changing what it does.  The lexical variables of closures
+   may be shared with other closures that set them, so only closures
+   that have none qualify.  */
+
+static bool
+compilable_function_p (Lisp_Object fun)
+{
+  Lisp_Object env;
+
+  if (EQ (XCAR (fun), Qlambda))
+    return CONSP (XCDR (fun));
+  if (! (EQ (XCAR (fun), Qclosure) && CONSP (XCDR (fun))
+	 && CONSP (XCDR (XCDR (fun)))))
+    return false;
+  for (env = XCAR (XCDR (fun)); CONSP (env); env = XCDR (env))
+    if (!SYMBOLP (XCAR (env)))
+      return false;
+  return NILP (env);
+}
+
+/* Count a call of the interpreted function FUN.  Return the byte-code
+   function that runs in its place if there is one.  Once FUN has been
+   called `interpreted-function-compile-threshold' times, queue it to
+   be compiled when Emacs is idle.  */
+
+static Lisp_Object
+count_interpreted_call (Lisp_Object fun)
+{
+  struct Lisp_Hash_Table *h = XHASH_TABLE (interpreted_functions);
+  EMACS_UINT hash;
+  ptrdiff_t i = hash_lookup (h, fun, &hash);
+  EMACS_INT calls;
+
+  if (i < 0)
+    {
+      hash_put (h, fun, make_number (1), hash);
+      return Qnil;
+    }
+  if (!INTEGERP (HASH_VALUE (h, i)))
+    return HASH_VALUE (h, i);
+
+  calls = XINT (HASH_VALUE (h, i)) + 1;
+  if (calls < XINT (Vinterpreted_function_compile_threshold))
+    set_hash_value_slot (h, i, make_number (calls));
+  else if (!compilable_function_p (fun))
+    set_hash_value_slot (h, i, Qt);
+  else
+    {
+      set_hash_value_slot (h, i, Qt);
+      Vinterpreted_functions_to_compile
+	= Fcons (fun, Vinterpreted_functions_to_compile);
+    }
+  return Qnil;
+}
+
+DEFUN ("internal--compiled-definition", Finternal__compiled_definition,
+       Sinternal__compiled_definition, 1, 1, 0,
+       doc: /* Return the byte-code function that runs in place of FUNCTION.
+FUNCTION is an interpreted function.  Return nil if it has not been
+compiled.  */)
+  (Lisp_Object function)
+{
+  Lisp_Object compiled = Fgethash (function, interpreted_functions, Qnil);
+  return COMPILEDP (compiled) ? compiled : Qnil;
+}
+
+DEFUN ("internal--set-compiled-definition", Finternal__set_compiled_definition,
+       Sinternal__set_compiled_definition, 2, 2, 0,
+       doc: /* Make the byte-code function COMPILED run in place of FUNCTION.
+FUNCTION is an interpreted function, and COMPILED must do the same as
+it.  If COMPILED is nil, FUNCTION keeps being interpreted, and is not
+queued for compilation again.  */)
+  (Lisp_Object function, Lisp_Object compiled)
+{
+  CHECK_CONS (function);
+  if (!NILP (compiled) && !COMPILEDP (compiled))
+    wrong_type_argument (intern ("byte-code-function-p"), compiled);
+  Fputhash (function, NILP (compiled) ? Qt : compiled, interpreted_functions);
+  return compiled;
+}
+
 static Lisp_Object
 apply_lambda (Lisp_Object fun, Lisp_Object args, ptrdiff_t count)
 {
@@ -2856,6 +3053,13 @@ funcall_lambda (Lisp_Object fun, ptrdiff_t nargs,
 
   if (CONSP (fun))
     {
+      if (INTEGERP (Vinterpreted_function_compile_threshold))
+	{
+	  Lisp_Object compiled = count_interpreted_call (fun);
+	  if (COMPILEDP (compiled))
+	    return funcall_lambda (compiled, nargs, arg_vector);
+	}
+
       if (EQ (XCAR (fun), Qclosure))
 	{
 	  fun = XCDR (fun);	/* Drop `closure'.  */
@@ -2891,7 +3095,7 @@ funcall_lambda (Lisp_Object fun, ptrdiff_t nargs,
 				 AREF (fun, COMPILED_CONSTANTS),
 				 AREF (fun, COMPILED_STACK_DEPTH),
 				 syms_left,
-				 nargs, arg_vector);
+				 nargs, arg_vector, Qnil);
 	}
       lexenv = Qnil;
     }
@@ -2956,7 +3160,7 @@ funcall_lambda (Lisp_Object fun, ptrdiff_t nargs,
       val = exec_byte_code (AREF (fun, COMPILED_BYTECODE),
 			    AREF (fun, COMPILED_CONSTANTS),
 			    AREF (fun, COMPILED_STACK_DEPTH),
-			    Qnil, 0, 0);
+			    Qnil, 0, 0, Qnil);
     }
 
   return unbind_to (count, val);
@@ -3051,6 +3255,7 @@ specbind (Lisp_Object symbol, Lisp_Object value)
       specpdl_ptr->let.kind = SPECPDL_LET;
       specpdl_ptr->let.symbol = symbol;
       specpdl_ptr->let.old_value = SYMBOL_VAL (sym);
+      specpdl_ptr->let.saved_value = Qnil;
       grow_specpdl ();
       if (!sym->constant)
 	SET_SYMBOL_VAL (sym, value);
@@ -3067,6 +3272,7 @@ specbind (Lisp_Object symbol, Lisp_Object value)
 	specpdl_ptr->let.symbol = symbol;
 	specpdl_ptr->let.old_value = ovalue;
 	specpdl_ptr->let.where = Fcurrent_buffer ();
+	specpdl_ptr->let.saved_value = Qnil;
 
 	eassert (sym->redirect != SYMBOL_LOCALIZED
 		 || (EQ (SYMBOL_BLV (sym)->where, Fcurrent_buffer ())));
@@ -3186,6 +3392,63 @@ set_unwind_protect_ptr (ptrdiff_t count, void (*func) (void *), void *arg)
   p->unwind_ptr.arg = arg;
 }
 
+/* Undo the specpdl entry THIS, which has just been taken off the
+   specpdl.  */
+
+static void
+do_one_unbind (union specbinding *this)
+{
+  switch (this->kind)
+    {
+    case SPECPDL_UNWIND:
+      this->unwind.func (this->unwind.arg);
+      break;
+    case SPECPDL_UNWIND_PTR:
+      this->unwind_ptr.func (this->unwind_ptr.arg);
+      break;
+    case SPECPDL_UNWIND_INT:
+      this->unwind_int.func (this->unwind_int.arg);
+      break;
+    case SPECPDL_UNWIND_VOID:
+      this->unwind_void.func ();
+      break;
+    case SPECPDL_BACKTRACE:
+      break;
+    case SPECPDL_LET:
+      { /* If variable has a trivial value (no forwarding), we can
+	   just set it.  No need to check for constant symbols here,
+	   since that was already done by specbind.  */
+	struct Lisp_Symbol *sym = XSYMBOL (specpdl_symbol (this));
+	if (sym->redirect == SYMBOL_PLAINVAL)
+	  {
+	    SET_SYMBOL_VAL (sym, specpdl_old_value (this));
+	    break;
+	  }
+	else
+	  { /* FALLTHROUGH!!
+	       NOTE: we only ever come here if make_local_foo was used for
+	       the first time on this var within this let.  */
+	  }
+      }
+    case SPECPDL_LET_DEFAULT:
+      Fset_default (specpdl_symbol (this), specpdl_old_value (this));
+      break;
+    case SPECPDL_LET_LOCAL:
+      {
+	Lisp_Object symbol = specpdl_symbol (this);
+	Lisp_Object where = specpdl_where (this);
+	Lisp_Object old_value = specpdl_old_value (this);
+	eassert (BUFFERP (where));
+
+	/* If this was a local binding, reset the value in the appropriate
+	   buffer, but only if that buffer's binding still exists.  */
+	if (!NILP (Flocal_variable_p (symbol, where)))
+	  set_internal (symbol, old_value, where, 1);
+      }
+      break;
+    }
+}
+
 /* Pop and execute entries from the unwind-protect stack until the
    depth COUNT is reached.  Return VALUE.  */
 
@@ -3206,57 +3469,7 @@ unbind_to (ptrdiff_t count, Lisp_Object value)
 	 before invoking any code that can make more bindings.  */
 
       specpdl_ptr--;
-
-      switch (specpdl_ptr->kind)
-	{
-	case SPECPDL_UNWIND:
-	  specpdl_ptr->unwind.func (specpdl_ptr->unwind.arg);
-	  break;
-	case SPECPDL_UNWIND_PTR:
-	  specpdl_ptr->unwind_ptr.func (specpdl_ptr->unwind_ptr.arg);
-	  break;
-	case SPECPDL_UNWIND_INT:
-	  specpdl_ptr->unwind_int.func (specpdl_ptr->unwind_int.arg);
-	  break;
-	case SPECPDL_UNWIND_VOID:
-	  specpdl_ptr->unwind_void.func ();
-	  break;
-	case SPECPDL_BACKTRACE:
-	  break;
-	case SPECPDL_LET:
-	  { /* If variable has a trivial value (no forwarding), we can
-	       just set it.  No need to check for constant symbols here,
-	       since that was already done by specbind.  */
-	    struct Lisp_Symbol *sym = XSYMBOL (specpdl_symbol (specpdl_ptr));
-	    if (sym->redirect == SYMBOL_PLAINVAL)
-	      {
-		SET_SYMBOL_VAL (sym, specpdl_old_value (specpdl_ptr));
-		break;
-	      }
-	    else
-	      { /* FALLTHROUGH!!
-		   NOTE: we only ever come here if make_local_foo was used for
-		   the first time on this var within this let.  */
-	      }
-	  }
-	case SPECPDL_LET_DEFAULT:
-	  Fset_default (specpdl_symbol (specpdl_ptr),
-			specpdl_old_value (specpdl_ptr));
-	  break;
-	case SPECPDL_LET_LOCAL:
-	  {
-	    Lisp_Object symbol = specpdl_symbol (specpdl_ptr);
-	    Lisp_Object where = specpdl_where (specpdl_ptr);
-	    Lisp_Object old_value = specpdl_old_value (specpdl_ptr);
-	    eassert (BUFFERP (where));
-
-	    /* If this was a local binding, reset the value in the appropriate
-	       buffer, but only if that buffer's binding still exists.  */
-	    if (!NILP (Flocal_variable_p (symbol, where)))
-	      set_internal (symbol, old_value, where, 1);
-	  }
-	  break;
-	}
+      do_one_unbind (specpdl_ptr);
     }
 
   if (NILP (Vquit_flag) && !NILP (quitf))
@@ -3266,6 +3479,172 @@ unbind_to (ptrdiff_t count, Lisp_Object value)
   return value;
 }
 
+/* Take the entries above COUNT off the specpdl without running their
+   unwind functions, and return a list of them that resume_specpdl can
+   push back.  The let-bindings among them are undone, and the list
+   records the values they had.  Signal an error, leaving the specpdl
+   alone, if any of the entries is one that refers to the C stack.  */
+
+Lisp_Object
+suspend_specpdl (ptrdiff_t count)
+{
+  union specbinding *pdl;
+  Lisp_Object saved = Qnil;
+
+  for (pdl = specpdl + count; pdl < specpdl_ptr; pdl++)
+    if (pdl->kind != SPECPDL_UNWIND && pdl->kind < SPECPDL_LET)
+      error ("Cannot suspend code with internal unwind forms pending");
+
+  while (specpdl_ptr != specpdl + count)
+    {
+      union specbinding *this = specpdl_ptr - 1;
+      Lisp_Object entry = Qnil;
+
+      if (this->kind == SPECPDL_UNWIND)
+	entry = make_save_funcptr_ptr_obj ((voidfuncptr) this->unwind.func,
+					   NULL, this->unwind.arg);
+      else
+	{
+	  Lisp_Object symbol = specpdl_symbol (this);
+	  Lisp_Object where = Qnil;
+
+	  /* A buffer-local binding that no longer exists is dropped, as
+	     unbind_to would.  */
+	  if (this->kind == SPECPDL_LET_LOCAL)
+	    {
+	      where = specpdl_where (this);
+	      if (!NILP (Flocal_variable_p (symbol, where)))
+		entry = Fcons (symbol,
+			       Fcons (Fbuffer_local_value (symbol, where),
+				      where));
+	    }
+	  else if (this->kind == SPECPDL_LET_DEFAULT)
+	    entry = Fcons (symbol, Fcons (Fdefault_value (symbol), where));
+	  else
+	    entry = Fcons (symbol, Fcons (find_symbol_value (symbol), where));
+	}
+
+      specpdl_ptr--;
+      if (this->kind != SPECPDL_UNWIND)
+	do_one_unbind (this);
+      if (!NILP (entry))
+	saved = Fcons (entry, saved);
+    }
+
+  return saved;
+}
+
+/* Push the entries SAVED that suspend_specpdl returned back onto the
+   specpdl, redoing the let-bindings among them.  A buffer-local
+   binding is made again in the buffer it was made in, if that is still
+   live.  */
+
+void
+resume_specpdl (Lisp_Object saved)
+{
+  for (; CONSP (saved); saved = XCDR (saved))
+    {
+      Lisp_Object entry = XCAR (saved);
+
+      if (SAVE_VALUEP (entry))
+	record_unwind_protect ((void (*) (Lisp_Object))
+			       XSAVE_FUNCPOINTER (entry, 0),
+			       XSAVE_OBJECT (entry, 2));
+      else
+	{
+	  Lisp_Object symbol = XCAR (entry);
+	  Lisp_Object value = XCAR (XCDR (entry));
+	  Lisp_Object where = XCDR (XCDR (entry));
+
+	  if (BUFFERP (where) && BUFFER_LIVE_P (XBUFFER (where))
+	      && XBUFFER (where) != current_buffer)
+	    {
+	      struct buffer *old = current_buffer;
+	      set_buffer_internal (XBUFFER (where));
+	      specbind (symbol, value);
+	      set_buffer_internal (old);
+	    }
+	  else
+	    specbind (symbol, value);
+	}
+    }
+}
+
+/* Undo the let-bindings of THR, the thread that is being switched out,
+   keeping the values they have in THR so that rebind_for_thread_switch
+   can bring them back.  Its other specpdl entries are left alone.  */
+
+void
+unbind_for_thread_switch (struct thread_state *thr)
+{
+  union specbinding *bind;
+
+  for (bind = thr->m_specpdl_ptr; bind > thr->m_specpdl;)
+    if ((--bind)->kind >= SPECPDL_LET)
+      {
+	Lisp_Object symbol = specpdl_symbol (bind);
+	struct Lisp_Symbol *sym = XSYMBOL (symbol);
+
+	if (bind->kind == SPECPDL_LET_LOCAL)
+	  {
+	    /* A buffer-local binding that no longer exists stays
+	       undone, as unbind_to would leave it.  */
+	    Lisp_Object where = specpdl_where (bind);
+	    bind->let.saved_value
+	      = (NILP (Flocal_variable_p (symbol, where)) ? Qunbound
+		 : Fbuffer_local_value (symbol, where));
+	  }
+	else if (bind->kind == SPECPDL_LET && sym->redirect == SYMBOL_PLAINVAL)
+	  bind->let.saved_value = SYMBOL_VAL (sym);
+	else
+	  bind->let.saved_value = Fdefault_value (symbol);
+	do_one_unbind (bind);
+      }
+}
+
+/* Redo the let-bindings of the current thread, which is being switched
+   in, giving their variables the values they had when
+   unbind_for_thread_switch undid them.  What the variables were set to
+   in the meantime becomes the value to restore when the bindings are
+   unbound.  */
+
+void
+rebind_for_thread_switch (void)
+{
+  union specbinding *bind;
+
+  for (bind = specpdl; bind != specpdl_ptr; bind++)
+    if (bind->kind >= SPECPDL_LET)
+      {
+	Lisp_Object symbol = specpdl_symbol (bind);
+	Lisp_Object value = specpdl_saved_value (bind);
+	struct Lisp_Symbol *sym = XSYMBOL (symbol);
+
+	bind->let.saved_value = Qnil;
+	if (bind->kind == SPECPDL_LET_LOCAL)
+	  {
+	    Lisp_Object where = specpdl_where (bind);
+	    if (!EQ (value, Qunbound)
+		&& !NILP (Flocal_variable_p (symbol, where)))
+	      {
+		set_specpdl_old_value (bind,
+				       Fbuffer_local_value (symbol, where));
+		set_internal (symbol, value, where, 1);
+	      }
+	  }
+	else if (bind->kind == SPECPDL_LET && sym->redirect == SYMBOL_PLAINVAL)
+	  {
+	    set_specpdl_old_value (bind, SYMBOL_VAL (sym));
+	    SET_SYMBOL_VAL (sym, value);
+	  }
+	else
+	  {
+	    set_specpdl_old_value (bind, Fdefault_value (symbol));
+	    Fset_default (symbol, value);
+	  }
+      }
+}
+
 DEFUN ("special-variable-p", Fspecial_variable_p, Sspecial_variable_p, 1, 1, 0,
        doc: /* Return non-nil if SYMBOL's global binding has been declared special.
 A special variable is one that will be bound dynamically, even in a
@@ -3562,10 +3941,10 @@ NFRAMES and BASE specify the activation frame to use, as in `backtrace-frame'.
 
 
 void
-mark_specpdl (void)
+mark_specpdl (union specbinding *first, union specbinding *ptr)
 {
   union specbinding *pdl;
-  for (pdl = specpdl; pdl != specpdl_ptr; pdl++)
+  for (pdl = first; pdl != ptr; pdl++)
     {
       switch (pdl->kind)
 	{
@@ -3591,6 +3970,7 @@ mark_specpdl (void)
 	case SPECPDL_LET:
 	  mark_object (specpdl_symbol (pdl));
 	  mark_object (specpdl_old_value (pdl));
+	  mark_object (specpdl_saved_value (pdl));
 	  break;
 	}
     }
@@ -3677,6 +4057,36 @@ before making `inhibit-quit' nil.  */);
   DEFSYM (Qclosure, "closure");
   DEFSYM (Qdebug, "debug");
 
+  DEFVAR_LISP ("interpreted-function-compile-threshold",
+	       Vinterpreted_function_compile_threshold,
+	       doc: /* Number of calls after which interpreted functions are compiled.
+When an interpreted function has been called this many times, it is
+byte-compiled the next time Emacs is idle, and from then on the
+compiled function runs whenever it is called.  The function itself
+does not change.  Closures that refer to lexical variables of their
+surroundings are not compiled.
+
+If nil, interpreted functions are not compiled, and their calls are not
+counted.  */);
+  Vinterpreted_function_compile_threshold = make_number (1000);
+
+  DEFVAR_LISP ("internal--interpreted-functions-to-compile",
+	       Vinterpreted_functions_to_compile,
+	       doc: /* Interpreted functions to compile when Emacs is idle.
+`internal--compile-interpreted-functions' compiles them.
+See `interpreted-function-compile-threshold'.  */);
+  Vinterpreted_functions_to_compile = Qnil;
+
+  {
+    Lisp_Object args[4];
+    args[0] = QCtest;
+    args[1] = Qeq;
+    args[2] = QCweakness;
+    args[3] = intern_c_string ("key");
+    interpreted_functions = Fmake_hash_table (4, args);
+    staticpro (&interpreted_functions);
+  }
+
   DEFVAR_LISP ("inhibit-debugger", Vinhibit_debugger,
 	       doc: /* Non-nil means never enter the debugger.
 Normally set while the debugger is already active, to avoid recursive
@@ -3813,4 +4223,6 @@ alist of active lexical bindings.  */);
   defsubr (&Sbacktrace__locals);
   defsubr (&Sspecial_variable_p);
   defsubr (&Sfunctionp);
+  defsubr (&Sinternal__compiled_definition);
+  defsubr (&Sinternal__set_compiled_definition);
 }
@@ -2426,9 +2426,11 @@ ARRAY is a vector, string, char-table, or bool-vector.  */)
     }
   else if (STRINGP (array))
     {
-      register unsigned char *p = SDATA (array);
+      register unsigned char *p;
       int charval;
       CHECK_CHARACTER (item);
+      unshare_string_data (array);
+      p = SDATA (array);
       charval = XFASTINT (item);
       size = SCHARS (array);
       if (STRING_MULTIBYTE (array))
@@ -2462,6 +2464,7 @@ This makes STRING unibyte and may change its length.  */)
 {
   ptrdiff_t len;
   CHECK_STRING (string);
+  unshare_string_data (string);
   len = SBYTES (string);
   memset (SDATA (string), 0, len);
   STRING_SET_CHARS (string, len);
@@ -3734,8 +3737,7 @@ larger_vector (Lisp_Object vec, ptrdiff_t incr_min, ptrdiff_t nitems_max)
 			 Low-level Functions
  ***********************************************************************/
 
-static struct hash_table_test hashtest_eq;
-struct hash_table_test hashtest_eql, hashtest_equal;
+struct hash_table_test hashtest_eq, hashtest_eql, hashtest_equal;
 
 /* Compare KEY1 which has hash code HASH1 and KEY2 with hash code
    HASH2 in hash table H using `eql'.  Value is true if KEY1 and
@@ -4189,19 +4191,66 @@ hash_clear (struct Lisp_Hash_Table *h)
 			   Weak Hash Tables
  ************************************************************************/
 
-/* Sweep weak hash table H.  REMOVE_ENTRIES_P means remove
-   entries from the table that don't survive the current GC.
-   !REMOVE_ENTRIES_P means mark entries that are in use.  Value is
-   true if anything was marked.  */
+/* Mark the keys and values of the entries of weak hash table H that
+   are known to survive the current GC, and register those that
+   survive only if their key or value turns out to be reachable as
+   ephemerons.  */
 
-static bool
-sweep_weak_table (struct Lisp_Hash_Table *h, bool remove_entries_p)
+static void
+mark_weak_table (struct Lisp_Hash_Table *h)
+{
+  ptrdiff_t i, n;
+
+  if (h->count == 0)
+    return;
+
+  n = ASIZE (h->next) & ~ARRAY_MARK_FLAG;
+  for (i = 0; i < n; i++)
+    if (!NILP (HASH_HASH (h, i)))
+      {
+	Lisp_Object key = HASH_KEY (h, i), value = HASH_VALUE (h, i);
+
+	if (EQ (h->weak, Qkey))
+	  {
+	    if (survives_gc_p (key))
+	      mark_object (value);
+	    else
+	      add_ephemeron (key, key, value);
+	  }
+	else if (EQ (h->weak, Qvalue))
+	  {
+	    if (survives_gc_p (value))
+	      mark_object (key);
+	    else
+	      add_ephemeron (value, key, value);
+	  }
+	else if (EQ (h->weak, Qkey_or_value))
+	  {
+	    if (survives_gc_p (key) || survives_gc_p (value))
+	      {
+		mark_object (key);
+		mark_object (value);
+	      }
+	    else
+	      {
+		add_ephemeron (key, key, value);
+		add_ephemeron (value, key, value);
+	      }
+	  }
+	else if (!EQ (h->weak, Qkey_and_value))
+	  emacs_abort ();
+      }
+}
+
+/* Remove the entries of weak hash table H that don't survive the
+   current GC.  */
+
+static void
+sweep_weak_table (struct Lisp_Hash_Table *h)
 {
   ptrdiff_t bucket, n;
-  bool marked;
 
   n = ASIZE (h->index) & ~ARRAY_MARK_FLAG;
-  marked = 0;
 
   for (bucket = 0; bucket < n; ++bucket)
     {
@@ -4230,54 +4279,31 @@ sweep_weak_table (struct Lisp_Hash_Table *h, bool remove_entries_p)
 
 	  next = HASH_NEXT (h, i);
 
-	  if (remove_entries_p)
+	  if (remove_p)
 	    {
-	      if (remove_p)
-		{
-		  /* Take out of collision chain.  */
-		  if (NILP (prev))
-		    set_hash_index_slot (h, bucket, next);
-		  else
-		    set_hash_next_slot (h, XFASTINT (prev), next);
-
-		  /* Add to free list.  */
-		  set_hash_next_slot (h, i, h->next_free);
-		  h->next_free = idx;
-
-		  /* Clear key, value, and hash.  */
-		  set_hash_key_slot (h, i, Qnil);
-		  set_hash_value_slot (h, i, Qnil);
-		  set_hash_hash_slot (h, i, Qnil);
-
-		  h->count--;
-		}
+	      /* Take out of collision chain.  */
+	      if (NILP (prev))
+		set_hash_index_slot (h, bucket, next);
 	      else
-		{
-		  prev = idx;
-		}
+		set_hash_next_slot (h, XFASTINT (prev), next);
+
+	      /* Add to free list.  */
+	      set_hash_next_slot (h, i, h->next_free);
+	      h->next_free = idx;
+
+	      /* Clear key, value, and hash.  */
+	      set_hash_key_slot (h, i, Qnil);
+	      set_hash_value_slot (h, i, Qnil);
+	      set_hash_hash_slot (h, i, Qnil);
+
+	      h->count--;
 	    }
 	  else
 	    {
-	      if (!remove_p)
-		{
-		  /* Make sure key and value survive.  */
-		  if (!key_known_to_survive_p)
-		    {
-		      mark_object (HASH_KEY (h, i));
-		      marked = 1;
-		    }
-
-		  if (!value_known_to_survive_p)
-		    {
-		      mark_object (HASH_VALUE (h, i));
-		      marked = 1;
-		    }
-		}
+	      prev = idx;
 	    }
 	}
     }
-
-  return marked;
 }
 
 /* Remove elements from weak hash tables that don't survive the
@@ -4288,48 +4314,48 @@ NO_INLINE /* For better stack traces */
 void
 sweep_weak_hash_tables (void)
 {
-  struct Lisp_Hash_Table *h, *used, *next;
-  bool marked;
-
-  /* Mark all keys and values that are in use.  Keep on marking until
-     there is no more change.  This is necessary for cases like
-     value-weak table A containing an entry X -> Y, where Y is used in a
-     key-weak table B, Z -> Y.  If B comes after A in the list of weak
-     tables, X -> Y might be removed from A, although when looking at B
-     one finds that it shouldn't.  */
+  struct Lisp_Hash_Table *h, **prev, *used = NULL;
+  bool found;
+
+  /* Mark all keys and values that are in use.  An entry can be kept
+     alive by another weak table, as in a value-weak table A containing
+     an entry X -> Y, where Y is used in a key-weak table B, Z -> Y; and
+     a weak table itself can be reachable only through an entry of
+     another one.  So each table in use is looked at once, entries
+     whose fate is not known yet are left to mark_ephemerons, and this
+     is repeated only for the tables that turn out to be in use
+     meanwhile.  */
   do
     {
-      marked = 0;
-      for (h = weak_hash_tables; h; h = h->next_weak)
-	{
-	  if (h->header.size & ARRAY_MARK_FLAG)
-	    marked |= sweep_weak_table (h, 0);
-	}
+      found = false;
+      for (prev = &weak_hash_tables; (h = *prev); )
+	if (h->header.size & ARRAY_MARK_FLAG)
+	  {
+	    /* Move the table to the list of used ones.  */
+	    *prev = h->next_weak;
+	    h->next_weak = used;
+	    used = h;
+	    mark_weak_table (h);
+	    found = true;
+	  }
+	else
+	  prev = &h->next_weak;
+      mark_ephemerons ();
     }
-  while (marked);
-
-  /* Remove tables and entries that aren't used.  */
-  for (h = weak_hash_tables, used = NULL; h; h = next)
-    {
-      next = h->next_weak;
+  while (found);
+  clear_ephemerons ();
 
-      if (h->header.size & ARRAY_MARK_FLAG)
-	{
-	  /* TABLE is marked as used.  Sweep its contents.  */
-	  if (h->count > 0)
-	    sweep_weak_table (h, 1);
-
-	  /* Add table to the list of used weak hash tables.  */
-	  h->next_weak = used;
-	  used = h;
-	}
-    }
+  /* Remove entries that aren't used.  The tables still in
+     weak_hash_tables are not used at all.  */
+  for (h = used; h; h = h->next_weak)
+    if (h->count > 0)
+      sweep_weak_table (h);
 
   weak_hash_tables = used;
 }
 
 
-
+
 /***********************************************************************
 			Hash Code Computation
  ***********************************************************************/
@@ -4561,7 +4587,9 @@ returned is a weak table.  Key/value pairs are removed from a weak
 hash table when there are no non-weak references pointing to their
 key, value, one of key or value, or both key and value, depending on
 WEAK.  WEAK t is equivalent to `key-and-value'.  Default value of WEAK
-is nil.
+is nil.  References from within the entries of weak tables are not
+counted: for example, an entry of a `key' weak table whose value refers
+to its key is removed unless the key is referenced from elsewhere.
 
 usage: (make-hash-table &rest KEYWORD-ARGS)  */)
   (ptrdiff_t nargs, Lisp_Object *args)
@@ -2835,7 +2835,7 @@ read_char (int commandflag, Lisp_Object map,
 
       /* If there is still no input available, ask for GC.  */
       if (!detect_input_pending_run_timers (0))
-	maybe_gc ();
+	maybe_gc_when_idle ();
     }
 
   /* Notify the caller if an autosave hook, or a timer, sentinel or
@@ -10513,7 +10513,12 @@ handle_interrupt (bool in_signal_handler)
       /* If executing a function that wants to be interrupted out of
 	 and the user has not deferred quitting by binding `inhibit-quit'
 	 then quit right away.  */
-      if (immediate_quit && NILP (Vinhibit_quit))
+      if (immediate_quit && NILP (Vinhibit_quit) && in_signal_handler)
+	/* The main thread may have given up the global lock to wait
+	   for a subprocess; it has to hold it to quit.  */
+	maybe_reacquire_global_lock ();
+      if (immediate_quit && NILP (Vinhibit_quit)
+	  && main_thread_p (current_thread))
 	{
 	  struct gl_state_s saved;
 	  struct gcpro gcpro1, gcpro2, gcpro3, gcpro4;
@@ -10550,8 +10555,15 @@ handle_interrupt (bool in_signal_handler)
          outside of polling since we don't get SIGIO like X and we don't have a
          separate event loop thread like W32.  */
 #ifndef HAVE_NS
+  /* Only the main thread reads keyboard input.  If it is waiting for
+     it, it has given up the global lock, so take that back first.  */
   if (waiting_for_input && !echoing)
-    quit_throw_to_read_char (in_signal_handler);
+    {
+      if (in_signal_handler)
+	maybe_reacquire_global_lock ();
+      if (main_thread_p (current_thread))
+	quit_throw_to_read_char (in_signal_handler);
+    }
 #endif
 }
 
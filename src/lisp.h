@@ -607,6 +607,10 @@ enum pvec_type
   PVEC_WINDOW_CONFIGURATION,
   PVEC_SUBR,
   PVEC_OTHER,
+  PVEC_COROUTINE,
+  PVEC_THREAD,
+  PVEC_MUTEX,
+  PVEC_CONDVAR,
   /* These should be last, check internal_equal to see why.  */
   PVEC_COMPILED,
   PVEC_CHAR_TABLE,
@@ -808,6 +812,7 @@ extern Lisp_Object Qvector_or_char_table_p, Qwholenump;
 extern Lisp_Object Qwindow;
 extern _Noreturn Lisp_Object wrong_type_argument (Lisp_Object, Lisp_Object);
 extern _Noreturn void wrong_choice (Lisp_Object, Lisp_Object);
+extern EMACS_INT function_epoch;
 
 /* Defined in emacs.c.  */
 extern bool might_dump;
@@ -2212,6 +2217,9 @@ struct Lisp_Buffer_Local_Value
     bool_bf found : 1;
     /* If non-NULL, a forwarding to the C var where it should also be set.  */
     union Lisp_Fwd *fwd;	/* Should never be (Buffer|Kboard)_Objfwd.  */
+    /* A number unique to this variable, which locates its bindings in
+       the slot tables of buffers.  */
+    EMACS_UINT index;
     /* The buffer or frame for which the loaded binding was found.  */
     Lisp_Object where;
     /* A cons cell that holds the default value.  It has the form
@@ -2452,6 +2460,12 @@ COMPILEDP (Lisp_Object a)
   return PSEUDOVECTORP (a, PVEC_COMPILED);
 }
 
+INLINE bool
+COROUTINEP (Lisp_Object a)
+{
+  return PSEUDOVECTORP (a, PVEC_COROUTINE);
+}
+
 INLINE bool
 BUFFERP (Lisp_Object a)
 {
@@ -2849,6 +2863,9 @@ union specbinding
       ENUM_BF (specbind_tag) kind : CHAR_BIT;
       /* `where' is not used in the case of SPECPDL_LET.  */
       Lisp_Object symbol, old_value, where;
+      /* The value of the binding while its thread is switched out;
+	 see unbind_for_thread_switch.  */
+      Lisp_Object saved_value;
     } let;
     struct {
       ENUM_BF (specbind_tag) kind : CHAR_BIT;
@@ -2859,9 +2876,7 @@ union specbinding
     } bt;
   };
 
-extern union specbinding *specpdl;
-extern union specbinding *specpdl_ptr;
-extern ptrdiff_t specpdl_size;
+#include "thread.h"
 
 INLINE ptrdiff_t
 SPECPDL_INDEX (void)
@@ -2913,7 +2928,11 @@ struct handler
   struct gcpro *gcpro;
 #endif
   sys_jmp_buf jmp;
-  EMACS_INT lisp_eval_depth;
+  /* If non-NULL, where to longjmp instead of JMP.  The handlers that
+     a frame of byte-code pushes all share one jump buffer in that
+     frame, which is set up only once.  */
+  sys_jmp_buf *frame_jmp;
+  EMACS_INT f_lisp_eval_depth;
   ptrdiff_t pdlcount;
   int poll_suppress_count;
   int interrupt_input_blocked;
@@ -2934,12 +2953,13 @@ struct handler
   (c)->tag_or_ch = (tag_ch_val);			\
   (c)->val = Qnil;					\
   (c)->next = handlerlist;				\
-  (c)->lisp_eval_depth = lisp_eval_depth;		\
+  (c)->f_lisp_eval_depth = lisp_eval_depth;		\
   (c)->pdlcount = SPECPDL_INDEX ();			\
   (c)->poll_suppress_count = poll_suppress_count;	\
   (c)->interrupt_input_blocked = interrupt_input_blocked;\
   (c)->gcpro = gcprolist;				\
   (c)->byte_stack = byte_stack_list;			\
+  (c)->frame_jmp = NULL;				\
   handlerlist = (c);
 
 
@@ -2998,8 +3018,6 @@ extern Lisp_Object Vascii_canon_table;
    Every function that can call Feval must protect in this fashion all
    Lisp_Object variables whose contents will be used again.  */
 
-extern struct gcpro *gcprolist;
-
 struct gcpro
 {
   struct gcpro *next;
@@ -3288,6 +3306,8 @@ INLINE void
 set_symbol_function (Lisp_Object sym, Lisp_Object function)
 {
   XSYMBOL (sym)->function = function;
+  function_epoch = (function_epoch < MOST_POSITIVE_FIXNUM
+		    ? function_epoch + 1 : 0);
 }
 
 INLINE void
@@ -3408,6 +3428,7 @@ enum Arith_Comparison {
 };
 extern Lisp_Object arithcompare (Lisp_Object num1, Lisp_Object num2,
                                  enum Arith_Comparison comparison);
+extern int count_one_bits_word (bits_word);
 
 /* Convert the integer I to an Emacs representation, either the integer
    itself, or a cons of two or three integers, or if all else fails a float.
@@ -3490,7 +3511,7 @@ Lisp_Object make_hash_table (struct hash_table_test, Lisp_Object, Lisp_Object,
 ptrdiff_t hash_lookup (struct Lisp_Hash_Table *, Lisp_Object, EMACS_UINT *);
 ptrdiff_t hash_put (struct Lisp_Hash_Table *, Lisp_Object, Lisp_Object,
 		    EMACS_UINT);
-extern struct hash_table_test hashtest_eql, hashtest_equal;
+extern struct hash_table_test hashtest_eq, hashtest_eql, hashtest_equal;
 extern void validate_subarray (Lisp_Object, Lisp_Object, Lisp_Object,
 			       ptrdiff_t, ptrdiff_t *, ptrdiff_t *);
 extern Lisp_Object substring_both (Lisp_Object, ptrdiff_t, ptrdiff_t,
@@ -3641,10 +3662,14 @@ extern void parse_str_as_multibyte (const unsigned char *, ptrdiff_t,
 extern void check_pure_size (void);
 extern void free_misc (Lisp_Object);
 extern void allocate_string_data (struct Lisp_String *, EMACS_INT, EMACS_INT);
+extern void unshare_string_data (Lisp_Object);
 extern void malloc_warning (const char *);
 extern _Noreturn void memory_full (size_t);
 extern _Noreturn void buffer_memory_full (ptrdiff_t);
 extern bool survives_gc_p (Lisp_Object);
+extern void add_ephemeron (Lisp_Object, Lisp_Object, Lisp_Object);
+extern void mark_ephemerons (void);
+extern void clear_ephemerons (void);
 extern void mark_object (Lisp_Object);
 #if defined REL_ALLOC && !defined SYSTEM_MALLOC && !defined HYBRID_MALLOC
 extern void refill_memory_reserve (void);
@@ -3652,9 +3677,21 @@ extern void refill_memory_reserve (void);
 extern const char *pending_malloc_warning;
 extern Lisp_Object zero_vector;
 extern Lisp_Object *stack_base;
+extern void mark_stack (char *, char *);
+extern void flush_stack_call_func (void (*func) (void *arg), void *arg);
 extern EMACS_INT consing_since_gc;
 extern EMACS_INT gc_relative_threshold;
 extern EMACS_INT memory_full_cons_threshold;
+
+/* Why garbage collection happens.  */
+enum gc_trigger
+  {
+    GC_TRIGGER_EXPLICIT,	/* Any other reason, e.g. `garbage-collect'.  */
+    GC_TRIGGER_THRESHOLD,	/* Enough consing was done.  */
+    GC_TRIGGER_MEMORY_FULL,	/* Memory is short.  */
+    GC_TRIGGER_IDLE		/* Put off until Emacs was idle.  */
+  };
+extern enum gc_trigger gc_trigger;
 extern Lisp_Object list1 (Lisp_Object);
 extern Lisp_Object list2 (Lisp_Object, Lisp_Object);
 extern Lisp_Object list3 (Lisp_Object, Lisp_Object, Lisp_Object);
@@ -3783,6 +3820,7 @@ extern bool abort_on_gc;
 extern Lisp_Object make_float (double);
 extern void display_malloc_warning (void);
 extern ptrdiff_t inhibit_garbage_collection (void);
+extern void maybe_gc_when_idle (void);
 extern Lisp_Object make_save_int_int_int (ptrdiff_t, ptrdiff_t, ptrdiff_t);
 extern Lisp_Object make_save_obj_obj_obj_obj (Lisp_Object, Lisp_Object,
 					      Lisp_Object, Lisp_Object);
@@ -3900,14 +3938,12 @@ intern_c_string (const char *str)
 }
 
 /* Defined in eval.c.  */
-extern EMACS_INT lisp_eval_depth;
 extern Lisp_Object Qexit, Qinteractive, Qcommandp, Qmacro;
 extern Lisp_Object Qinhibit_quit, Qinternal_interpreter_environment, Qclosure;
 extern Lisp_Object Qand_rest;
 extern Lisp_Object Vautoload_queue;
 extern Lisp_Object Vsignaling_function;
 extern Lisp_Object inhibit_lisp_code;
-extern struct handler *handlerlist;
 
 /* To run a normal hook, use the appropriate function from the list below.
    The calling convention:
@@ -3929,6 +3965,12 @@ extern _Noreturn void xsignal3 (Lisp_Object, Lisp_Object, Lisp_Object,
 				Lisp_Object);
 extern _Noreturn void signal_error (const char *, Lisp_Object);
 extern Lisp_Object eval_sub (Lisp_Object form);
+extern Lisp_Object funcall_definition (Lisp_Object, ptrdiff_t, Lisp_Object *);
+extern Lisp_Object funcall_subr_exact (Lisp_Object, ptrdiff_t, Lisp_Object *);
+extern bool backtrace_replace_call (ptrdiff_t, Lisp_Object, Lisp_Object *,
+				    ptrdiff_t);
+extern Lisp_Object suspend_specpdl (ptrdiff_t);
+extern void resume_specpdl (Lisp_Object);
 extern Lisp_Object apply1 (Lisp_Object, Lisp_Object);
 extern Lisp_Object call0 (Lisp_Object);
 extern Lisp_Object call1 (Lisp_Object, Lisp_Object);
@@ -3969,7 +4011,10 @@ extern void init_eval (void);
 extern void syms_of_eval (void);
 extern void unwind_body (Lisp_Object);
 extern ptrdiff_t record_in_backtrace (Lisp_Object, Lisp_Object *, ptrdiff_t);
-extern void mark_specpdl (void);
+extern void mark_specpdl (union specbinding *first, union specbinding *ptr);
+extern void init_handlerlist (void);
+extern void unbind_for_thread_switch (struct thread_state *);
+extern void rebind_for_thread_switch (void);
 extern void get_backtrace (Lisp_Object array);
 Lisp_Object backtrace_top_function (void);
 extern bool let_shadows_buffer_binding_p (struct Lisp_Symbol *symbol);
@@ -4239,13 +4284,13 @@ extern int read_bytecode_char (bool);
 
 /* Defined in bytecode.c.  */
 extern void syms_of_bytecode (void);
-extern struct byte_stack *byte_stack_list;
 #if BYTE_MARK_STACK
-extern void mark_byte_stack (void);
+extern void mark_byte_stack (struct byte_stack *);
 #endif
-extern void unmark_byte_stack (void);
+extern void unmark_byte_stack (struct byte_stack *);
 extern Lisp_Object exec_byte_code (Lisp_Object, Lisp_Object, Lisp_Object,
-				   Lisp_Object, ptrdiff_t, Lisp_Object *);
+				   Lisp_Object, ptrdiff_t, Lisp_Object *,
+				   Lisp_Object);
 
 /* Defined in macros.c.  */
 extern void init_macros (void);
@@ -4428,6 +4473,7 @@ void syms_of_dbusbind (void);
 /* Defined in profiler.c.  */
 extern bool profiler_memory_running;
 extern void malloc_probe (size_t);
+extern void alloc_probe (Lisp_Object, size_t);
 extern void syms_of_profiler (void);
 
 
@@ -4710,11 +4756,18 @@ extern const char *verify_ascii (const char *);
 INLINE void
 maybe_gc (void)
 {
-  if ((consing_since_gc > gc_cons_threshold
-       && consing_since_gc > gc_relative_threshold)
-      || (!NILP (Vmemory_full)
-	  && consing_since_gc > memory_full_cons_threshold))
-    Fgarbage_collect ();
+  if (consing_since_gc > gc_cons_threshold
+      && consing_since_gc > gc_relative_threshold)
+    {
+      gc_trigger = GC_TRIGGER_THRESHOLD;
+      Fgarbage_collect ();
+    }
+  else if (!NILP (Vmemory_full)
+	   && consing_since_gc > memory_full_cons_threshold)
+    {
+      gc_trigger = GC_TRIGGER_MEMORY_FULL;
+      Fgarbage_collect ();
+    }
 }
 
 INLINE bool
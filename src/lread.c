@@ -1264,6 +1264,7 @@ Return t if the file exists and loads successfully.  */)
               result = stat (SSDATA (efound), &s1);
               if (result == 0)
                 {
+                  unshare_string_data (efound);
                   SSET (efound, SBYTES (efound) - 1, 0);
                   result = stat (SSDATA (efound), &s2);
                   SSET (efound, SBYTES (efound) - 1, 'c');
@@ -1918,6 +1918,46 @@ print_object (Lisp_Object obj, Lisp_Object printcharfun, bool escapeflag)
 	{
 	  strout ("#<window-configuration>", -1, -1, printcharfun);
 	}
+      else if (COROUTINEP (obj))
+	{
+	  strout ("#<coroutine>", -1, -1, printcharfun);
+	}
+      else if (THREADP (obj))
+	{
+	  strout ("#<thread ", -1, -1, printcharfun);
+	  if (STRINGP (XTHREAD (obj)->name))
+	    print_string (XTHREAD (obj)->name, printcharfun);
+	  else
+	    {
+	      int len = sprintf (buf, "%p", XTHREAD (obj));
+	      strout (buf, len, len, printcharfun);
+	    }
+	  PRINTCHAR ('>');
+	}
+      else if (MUTEXP (obj))
+	{
+	  strout ("#<mutex ", -1, -1, printcharfun);
+	  if (STRINGP (XMUTEX (obj)->name))
+	    print_string (XMUTEX (obj)->name, printcharfun);
+	  else
+	    {
+	      int len = sprintf (buf, "%p", XMUTEX (obj));
+	      strout (buf, len, len, printcharfun);
+	    }
+	  PRINTCHAR ('>');
+	}
+      else if (CONDVARP (obj))
+	{
+	  strout ("#<condvar ", -1, -1, printcharfun);
+	  if (STRINGP (XCONDVAR (obj)->name))
+	    print_string (XCONDVAR (obj)->name, printcharfun);
+	  else
+	    {
+	      int len = sprintf (buf, "%p", XCONDVAR (obj));
+	      strout (buf, len, len, printcharfun);
+	    }
+	  PRINTCHAR ('>');
+	}
       else if (FRAMEP (obj))
 	{
 	  int len;
@@ -447,6 +447,11 @@ pset_write_queue (struct Lisp_Process *p, Lisp_Object val)
 {
   p->write_queue = val;
 }
+static void
+pset_thread (struct Lisp_Process *p, Lisp_Object val)
+{
+  p->thread = val;
+}
 
 
 
@@ -457,8 +462,53 @@ static struct fd_callback_data
 #define FOR_READ  1
 #define FOR_WRITE 2
   int condition; /* mask of the defines above.  */
+  /* The thread that is waiting on this descriptor in
+     wait_reading_process_output, if any.  Other threads leave it
+     alone meanwhile.  */
+  struct thread_state *waiting_thread;
 } fd_callback_info[FD_SETSIZE];
 
+/* Take out of MASK the descriptors that the current thread must not
+   wait on: those another thread is waiting on, those of processes
+   locked to another thread, and, unless this is the main thread, the
+   keyboard.  Mark the rest of the descriptors up to MAX_DESC as waited
+   on by the current thread.  */
+
+static void
+claim_wait_descriptors (fd_set *mask, int max_desc)
+{
+  bool main_thread = main_thread_p (current_thread);
+  int fd;
+
+  for (fd = 0; fd <= max_desc; fd++)
+    if (FD_ISSET (fd, mask))
+      {
+	struct thread_state *waiter = fd_callback_info[fd].waiting_thread;
+	Lisp_Object proc = chan_process[fd];
+
+	if ((waiter && waiter != current_thread)
+	    || (PROCESSP (proc) && THREADP (XPROCESS (proc)->thread)
+		&& XTHREAD (XPROCESS (proc)->thread) != current_thread)
+	    || (!main_thread && FD_ISSET (fd, &input_wait_mask)
+		&& !FD_ISSET (fd, &non_keyboard_wait_mask)))
+	  FD_CLR (fd, mask);
+	else
+	  fd_callback_info[fd].waiting_thread = current_thread;
+      }
+}
+
+/* Forget the descriptors that the current thread has claimed.  */
+
+static void
+release_wait_descriptors (void)
+{
+  int fd;
+
+  for (fd = 0; fd < FD_SETSIZE; fd++)
+    if (fd_callback_info[fd].waiting_thread == current_thread)
+      fd_callback_info[fd].waiting_thread = NULL;
+}
+
 
 /* Add a file descriptor FD to be monitored for when read is possible.
    When read is possible, call FUNC with argument DATA.  */
@@ -753,6 +803,7 @@ make_process (Lisp_Object name)
   pset_name (p, name);
   pset_sentinel (p, Qinternal_default_process_sentinel);
   pset_filter (p, Qinternal_default_process_filter);
+  pset_thread (p, Fcurrent_thread ());
   XSETPROCESS (val, p);
   Vprocess_alist = Fcons (Fcons (name, val), Vprocess_alist);
   return val;
@@ -1133,6 +1184,33 @@ See `set-process-sentinel' for more info on sentinels.  */)
   return XPROCESS (process)->sentinel;
 }
 
+DEFUN ("set-process-thread", Fset_process_thread, Sset_process_thread,
+       2, 2, 0,
+       doc: /* Set the locking thread of PROCESS to be THREAD.
+If THREAD is nil, the process is unlocked, and any thread can read its
+output.  Otherwise only THREAD reads it, in `accept-process-output'
+and whenever it waits for input.  Return THREAD.  */)
+  (Lisp_Object process, Lisp_Object thread)
+{
+  CHECK_PROCESS (process);
+  if (!NILP (thread))
+    CHECK_THREAD (thread);
+
+  pset_thread (XPROCESS (process), thread);
+  return thread;
+}
+
+DEFUN ("process-thread", Fprocess_thread, Sprocess_thread,
+       1, 1, 0,
+       doc: /* Return the locking thread of PROCESS.
+If PROCESS is unlocked, this function returns nil.
+A process is locked to the thread that created it.  */)
+  (Lisp_Object process)
+{
+  CHECK_PROCESS (process);
+  return XPROCESS (process)->thread;
+}
+
 DEFUN ("set-process-window-size", Fset_process_window_size,
        Sset_process_window_size, 3, 3, 0,
        doc: /* Tell PROCESS that it has logical window size HEIGHT and WIDTH.  */)
@@ -3951,7 +4029,23 @@ is nil, from any process) before the timeout expired.  */)
   int nsecs;
 
   if (! NILP (process))
-    CHECK_PROCESS (process);
+    {
+      struct Lisp_Process *proc;
+
+      CHECK_PROCESS (process);
+      proc = XPROCESS (process);
+      if (THREADP (proc->thread) && XTHREAD (proc->thread) != current_thread)
+	{
+	  Lisp_Object thread_name = XTHREAD (proc->thread)->name;
+
+	  if (STRINGP (thread_name))
+	    error ("Attempt to accept output from process %s locked to thread %s",
+		   SDATA (proc->name), SDATA (thread_name));
+	  else
+	    error ("Attempt to accept output from process %s locked to another thread",
+		   SDATA (proc->name));
+	}
+    }
   else
     just_this_one = Qnil;
 
@@ -4301,9 +4395,14 @@ wait_reading_process_output (intmax_t time_limit, int nsecs, int read_kbd,
 	   && EQ (XCAR (wait_proc->status), Qexit)))
     message1 ("Blocking call to accept-process-output with quit inhibited!!");
 
+  /* Only the main thread reads keyboard input.  */
+  if (!main_thread_p (current_thread))
+    read_kbd = 0;
+
   record_unwind_protect_int (wait_reading_process_output_unwind,
 			     waiting_for_user_input_p);
   waiting_for_user_input_p = read_kbd;
+  record_unwind_protect_void (release_wait_descriptors);
 
   if (time_limit < 0)
     {
@@ -4551,7 +4650,8 @@ wait_reading_process_output (intmax_t time_limit, int nsecs, int read_kbd,
 	 triggered by processing X events).  In the latter case, set
 	 nfds to 1 to avoid breaking the loop.  */
       no_avail = 0;
-      if ((read_kbd || !NILP (wait_for_cell))
+      if ((read_kbd
+	   || (!NILP (wait_for_cell) && main_thread_p (current_thread)))
 	  && detect_input_pending ())
 	{
 	  nfds = read_kbd ? 0 : 1;
@@ -4596,17 +4696,26 @@ wait_reading_process_output (intmax_t time_limit, int nsecs, int read_kbd,
 	    }
 #endif
 
+	  /* Other threads can run while this one waits.  Leave them the
+	     descriptors they are waiting on or have locked.  */
+	  claim_wait_descriptors (&Available,
+				  max (max_process_desc, max_input_desc));
+	  if (check_write)
+	    claim_wait_descriptors (&Writeok,
+				    max (max_process_desc, max_input_desc));
+
+          nfds = thread_select (
 #if defined (HAVE_NS)
-          nfds = ns_select
+				ns_select,
 #elif defined (HAVE_GLIB)
-	  nfds = xg_select
+				xg_select,
 #else
-	  nfds = pselect
+				pselect,
 #endif
-            (max (max_process_desc, max_input_desc) + 1,
-             &Available,
-             (check_write ? &Writeok : 0),
-             NULL, &timeout, NULL);
+				max (max_process_desc, max_input_desc) + 1,
+				&Available,
+				(check_write ? &Writeok : 0),
+				NULL, &timeout, NULL);
 
 #ifdef HAVE_GNUTLS
           /* GnuTLS buffers data internally.  In lowat mode it leaves
@@ -4624,7 +4733,9 @@ wait_reading_process_output (intmax_t time_limit, int nsecs, int read_kbd,
 		     to need it.  See
 		     http://comments.gmane.org/gmane.emacs.devel/145074 */
 		  for (channel = 0; channel < FD_SETSIZE; ++channel)
-		    if (! NILP (chan_process[channel]))
+		    if (! NILP (chan_process[channel])
+			&& (fd_callback_info[channel].waiting_thread
+			    == current_thread))
 		      {
 			struct Lisp_Process *p =
 			  XPROCESS (chan_process[channel]);
@@ -4657,6 +4768,7 @@ wait_reading_process_output (intmax_t time_limit, int nsecs, int read_kbd,
 		}
 	    }
 #endif
+	  release_wait_descriptors ();
 	}
 
       xerrno = errno;
@@ -4722,7 +4834,8 @@ wait_reading_process_output (intmax_t time_limit, int nsecs, int read_kbd,
 	 That would causes delays in pasting selections, for example.
 
 	 (We used to do this only if wait_for_cell.)  */
-      if (read_kbd == 0 && detect_input_pending ())
+      if (read_kbd == 0 && main_thread_p (current_thread)
+	  && detect_input_pending ())
 	{
 	  swallow_events (do_display);
 #if 0  /* Exiting when read_kbd doesn't request that seems wrong, though.  */
@@ -5154,6 +5267,8 @@ read_and_dispose_of_process_output (struct Lisp_Process *p, char *chars,
     {
       if (SCHARS (p->decoding_buf) < coding->carryover_bytes)
 	pset_decoding_buf (p, make_uninit_string (coding->carryover_bytes));
+      else
+	unshare_string_data (p->decoding_buf);
       memcpy (SDATA (p->decoding_buf), coding->carryover,
 	      coding->carryover_bytes);
       p->decoding_carryover = coding->carryover_bytes;
@@ -6929,6 +7044,21 @@ BUFFER may be a buffer or the name of one.  */)
   return Qnil;
 }
 
+/* Unlock the processes locked to DYING_THREAD, which is exiting, so
+   that other threads can read their output.  */
+
+void
+update_processes_for_thread_death (Lisp_Object dying_thread)
+{
+#ifdef subprocesses
+  Lisp_Object tail, proc;
+
+  FOR_EACH_PROCESS (tail, proc)
+    if (EQ (XPROCESS (proc)->thread, dying_thread))
+      pset_thread (XPROCESS (proc), Qnil);
+#endif	/* subprocesses */
+}
+
 DEFUN ("process-inherit-coding-system-flag",
        Fprocess_inherit_coding_system_flag, Sprocess_inherit_coding_system_flag,
        1, 1, 0,
@@ -7370,6 +7500,8 @@ The variable takes effect when `start-process' is called.  */);
   defsubr (&Sprocess_filter);
   defsubr (&Sset_process_sentinel);
   defsubr (&Sprocess_sentinel);
+  defsubr (&Sset_process_thread);
+  defsubr (&Sprocess_thread);
   defsubr (&Sset_process_window_size);
   defsubr (&Sset_process_inherit_coding_system_flag);
   defsubr (&Sset_process_query_on_exit_flag);
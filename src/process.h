@@ -101,6 +101,10 @@ struct Lisp_Process
     /* Queue for storing waiting writes */
     Lisp_Object write_queue;
 
+    /* The thread to which this process is locked, or nil if any thread
+       can read its output.  */
+    Lisp_Object thread;
+
 #ifdef HAVE_GNUTLS
     Lisp_Object gnutls_cred_type;
 #endif
@@ -237,6 +241,7 @@ extern void delete_read_fd (int fd);
 extern void add_write_fd (int fd, fd_callback func, void *data);
 extern void delete_write_fd (int fd);
 extern void catch_child_signal (void);
+extern void update_processes_for_thread_death (Lisp_Object);
 
 #ifdef WINDOWSNT
 extern Lisp_Object network_interface_list (void);
@@ -133,10 +133,11 @@ static void evict_lower_half (log_t *log)
 
 /* Record the current backtrace in LOG.  COUNT is the weight of this
    current backtrace: interrupt counts for CPU, and the allocation
-   size for memory.  */
+   size for memory.  If KIND is non-nil, record it as the innermost
+   element of the backtrace, at the expense of the outermost one.  */
 
 static void
-record_backtrace (log_t *log, EMACS_INT count)
+record_backtrace (log_t *log, Lisp_Object kind, EMACS_INT count)
 {
   Lisp_Object backtrace;
   ptrdiff_t index;
@@ -150,6 +151,13 @@ record_backtrace (log_t *log, EMACS_INT count)
   /* Get a "working memory" vector.  */
   backtrace = HASH_KEY (log, index);
   get_backtrace (backtrace);
+  if (!NILP (kind) && ASIZE (backtrace) > 0)
+    {
+      ptrdiff_t i;
+      for (i = ASIZE (backtrace) - 1; i > 0; i--)
+	ASET (backtrace, i, AREF (backtrace, i - 1));
+      ASET (backtrace, 0, kind);
+    }
 
   { /* We basically do a `gethash+puthash' here, except that we have to be
        careful to avoid memory allocation since we're in a signal
@@ -221,6 +229,12 @@ static EMACS_INT current_sampling_interval;
 static void
 handle_profiler_signal (int signal)
 {
+  /* The signal is handled by the main thread, which cannot safely look
+     at the backtrace of another thread running meanwhile, so only the
+     main thread is profiled.  */
+  if (!main_thread_p (current_thread))
+    return;
+
   if (EQ (backtrace_top_function (), Qautomatic_gc))
     /* Special case the time-count inside GC because the hash-table
        code is not prepared to be used while the GC is running.
@@ -241,7 +255,7 @@ handle_profiler_signal (int signal)
 	}
 #endif
       eassert (HASH_TABLE_P (cpu_log));
-      record_backtrace (XHASH_TABLE (cpu_log), count);
+      record_backtrace (XHASH_TABLE (cpu_log), Qnil, count);
     }
 }
 
@@ -421,12 +435,19 @@ bool profiler_memory_running;
 
 static Lisp_Object memory_log;
 
+/* Number of bytes of Lisp objects allocated since the memory profiler
+   last took a sample of them.  */
+static EMACS_INT alloc_bytes_unsampled;
+
 DEFUN ("profiler-memory-start", Fprofiler_memory_start, Sprofiler_memory_start,
        0, 0, 0,
        doc: /* Start/restart the memory profiler.
 The memory profiler will take samples of the call-stack whenever a new
 allocation takes place.  Note that most small allocations only trigger
-the profiler occasionally.
+the profiler occasionally.  Lisp objects are sampled once every
+`profiler-memory-sampling-interval' bytes, whether they come from
+malloc or not, and the kind of object allocated, such as `conses' or
+`strings', is recorded as the innermost element of the call-stack.
 See also `profiler-log-size' and `profiler-max-stack-depth'.  */)
   (void)
 {
@@ -437,6 +458,7 @@ See also `profiler-log-size' and `profiler-max-stack-depth'.  */)
     memory_log = make_log (profiler_log_size,
 			   profiler_max_stack_depth);
 
+  alloc_bytes_unsampled = 0;
   profiler_memory_running = true;
 
   return Qt;
@@ -492,7 +514,26 @@ void
 malloc_probe (size_t size)
 {
   eassert (HASH_TABLE_P (memory_log));
-  record_backtrace (XHASH_TABLE (memory_log), min (size, MOST_POSITIVE_FIXNUM));
+  record_backtrace (XHASH_TABLE (memory_log), Qnil,
+		    min (size, MOST_POSITIVE_FIXNUM));
+}
+
+/* Record that the current backtrace allocated a Lisp object of SIZE
+   bytes, of the kind named by the symbol KIND, if it is time to take
+   a sample.  The sample's weight is the number of bytes allocated
+   since the previous one.  */
+void
+alloc_probe (Lisp_Object kind, size_t size)
+{
+  alloc_bytes_unsampled
+    = saturated_add (alloc_bytes_unsampled, min (size, MOST_POSITIVE_FIXNUM));
+  if (alloc_bytes_unsampled >= profiler_memory_sampling_interval)
+    {
+      eassert (HASH_TABLE_P (memory_log));
+      record_backtrace (XHASH_TABLE (memory_log), kind,
+			alloc_bytes_unsampled);
+      alloc_bytes_unsampled = 0;
+    }
 }
 
 DEFUN ("function-equal", Ffunction_equal, Sfunction_equal, 2, 2, 0,
@@ -566,6 +607,13 @@ syms_of_profiler (void)
 If the log gets full, some of the least-seen call-stacks will be evicted
 to make room for new entries.  */);
   profiler_log_size = 10000;
+  DEFVAR_INT ("profiler-memory-sampling-interval",
+	      profiler_memory_sampling_interval,
+	      doc: /* Number of bytes of Lisp objects allocated per memory profiler sample.
+Each sample is weighted by the number of bytes allocated since the
+previous one, so a smaller value gives a more precise profile at the
+cost of a slower program.  */);
+  profiler_memory_sampling_interval = 4096;
 
   DEFSYM (Qprofiler_backtrace_equal, "profiler-backtrace-equal");
 
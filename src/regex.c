@@ -73,6 +73,12 @@
 # include <wctype.h>
 #endif
 
+/* regex.h is included everywhere through lisp.h, so define this here
+   rather than there, where it would break <wchar.h>.  */
+#if !WIDE_CHAR_SUPPORT
+# define btowc(c) c
+#endif
+
 #ifdef _LIBC
 /* We have to keep the namespace clean.  */
 # define regfree(preg) __regfree (preg)
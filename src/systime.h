@@ -84,8 +84,8 @@ extern void set_waiting_for_input (struct timespec *);
 
 /* When lisp.h is not included Lisp_Object is not defined (this can
    happen when this files is used outside the src directory).
-   Use GCPRO1 to determine if lisp.h was included.  */
-#ifdef GCPRO1
+   Use EMACS_LISP_H to determine if lisp.h was included.  */
+#ifdef EMACS_LISP_H
 /* defined in editfns.c */
 extern Lisp_Object make_lisp_time (struct timespec);
 extern bool decode_time_components (Lisp_Object, Lisp_Object, Lisp_Object,
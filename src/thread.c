@@ -0,0 +1,1081 @@
+/* Threading code.
+Copyright (C) 2014 Free Software Foundation, Inc.
+
+This file is part of GNU Emacs.
+
+GNU Emacs is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+GNU Emacs is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with GNU Emacs.  If not, see <http://www.gnu.org/licenses/>.  */
+
+/* Lisp threads are cooperative: every thread is a system thread, but
+   only the one holding the global lock runs Lisp.  A thread gives up
+   the lock only at well-defined points -- when it waits for input in
+   `thread_select' or `thread_read', and in `thread-yield',
+   `thread-join', `mutex-lock' and `condition-wait' -- so the rest of
+   Emacs can keep treating the state of the interpreter as global.
+   What differs between threads is kept in struct thread_state, and a
+   thread that takes the lock installs its own dynamic bindings and
+   current buffer.  */
+
+#include <config.h>
+#include <errno.h>
+#include <stdio.h>
+#include <unistd.h>
+#include "lisp.h"
+#include "character.h"
+#include "buffer.h"
+#include "process.h"
+
+static struct thread_state main_thread;
+
+/* The thread holding the global lock, or that last held it.  */
+struct thread_state *current_thread = &main_thread;
+
+/* All the threads that are alive, most recently created first.  */
+struct thread_state *all_threads = &main_thread;
+
+/* The lock a thread has to hold to run Lisp.  */
+static sys_mutex_t global_lock;
+
+Lisp_Object Qthreadp, Qmutexp, Qcondition_variable_p;
+
+/* The error with which the last thread that failed exited.  */
+static Lisp_Object last_thread_error;
+
+#if !defined DOUG_LEA_MALLOC && defined HAVE_PTHREAD \
+  && !defined SYSTEM_MALLOC && !defined HYBRID_MALLOC
+extern void malloc_enable_thread (void);
+#endif
+
+
+
+/* Block/unblock SIGINT, whose handler may take the global lock on
+   behalf of the main thread; see maybe_reacquire_global_lock.  */
+
+static void
+block_interrupt_signal (sigset_t *oldset)
+{
+  sigset_t blocked;
+  sigemptyset (&blocked);
+  sigaddset (&blocked, SIGINT);
+  pthread_sigmask (SIG_BLOCK, &blocked, oldset);
+}
+
+static void
+restore_signal_mask (sigset_t const *oldset)
+{
+  pthread_sigmask (SIG_SETMASK, oldset, 0);
+}
+
+static void
+release_global_lock (void)
+{
+  sys_mutex_unlock (&global_lock);
+}
+
+/* Make SELF, which has just taken the global lock, the current thread.
+   If another thread ran last, undo its dynamic bindings, redo those of
+   SELF and switch to the current buffer of SELF.  */
+
+static void
+post_acquire_global_lock (struct thread_state *self)
+{
+  struct thread_state *prev_thread = current_thread;
+
+  if (prev_thread == self)
+    return;
+
+  /* PREV_THREAD is still current here, so that its bindings are
+     undone in its own current buffer.  */
+  unbind_for_thread_switch (prev_thread);
+  current_thread = self;
+  rebind_for_thread_switch ();
+  set_buffer_internal_2 (prev_thread->m_current_buffer);
+}
+
+static void
+acquire_global_lock (struct thread_state *self)
+{
+  sys_mutex_lock (&global_lock);
+  self->not_holding_lock = false;
+  post_acquire_global_lock (self);
+}
+
+/* If the current thread has been signaled by `thread-signal', signal
+   the error now.  */
+
+static void
+signal_pending_thread_error (void)
+{
+  Lisp_Object error_symbol = current_thread->error_symbol;
+  Lisp_Object error_data = current_thread->error_data;
+
+  if (NILP (error_symbol) || !handlerlist)
+    return;
+
+  current_thread->error_symbol = Qnil;
+  current_thread->error_data = Qnil;
+  Fsignal (error_symbol, error_data);
+}
+
+/* Called from the SIGINT handler, which runs in the main thread.  If
+   the main thread has given up the global lock to wait for input,
+   take it back, so that the handler can quit.  */
+
+void
+maybe_reacquire_global_lock (void)
+{
+  if (main_thread.not_holding_lock)
+    acquire_global_lock (&main_thread);
+}
+
+
+
+/* Lisp mutexes.  */
+
+static void
+lisp_mutex_init (lisp_mutex_t *mutex)
+{
+  mutex->owner = NULL;
+  mutex->count = 0;
+  sys_cond_init (&mutex->condition);
+}
+
+/* Lock MUTEX for thread SELF, which holds the global lock.  If
+   NEW_COUNT is zero, this is an ordinary lock, which gives up if SELF
+   is signaled while it waits; otherwise SELF is taking back MUTEX
+   after `condition-wait', with NEW_COUNT as its lock count, and has to
+   get it no matter what.  Return true if SELF had to wait, and so let
+   other threads run.  */
+
+static bool
+lisp_mutex_lock (lisp_mutex_t *mutex, struct thread_state *self,
+		 unsigned int new_count)
+{
+  if (mutex->owner == NULL)
+    {
+      mutex->owner = self;
+      mutex->count = new_count == 0 ? 1 : new_count;
+      return false;
+    }
+  if (mutex->owner == self)
+    {
+      eassert (new_count == 0);
+      ++mutex->count;
+      return false;
+    }
+
+  self->wait_condvar = &mutex->condition;
+  while (mutex->owner != NULL && (new_count != 0 || NILP (self->error_symbol)))
+    sys_cond_wait (&mutex->condition, &global_lock);
+  self->wait_condvar = NULL;
+
+  if (mutex->owner == NULL)
+    {
+      mutex->owner = self;
+      mutex->count = new_count == 0 ? 1 : new_count;
+    }
+
+  return true;
+}
+
+static void
+lisp_mutex_unlock (lisp_mutex_t *mutex)
+{
+  if (mutex->owner != current_thread)
+    error ("Cannot unlock mutex owned by another thread");
+
+  if (--mutex->count > 0)
+    return;
+
+  mutex->owner = NULL;
+  sys_cond_broadcast (&mutex->condition);
+}
+
+/* Unlock MUTEX completely for `condition-wait', and return the lock
+   count it had.  */
+
+static unsigned int
+lisp_mutex_unlock_for_wait (lisp_mutex_t *mutex)
+{
+  unsigned int result = mutex->count;
+
+  /* Ensured by condition-wait.  */
+  eassert (mutex->owner == current_thread);
+
+  mutex->count = 0;
+  mutex->owner = NULL;
+  sys_cond_broadcast (&mutex->condition);
+
+  return result;
+}
+
+DEFUN ("make-mutex", Fmake_mutex, Smake_mutex, 0, 1, 0,
+       doc: /* Create a mutex.
+A mutex provides a synchronization point for threads.
+Only one thread at a time can hold a mutex.  Other threads attempting
+to acquire it will block until the mutex is available.
+
+A thread can acquire a mutex any number of times.
+
+NAME, if given, is used as the name of the mutex.  The name is
+informational only.  */)
+  (Lisp_Object name)
+{
+  struct Lisp_Mutex *mutex;
+  Lisp_Object result;
+  size_t offset = offsetof (struct Lisp_Mutex, mutex);
+
+  if (!NILP (name))
+    CHECK_STRING (name);
+
+  mutex = ALLOCATE_PSEUDOVECTOR (struct Lisp_Mutex, mutex, PVEC_MUTEX);
+  memset ((char *) mutex + offset, 0, sizeof (struct Lisp_Mutex) - offset);
+  mutex->name = name;
+  lisp_mutex_init (&mutex->mutex);
+
+  XSETMUTEX (result, mutex);
+  return result;
+}
+
+static void
+mutex_lock_callback (void *arg)
+{
+  struct Lisp_Mutex *mutex = arg;
+  struct thread_state *self = current_thread;
+
+  if (lisp_mutex_lock (&mutex->mutex, self, 0))
+    post_acquire_global_lock (self);
+}
+
+static void
+do_unwind_mutex_lock (void)
+{
+  current_thread->event_object = Qnil;
+}
+
+DEFUN ("mutexp", Fmutexp, Smutexp, 1, 1, 0,
+       doc: /* Return t if OBJECT is a mutex.  */)
+  (Lisp_Object object)
+{
+  return MUTEXP (object) ? Qt : Qnil;
+}
+
+DEFUN ("mutex-lock", Fmutex_lock, Smutex_lock, 1, 1, 0,
+       doc: /* Acquire a mutex.
+If the current thread already owns MUTEX, increment the count and
+return.
+Otherwise, if no thread owns MUTEX, make the current thread own it.
+Otherwise, block until MUTEX is available, or until the current thread
+is signaled using `thread-signal'.
+Note that calls to `mutex-lock' and `mutex-unlock' must be paired.  */)
+  (Lisp_Object mutex)
+{
+  struct Lisp_Mutex *lmutex;
+  ptrdiff_t count = SPECPDL_INDEX ();
+
+  CHECK_MUTEX (mutex);
+  lmutex = XMUTEX (mutex);
+
+  current_thread->event_object = mutex;
+  record_unwind_protect_void (do_unwind_mutex_lock);
+  flush_stack_call_func (mutex_lock_callback, lmutex);
+  if (lmutex->mutex.owner != current_thread)
+    /* We were signaled while waiting.  */
+    signal_pending_thread_error ();
+  return unbind_to (count, Qnil);
+}
+
+DEFUN ("mutex-unlock", Fmutex_unlock, Smutex_unlock, 1, 1, 0,
+       doc: /* Release the mutex.
+If this thread does not own MUTEX, signal an error.
+Otherwise, decrement the mutex's count.  If the count is zero,
+release MUTEX.   */)
+  (Lisp_Object mutex)
+{
+  CHECK_MUTEX (mutex);
+  lisp_mutex_unlock (&XMUTEX (mutex)->mutex);
+  return Qnil;
+}
+
+DEFUN ("mutex-name", Fmutex_name, Smutex_name, 1, 1, 0,
+       doc: /* Return the name of MUTEX.
+If no name was given when MUTEX was created, return nil.  */)
+  (Lisp_Object mutex)
+{
+  CHECK_MUTEX (mutex);
+  return XMUTEX (mutex)->name;
+}
+
+void
+finalize_one_mutex (struct Lisp_Mutex *mutex)
+{
+  sys_cond_destroy (&mutex->mutex.condition);
+}
+
+
+
+/* Condition variables.  */
+
+DEFUN ("make-condition-variable",
+       Fmake_condition_variable, Smake_condition_variable,
+       1, 2, 0,
+       doc: /* Make a condition variable associated with MUTEX.
+A condition variable provides a way for a thread to sleep while
+waiting for a state change.
+
+MUTEX is the mutex associated with this condition variable.
+NAME, if given, is the name of this condition variable.  The name is
+informational only.  */)
+  (Lisp_Object mutex, Lisp_Object name)
+{
+  struct Lisp_CondVar *condvar;
+  Lisp_Object result;
+  size_t offset = offsetof (struct Lisp_CondVar, cond);
+
+  CHECK_MUTEX (mutex);
+  if (!NILP (name))
+    CHECK_STRING (name);
+
+  condvar = ALLOCATE_PSEUDOVECTOR (struct Lisp_CondVar, cond, PVEC_CONDVAR);
+  memset ((char *) condvar + offset, 0,
+	  sizeof (struct Lisp_CondVar) - offset);
+  condvar->mutex = mutex;
+  condvar->name = name;
+  sys_cond_init (&condvar->cond);
+
+  XSETCONDVAR (result, condvar);
+  return result;
+}
+
+DEFUN ("condition-variable-p", Fcondition_variable_p, Scondition_variable_p,
+       1, 1, 0,
+       doc: /* Return t if OBJECT is a condition variable.  */)
+  (Lisp_Object object)
+{
+  return CONDVARP (object) ? Qt : Qnil;
+}
+
+static void
+condition_wait_callback (void *arg)
+{
+  struct Lisp_CondVar *cvar = arg;
+  struct Lisp_Mutex *mutex = XMUTEX (cvar->mutex);
+  struct thread_state *self = current_thread;
+  unsigned int saved_count;
+  Lisp_Object cond;
+
+  XSETCONDVAR (cond, cvar);
+  self->event_object = cond;
+  saved_count = lisp_mutex_unlock_for_wait (&mutex->mutex);
+  /* If we were signaled already, skip the wait, but still take back
+     the mutex.  */
+  if (NILP (self->error_symbol))
+    {
+      self->wait_condvar = &cvar->cond;
+      sys_cond_wait (&cvar->cond, &global_lock);
+      self->wait_condvar = NULL;
+    }
+  lisp_mutex_lock (&mutex->mutex, self, saved_count);
+  self->event_object = Qnil;
+  post_acquire_global_lock (self);
+}
+
+DEFUN ("condition-wait", Fcondition_wait, Scondition_wait, 1, 1, 0,
+       doc: /* Wait for the condition variable COND to be notified.
+COND is the condition variable to wait on.
+
+The mutex associated with COND must be held when this is called.
+It is an error if it is not held.
+
+This releases the mutex and waits for COND to be notified or for
+this thread to be signaled with `thread-signal'.  When
+`condition-wait' returns, COND's mutex will again be locked by
+this thread.  As a wakeup can be spurious, the caller should check
+again whether what it waits for has happened.  */)
+  (Lisp_Object cond)
+{
+  struct Lisp_CondVar *cvar;
+  struct Lisp_Mutex *mutex;
+
+  CHECK_CONDVAR (cond);
+  cvar = XCONDVAR (cond);
+
+  mutex = XMUTEX (cvar->mutex);
+  if (mutex->mutex.owner != current_thread)
+    error ("Condition variable's mutex is not held by current thread");
+
+  flush_stack_call_func (condition_wait_callback, cvar);
+  signal_pending_thread_error ();
+
+  return Qnil;
+}
+
+DEFUN ("condition-notify", Fcondition_notify, Scondition_notify, 1, 2, 0,
+       doc: /* Notify COND, a condition variable.
+This wakes a thread waiting on COND.
+If ALL is non-nil, all waiting threads are awoken.
+
+The mutex associated with COND must be held when this is called.
+It is an error if it is not held.
+
+The woken threads run only once the current thread releases the
+mutex.  */)
+  (Lisp_Object cond, Lisp_Object all)
+{
+  struct Lisp_CondVar *cvar;
+  struct Lisp_Mutex *mutex;
+
+  CHECK_CONDVAR (cond);
+  cvar = XCONDVAR (cond);
+
+  mutex = XMUTEX (cvar->mutex);
+  if (mutex->mutex.owner != current_thread)
+    error ("Condition variable's mutex is not held by current thread");
+
+  if (NILP (all))
+    sys_cond_signal (&cvar->cond);
+  else
+    sys_cond_broadcast (&cvar->cond);
+
+  return Qnil;
+}
+
+DEFUN ("condition-mutex", Fcondition_mutex, Scondition_mutex, 1, 1, 0,
+       doc: /* Return the mutex associated with condition variable COND.  */)
+  (Lisp_Object cond)
+{
+  CHECK_CONDVAR (cond);
+  return XCONDVAR (cond)->mutex;
+}
+
+DEFUN ("condition-name", Fcondition_name, Scondition_name, 1, 1, 0,
+       doc: /* Return the name of condition variable COND.
+If no name was given when COND was created, return nil.  */)
+  (Lisp_Object cond)
+{
+  CHECK_CONDVAR (cond);
+  return XCONDVAR (cond)->name;
+}
+
+void
+finalize_one_condvar (struct Lisp_CondVar *condvar)
+{
+  sys_cond_destroy (&condvar->cond);
+}
+
+
+
+/* Waiting for input without the global lock.  */
+
+struct select_args
+{
+  select_func *func;
+  int max_fds;
+  fd_set *rfds;
+  fd_set *wfds;
+  fd_set *efds;
+  struct timespec *timeout;
+  sigset_t *sigmask;
+  int result;
+};
+
+static void
+really_call_select (void *arg)
+{
+  struct select_args *sa = arg;
+  struct thread_state *self = current_thread;
+  sigset_t oldset;
+
+  block_interrupt_signal (&oldset);
+  self->not_holding_lock = true;
+  release_global_lock ();
+  restore_signal_mask (&oldset);
+
+  sa->result = (sa->func) (sa->max_fds, sa->rfds, sa->wfds, sa->efds,
+			   sa->timeout, sa->sigmask);
+
+  /* The SIGINT handler may have taken back the lock already.  */
+  block_interrupt_signal (&oldset);
+  if (self->not_holding_lock)
+    acquire_global_lock (self);
+  restore_signal_mask (&oldset);
+}
+
+/* Call FUNC, which is pselect or a function like it, with the other
+   arguments, letting other threads run while it waits.  */
+
+int
+thread_select (select_func *func, int max_fds, fd_set *rfds,
+	       fd_set *wfds, fd_set *efds, struct timespec *timeout,
+	       sigset_t *sigmask)
+{
+  struct select_args sa;
+
+  sa.func = func;
+  sa.max_fds = max_fds;
+  sa.rfds = rfds;
+  sa.wfds = wfds;
+  sa.efds = efds;
+  sa.timeout = timeout;
+  sa.sigmask = sigmask;
+  flush_stack_call_func (really_call_select, &sa);
+  signal_pending_thread_error ();
+  return sa.result;
+}
+
+struct read_args
+{
+  int fd;
+  void *buf;
+  ptrdiff_t nbyte;
+  ptrdiff_t result;
+  int error;
+};
+
+static void
+really_call_read (void *arg)
+{
+  struct read_args *ra = arg;
+  struct thread_state *self = current_thread;
+  sigset_t oldset;
+
+  block_interrupt_signal (&oldset);
+  self->not_holding_lock = true;
+  release_global_lock ();
+  restore_signal_mask (&oldset);
+
+  ra->result = read (ra->fd, ra->buf, ra->nbyte);
+  ra->error = errno;
+
+  block_interrupt_signal (&oldset);
+  if (self->not_holding_lock)
+    acquire_global_lock (self);
+  restore_signal_mask (&oldset);
+}
+
+/* Read up to NBYTE bytes from FD into BUF like emacs_read, letting
+   other threads run while the read blocks.  BUF must not be in memory
+   that another thread might move or free, such as buffer text.  */
+
+ptrdiff_t
+thread_read (int fd, void *buf, ptrdiff_t nbyte)
+{
+  struct read_args ra;
+
+  /* There is no need to check nbyte against MAX_RW_COUNT here, for
+     the same reason as in emacs_read.  */
+  ra.fd = fd;
+  ra.buf = buf;
+  ra.nbyte = nbyte;
+  do
+    {
+      flush_stack_call_func (really_call_read, &ra);
+      signal_pending_thread_error ();
+      if (ra.result < 0 && ra.error == EINTR)
+	QUIT;
+    }
+  while (ra.result < 0 && ra.error == EINTR);
+
+  errno = ra.error;
+  return ra.result;
+}
+
+
+
+/* Threads.  */
+
+static void
+yield_callback (void *ignore)
+{
+  struct thread_state *self = current_thread;
+
+  release_global_lock ();
+  sys_thread_yield ();
+  acquire_global_lock (self);
+}
+
+DEFUN ("thread-yield", Fthread_yield, Sthread_yield, 0, 0, 0,
+       doc: /* Yield the CPU to another thread.  */)
+     (void)
+{
+  flush_stack_call_func (yield_callback, NULL);
+  signal_pending_thread_error ();
+  return Qnil;
+}
+
+static Lisp_Object
+invoke_thread_function (void)
+{
+  ptrdiff_t count = SPECPDL_INDEX ();
+
+  signal_pending_thread_error ();
+  current_thread->result = Ffuncall (1, &current_thread->function);
+  return unbind_to (count, Qnil);
+}
+
+static Lisp_Object
+record_thread_error (Lisp_Object error_form)
+{
+  last_thread_error = error_form;
+  return error_form;
+}
+
+static void *
+run_thread (void *state)
+{
+  struct thread_state *self = state;
+  struct thread_state **iter;
+  struct handler *c, *c_next;
+  char stack_pos;
+
+  acquire_global_lock (self);
+
+  /* Fill in the stack only now, so that a garbage collection in the
+     thread holding the lock never sees half of it.  */
+  self->m_stack_bottom = self->stack_top = &stack_pos;
+  self->thread_id = sys_thread_self ();
+
+  /* Put a dummy catcher at top-level so that handlerlist is never NULL.
+     This is important since handlerlist->nextfree holds the freelist
+     which would otherwise leak every time we unwind back to top-level.   */
+  init_handlerlist ();
+
+  internal_condition_case (invoke_thread_function, Qt, record_thread_error);
+
+  update_processes_for_thread_death (Fcurrent_thread ());
+
+  /* Mark the thread dead.  It stays current_thread until another
+     thread takes the lock, which then has no bindings of this thread
+     to undo.  */
+  xfree (self->m_specpdl - 1);
+  self->m_specpdl = self->m_specpdl_ptr = NULL;
+  self->m_specpdl_size = 0;
+
+  for (c = handlerlist_sentinel; c; c = c_next)
+    {
+      c_next = c->nextfree;
+      xfree (c);
+    }
+  self->m_handlerlist = self->m_handlerlist_sentinel = NULL;
+
+  xfree (self->m_search_regs.start);
+  xfree (self->m_search_regs.end);
+  xfree (self->m_saved_search_regs.start);
+  xfree (self->m_saved_search_regs.end);
+  memset (&self->m_search_regs, 0, sizeof self->m_search_regs);
+  memset (&self->m_saved_search_regs, 0, sizeof self->m_saved_search_regs);
+
+  /* Unlink this thread from the list of all threads.  */
+  for (iter = &all_threads; *iter != self; iter = &(*iter)->next_thread)
+    ;
+  *iter = (*iter)->next_thread;
+
+  sys_cond_broadcast (&self->thread_condvar);
+
+  release_global_lock ();
+
+  return NULL;
+}
+
+void
+finalize_one_thread (struct thread_state *state)
+{
+  sys_cond_destroy (&state->thread_condvar);
+}
+
+DEFUN ("make-thread", Fmake_thread, Smake_thread, 1, 2, 0,
+       doc: /* Start a new thread and run FUNCTION in it.
+When the function exits, the thread dies.
+If NAME is given, it must be a string; it names the new thread.
+
+Only one thread runs Lisp at a time.  The others get a chance to run
+when it waits for input or for a subprocess, and when it calls
+`thread-yield', `thread-join', `mutex-lock' or `condition-wait'.
+Each thread has its own dynamic bindings and current buffer; it
+starts in the current buffer of the thread that created it.  */)
+  (Lisp_Object function, Lisp_Object name)
+{
+  sys_thread_t thr;
+  struct thread_state *new_thread;
+  Lisp_Object result;
+  size_t offset = offsetof (struct thread_state, m_stack_bottom);
+
+  /* A dumped Emacs cannot have threads in it.  */
+  if (!NILP (Vpurify_flag))
+    error ("Cannot start a thread while preparing to dump");
+
+  if (!NILP (name))
+    CHECK_STRING (name);
+
+  new_thread = ALLOCATE_PSEUDOVECTOR (struct thread_state, m_stack_bottom,
+				      PVEC_THREAD);
+  memset ((char *) new_thread + offset, 0,
+	  sizeof (struct thread_state) - offset);
+
+  new_thread->function = function;
+  new_thread->name = name;
+  new_thread->m_current_buffer = current_thread->m_current_buffer;
+
+  new_thread->m_specpdl_size = 50;
+  new_thread->m_specpdl = xmalloc ((1 + new_thread->m_specpdl_size)
+				   * sizeof (union specbinding));
+  /* Skip the dummy entry.  */
+  ++new_thread->m_specpdl;
+  new_thread->m_specpdl_ptr = new_thread->m_specpdl;
+
+  sys_cond_init (&new_thread->thread_condvar);
+
+  new_thread->next_thread = all_threads;
+  all_threads = new_thread;
+
+#if !defined DOUG_LEA_MALLOC && defined HAVE_PTHREAD \
+  && !defined SYSTEM_MALLOC && !defined HYBRID_MALLOC
+  /* A batch Emacs may not have made malloc thread-safe yet.  */
+  malloc_enable_thread ();
+#endif
+
+  if (!sys_thread_create (&thr, run_thread, new_thread))
+    {
+      /* Restore the previous situation.  */
+      all_threads = all_threads->next_thread;
+      xfree (new_thread->m_specpdl - 1);
+      new_thread->m_specpdl = new_thread->m_specpdl_ptr = NULL;
+      error ("Could not start a new thread");
+    }
+
+  XSETTHREAD (result, new_thread);
+  return result;
+}
+
+DEFUN ("current-thread", Fcurrent_thread, Scurrent_thread, 0, 0, 0,
+       doc: /* Return the current thread.  */)
+  (void)
+{
+  Lisp_Object result;
+  XSETTHREAD (result, current_thread);
+  return result;
+}
+
+DEFUN ("thread-name", Fthread_name, Sthread_name, 1, 1, 0,
+       doc: /* Return the name of the THREAD.
+The name is the same object that was passed to `make-thread'.  */)
+     (Lisp_Object thread)
+{
+  CHECK_THREAD (thread);
+  return XTHREAD (thread)->name;
+}
+
+DEFUN ("thread-signal", Fthread_signal, Sthread_signal, 3, 3, 0,
+       doc: /* Signal an error in a thread.
+This acts like `signal', but arranges for the signal to be raised
+in THREAD.  If THREAD is the current thread, acts just like `signal'.
+This will interrupt a blocked call to `mutex-lock', `condition-wait',
+or `thread-join' in the target thread; a thread waiting for input
+sees the signal when its wait ends.  */)
+  (Lisp_Object thread, Lisp_Object error_symbol, Lisp_Object data)
+{
+  struct thread_state *tstate;
+
+  CHECK_THREAD (thread);
+  tstate = XTHREAD (thread);
+
+  if (tstate == current_thread)
+    Fsignal (error_symbol, data);
+
+  tstate->error_symbol = error_symbol;
+  tstate->error_data = data;
+
+  if (tstate->wait_condvar)
+    sys_cond_broadcast (tstate->wait_condvar);
+
+  return Qnil;
+}
+
+static bool
+thread_alive_p (struct thread_state *tstate)
+{
+  return tstate->m_specpdl != NULL;
+}
+
+DEFUN ("threadp", Fthreadp, Sthreadp, 1, 1, 0,
+       doc: /* Return t if OBJECT is a thread.  */)
+  (Lisp_Object object)
+{
+  return THREADP (object) ? Qt : Qnil;
+}
+
+DEFUN ("thread-alive-p", Fthread_alive_p, Sthread_alive_p, 1, 1, 0,
+       doc: /* Return t if THREAD is alive, or nil if it has exited.  */)
+  (Lisp_Object thread)
+{
+  CHECK_THREAD (thread);
+  return thread_alive_p (XTHREAD (thread)) ? Qt : Qnil;
+}
+
+DEFUN ("thread--blocker", Fthread_blocker, Sthread_blocker, 1, 1, 0,
+       doc: /* Return the object that THREAD is blocking on.
+If THREAD is blocked in `thread-join' on a second thread, return that
+thread.
+If THREAD is blocked in `mutex-lock', return the mutex.
+If THREAD is blocked in `condition-wait', return the condition variable.
+Otherwise, if THREAD is not blocked, return nil.  */)
+  (Lisp_Object thread)
+{
+  CHECK_THREAD (thread);
+  return XTHREAD (thread)->event_object;
+}
+
+static void
+thread_join_callback (void *arg)
+{
+  struct thread_state *tstate = arg;
+  struct thread_state *self = current_thread;
+  Lisp_Object thread;
+
+  XSETTHREAD (thread, tstate);
+  self->event_object = thread;
+  self->wait_condvar = &tstate->thread_condvar;
+  while (thread_alive_p (tstate) && NILP (self->error_symbol))
+    sys_cond_wait (self->wait_condvar, &global_lock);
+
+  self->wait_condvar = NULL;
+  self->event_object = Qnil;
+  post_acquire_global_lock (self);
+}
+
+DEFUN ("thread-join", Fthread_join, Sthread_join, 1, 1, 0,
+       doc: /* Wait for THREAD to exit.
+This blocks the current thread until THREAD exits or until the current
+thread is signaled.  Return the value that the function of THREAD
+returned, or nil if THREAD exited because of an error.  It is an
+error for a thread to try to join itself.  */)
+  (Lisp_Object thread)
+{
+  struct thread_state *tstate;
+
+  CHECK_THREAD (thread);
+  tstate = XTHREAD (thread);
+
+  if (tstate == current_thread)
+    error ("Cannot join current thread");
+
+  if (thread_alive_p (tstate))
+    {
+      flush_stack_call_func (thread_join_callback, tstate);
+      signal_pending_thread_error ();
+    }
+
+  return tstate->result;
+}
+
+DEFUN ("all-threads", Fall_threads, Sall_threads, 0, 0, 0,
+       doc: /* Return a list of all the live threads.  */)
+  (void)
+{
+  Lisp_Object result = Qnil;
+  struct thread_state *iter;
+
+  for (iter = all_threads; iter; iter = iter->next_thread)
+    {
+      if (thread_alive_p (iter))
+	{
+	  Lisp_Object thread;
+
+	  XSETTHREAD (thread, iter);
+	  result = Fcons (thread, result);
+	}
+    }
+
+  return result;
+}
+
+DEFUN ("thread-last-error", Fthread_last_error, Sthread_last_error, 0, 0, 0,
+       doc: /* Return the last error form recorded by a dying thread.
+This is of the form (ERROR-SYMBOL . DATA).  */)
+  (void)
+{
+  return last_thread_error;
+}
+
+
+
+/* Return true if BUFFER is the current buffer of a thread other than
+   the current one; such a buffer must not be killed.  */
+
+bool
+thread_check_current_buffer (struct buffer *buffer)
+{
+  struct thread_state *iter;
+
+  for (iter = all_threads; iter; iter = iter->next_thread)
+    {
+      if (iter == current_thread)
+	continue;
+
+      if (iter->m_current_buffer == buffer)
+	return true;
+    }
+
+  return false;
+}
+
+bool
+main_thread_p (void *ptr)
+{
+  return ptr == &main_thread;
+}
+
+
+
+/* Mark what thread THREAD refers to outside its Lisp slots: its
+   bindings, handlers, current buffer and stack.  */
+
+static void
+mark_one_thread (struct thread_state *thread)
+{
+  struct handler *handler;
+  Lisp_Object tem;
+
+  mark_specpdl (thread->m_specpdl, thread->m_specpdl_ptr);
+
+#if (GC_MARK_STACK == GC_MAKE_GCPROS_NOOPS \
+     || GC_MARK_STACK == GC_MARK_STACK_CHECK_GCPROS)
+  if (thread->m_stack_bottom)
+    mark_stack (thread->m_stack_bottom, thread->stack_top);
+#else
+  {
+    struct gcpro *tail;
+    ptrdiff_t i;
+
+    for (tail = thread->m_gcprolist; tail; tail = tail->next)
+      for (i = 0; i < tail->nvars; i++)
+	mark_object (tail->var[i]);
+  }
+#if BYTE_MARK_STACK
+  mark_byte_stack (thread->m_byte_stack_list);
+#endif
+#endif
+
+  for (handler = thread->m_handlerlist; handler; handler = handler->next)
+    {
+      mark_object (handler->tag_or_ch);
+      mark_object (handler->val);
+    }
+
+#if GC_MARK_STACK == GC_USE_GCPROS_CHECK_ZOMBIES
+  if (thread->m_stack_bottom)
+    mark_stack (thread->m_stack_bottom, thread->stack_top);
+#endif
+
+  if (thread->m_current_buffer)
+    {
+      XSETBUFFER (tem, thread->m_current_buffer);
+      mark_object (tem);
+    }
+}
+
+/* Mark all the live threads.  Called during GC.  */
+
+void
+mark_threads (void)
+{
+  struct thread_state *iter;
+
+  for (iter = all_threads; iter; iter = iter->next_thread)
+    {
+      Lisp_Object thread;
+
+      XSETTHREAD (thread, iter);
+      mark_object (thread);
+      mark_one_thread (iter);
+    }
+}
+
+/* Undo what mark_threads did to objects that are not swept.  */
+
+void
+unmark_threads (void)
+{
+  struct thread_state *iter;
+
+  for (iter = all_threads; iter; iter = iter->next_thread)
+    unmark_byte_stack (iter->m_byte_stack_list);
+
+  main_thread.header.size &= ~ARRAY_MARK_FLAG;
+}
+
+
+
+void
+init_threads_once (void)
+{
+  XSETPVECTYPESIZE (&main_thread, PVEC_THREAD,
+		    PSEUDOVECSIZE (struct thread_state, m_stack_bottom),
+		    (VECSIZE (struct thread_state)
+		     - PSEUDOVECSIZE (struct thread_state, m_stack_bottom)));
+  main_thread.m_last_thing_searched = Qnil;
+  main_thread.m_saved_last_thing_searched = Qnil;
+  main_thread.name = Qnil;
+  main_thread.function = Qnil;
+  main_thread.result = Qnil;
+  main_thread.error_symbol = Qnil;
+  main_thread.error_data = Qnil;
+  main_thread.event_object = Qnil;
+}
+
+void
+init_threads (void)
+{
+  sys_mutex_init (&global_lock);
+  sys_cond_init (&main_thread.thread_condvar);
+  main_thread.m_stack_bottom = (char *) stack_base;
+  main_thread.thread_id = sys_thread_self ();
+  main_thread.not_holding_lock = false;
+  /* The main thread just takes the lock; there is no state to switch.  */
+  sys_mutex_lock (&global_lock);
+  current_thread = &main_thread;
+}
+
+void
+syms_of_threads (void)
+{
+  defsubr (&Sthread_yield);
+  defsubr (&Smake_thread);
+  defsubr (&Scurrent_thread);
+  defsubr (&Sthread_name);
+  defsubr (&Sthread_signal);
+  defsubr (&Sthreadp);
+  defsubr (&Sthread_alive_p);
+  defsubr (&Sthread_join);
+  defsubr (&Sthread_blocker);
+  defsubr (&Sall_threads);
+  defsubr (&Smake_mutex);
+  defsubr (&Smutexp);
+  defsubr (&Smutex_lock);
+  defsubr (&Smutex_unlock);
+  defsubr (&Smutex_name);
+  defsubr (&Smake_condition_variable);
+  defsubr (&Scondition_variable_p);
+  defsubr (&Scondition_wait);
+  defsubr (&Scondition_notify);
+  defsubr (&Scondition_mutex);
+  defsubr (&Scondition_name);
+  defsubr (&Sthread_last_error);
+
+  last_thread_error = Qnil;
+  staticpro (&last_thread_error);
+
+  DEFSYM (Qthreadp, "threadp");
+  DEFSYM (Qmutexp, "mutexp");
+  DEFSYM (Qcondition_variable_p, "condition-variable-p");
+}
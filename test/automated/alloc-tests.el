@@ -0,0 +1,242 @@
+;;; alloc-tests.el --- tests for src/alloc.c
+
+;; Copyright (C) 2014 Free Software Foundation, Inc.
+
+;; This file is part of GNU Emacs.
+
+;; This program is free software: you can redistribute it and/or
+;; modify it under the terms of the GNU General Public License as
+;; published by the Free Software Foundation, either version 3 of the
+;; License, or (at your option) any later version.
+;;
+;; This program is distributed in the hope that it will be useful, but
+;; WITHOUT ANY WARRANTY; without even the implied warranty of
+;; MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+;; General Public License for more details.
+;;
+;; You should have received a copy of the GNU General Public License
+;; along with this program.  If not, see `http://www.gnu.org/licenses/'.
+
+;;; Commentary:
+
+;;; Code:
+
+(require 'ert)
+
+(ert-deftest alloc-tests-deeply-nested ()
+  "GC must survive data nested far deeper than the C stack allows."
+  (let ((l nil) (v nil))
+    (dotimes (_ 500000)
+      (setq l (list l 1))
+      (setq v (vector v 1)))
+    (garbage-collect)
+    (should (> gc-mark-stack-max 0))
+    (let ((depth 0))
+      (while l
+        (setq l (car l) depth (1+ depth)))
+      (should (= depth 500000)))
+    (let ((depth 0))
+      (while v
+        (setq v (aref v 0) depth (1+ depth)))
+      (should (= depth 500000)))))
+
+;; Use a function, so that the garbage is not referenced from the
+;; stack of the caller.
+(defun alloc-tests--make-garbage ()
+  (dotimes (_ 10000)
+    (cons nil nil)))
+
+(ert-deftest alloc-tests-gc-history ()
+  "`garbage-collection-history' describes the last collection."
+  (garbage-collect)
+  (alloc-tests--make-garbage)
+  (garbage-collect)
+  (let ((last (car (garbage-collection-history))))
+    (should (= (cdr (assq 'number last)) (1- gcs-done)))
+    (should (eq (cdr (assq 'trigger last)) 'explicit))
+    (should (>= (cdr (assq 'pause last)) (cdr (assq 'mark last))))
+    (should (= (length (cdr (assq 'sweep last))) 8))
+    (should (>= (cdr (assq 'conses (cdr (assq 'reclaimed last))))
+                (* 10000 16)))))
+
+(ert-deftest alloc-tests-gc-adaptive-threshold ()
+  "Expensive collections make the next one wait for more consing."
+  (let ((threshold (lambda ()
+                     (cdr (assq 'threshold (car (garbage-collection-history))))))
+        base)
+    (let ((gc-target-overhead nil))
+      (garbage-collect)
+      (setq base (funcall threshold))
+      (should (>= base gc-cons-threshold)))
+    (let ((gc-target-overhead 0.0))
+      (dotimes (_ 4)
+        (garbage-collect))
+      (should (> (funcall threshold) base)))
+    (let ((gc-target-overhead nil))
+      (garbage-collect)
+      (should (< (abs (- (funcall threshold) base)) (/ base 10))))))
+
+(ert-deftest alloc-tests-heap-census ()
+  "`heap-census' finds a large vector, a hash table and a buffer."
+  (let ((v (make-vector 100000 nil))
+        (h (make-hash-table :size 1000))
+        census)
+    (puthash 'a 1 h)
+    (with-temp-buffer
+      (insert (make-string 1000 ?x))
+      (make-overlay 1 10)
+      (setq census (heap-census 3))
+      (let ((buf (cdr (assq (current-buffer)
+                            (cdr (assq 'buffers census))))))
+        (should (>= (cdr (assq 'text buf)) 1000))
+        (should (= (cadr (assq 'overlays buf)) 1))))
+    (should (eq (car (nth 0 (cdr (assq 'vectors census)))) v))
+    (should (= (length (cdr (assq 'vectors census))) 3))
+    (let ((table (assq h (cdr (assq 'hash-tables census)))))
+      (should (= (nth 1 table) 1))
+      (should (>= (nth 2 table) 1000)))
+    (should (>= (cadr (assq 'vector (cdr (assq 'types census)))) 1))))
+
+;; A vector this large is allocated on its own, and mapped on its own
+;; where malloc would not give its memory back to the system.
+(defconst alloc-tests--large-vector-length 100000)
+
+(defun alloc-tests--large-vectors ()
+  "Return (COUNT BYTES . MAPPED) for large vectors and the vector slots."
+  (list (cdr (assq 'large-vectors (heap-census 0)))
+        (nth 2 (assq 'vector-slots (garbage-collect)))))
+
+(ert-deftest alloc-tests-large-vector ()
+  "A large vector is counted alike by `heap-census' and `garbage-collect'."
+  (let* ((before (alloc-tests--large-vectors))
+         (v (make-vector alloc-tests--large-vector-length nil))
+         (during (alloc-tests--large-vectors))
+         (bytes (- (nth 1 (car during)) (nth 1 (car before))))
+         (mapped (- (nthcdr 2 (car during)) (nthcdr 2 (car before)))))
+    (should (= (car (car during)) (1+ (car (car before)))))
+    (should (> bytes (* alloc-tests--large-vector-length 4)))
+    ;; The vector has a mapping of its own, unless malloc maps large
+    ;; objects by itself and no large vector is ever mapped.
+    (should (or (>= mapped bytes)
+                (= (nthcdr 2 (car during)) 0)))
+    (should (= (* (- (nth 1 during) (nth 1 before))
+                  (nth 1 (assq 'vector-slots (garbage-collect))))
+               bytes))
+    (should (= (length v) alloc-tests--large-vector-length))
+    (setq v nil)
+    (let ((after (alloc-tests--large-vectors)))
+      (should (equal after before)))))
+
+(defun alloc-tests--make-floats ()
+  (dotimes (i 100000)
+    (float i)))
+
+(ert-deftest alloc-tests-memory-profiler ()
+  "The memory profiler records the kind of object allocated."
+  (let ((profiler-memory-sampling-interval 1024)
+        log found)
+    (profiler-memory-log)
+    (profiler-memory-start)
+    (unwind-protect
+        (alloc-tests--make-floats)
+      (profiler-memory-stop))
+    (setq log (profiler-memory-log))
+    (maphash (lambda (backtrace _count)
+               (when (and (eq (aref backtrace 0) 'floats)
+                          (memq 'alloc-tests--make-floats
+                                (append backtrace nil)))
+                 (setq found t)))
+             log)
+    (should found)))
+
+(ert-deftest alloc-tests-deduplicate-strings ()
+  "Strings whose contents are shared can still be modified separately."
+  (let* ((gc-deduplicate-strings t)
+         ;; Sweeping strings in several threads must not lose track of
+         ;; which shared data are still in use.
+         (gc-sweep-threads 4)
+         (base "deduplicated string contents")
+         (strings (mapcar (lambda (_) (copy-sequence base))
+                          (make-list 10 nil)))
+         (multi (list (string ?é ?a) (string ?é ?a))))
+    (garbage-collect)
+    (alloc-tests--make-garbage)
+    (garbage-collect)
+    (aset (nth 0 strings) 0 ?D)
+    (fillarray (nth 1 strings) ?x)
+    (clear-string (nth 2 strings))
+    (aset (car multi) 1 ?ü)
+    (garbage-collect)
+    (should (equal (nth 0 strings) "Deduplicated string contents"))
+    (should (equal (nth 1 strings) (make-string (length base) ?x)))
+    (should (equal (nth 2 strings) (make-string (length base) 0)))
+    (dolist (s (nthcdr 3 strings))
+      (should (equal s base)))
+    (should (equal multi (list (string ?é ?ü) (string ?é ?a))))))
+
+(defun alloc-tests--weak-chain (table n)
+  "Add a chain of N entries to TABLE and return the first key.
+Each key but the first is reachable only through the previous entry."
+  (let* ((root (list 0))
+         (prev root))
+    (dotimes (i n)
+      (let ((key (list (1+ i))))
+        (puthash prev key table)
+        (setq prev key)))
+    root))
+
+(ert-deftest alloc-tests-weak-hash-tables ()
+  "Entries of key-weak tables behave as ephemerons."
+  (let ((table (make-hash-table :test 'eq :weakness 'key))
+        (kept (list 'kept))
+        (anchor (list 'anchor))
+        (root nil))
+    (setq root (alloc-tests--weak-chain table 1000))
+    ;; The value of an entry that refers to its own key does not keep
+    ;; the entry alive.
+    (dotimes (_ 10)
+      (let ((key (list 'garbage)))
+        (puthash key (list key) table)))
+    ;; A weak table reachable only through an entry of another one.
+    (let ((inner (make-hash-table :test 'eq :weakness 'key)))
+      (puthash kept (list 'value) inner)
+      (puthash (list 'doomed) 'value inner)
+      (puthash anchor inner table))
+    (garbage-collect)
+    (should (= (hash-table-count table) 1001))
+    (let ((inner (gethash anchor table)))
+      (should (= (hash-table-count inner) 1))
+      (should (equal (gethash kept inner) '(value))))
+    (should (equal (gethash root table) '(1)))))
+
+(ert-deftest alloc-tests-weak-hash-tables-threads ()
+  "Conses marked by the GC threads fire their ephemerons."
+  (let ((gc-threads 4)
+        (table (make-hash-table :test 'eq :weakness 'key))
+        ;; Enough keys for the GC threads to mark them in parallel.
+        (roots (make-vector 5000 nil))
+        (junk nil))
+    ;; Chains of 4 entries, where each key is buried at the end of the
+    ;; value of the previous entry.  The entries are made last to
+    ;; first, so that the table is looked at before most keys are
+    ;; found to be reachable.
+    (dotimes (i (length roots))
+      (let ((next (list i 3)))
+        (dotimes (k 4)
+          (let* ((j (- 3 k))
+                 (key (if (zerop j) (aset roots i (list i)) (list i (1- j)))))
+            (puthash key (nconc (make-list 10 j) (list next)) table)
+            (setq next key)))))
+    (garbage-collect)
+    ;; Reuse whatever was freed, so that values freed by mistake change.
+    (setq junk (make-list 200000 'junk))
+    (should (= (hash-table-count table) (* 4 (length roots))))
+    (dotimes (i (length roots))
+      (let ((key (aref roots i)))
+        (dotimes (j 4)
+          (let ((value (gethash key table)))
+            (should (equal (butlast value) (make-list 10 j)))
+            (setq key (car (last value)))
+            (should (equal key (list i j)))))))))
+
+;;; alloc-tests.el ends here
@@ -275,6 +275,288 @@ bytecompiled code, and their results compared.")
   (dolist (pat byte-opt-testsuite-arith-data)
     (should (bytecomp-check-1 pat))))
 
+;; Code with frequent pairs of instructions, with values for which
+;; they do the usual thing and values for which they do not.
+(defconst bytecomp-tests--instruction-pair-data
+  '((let ((l '(1 2 3)) (n 0))
+      (while l (setq n (+ n (car l)) l (cdr l)))
+      n)
+    (let ((l '(a b c b)) r)
+      (while l (if (eq (car l) 'b) (setq r (cons l r))) (setq l (cdr l)))
+      r)
+    (let ((l '(a b c)) r)
+      (while l (or (eq (car l) 'b) (setq r (cons (car l) r))) (setq l (cdr l)))
+      r)
+    (let ((x '(1 2))) (list (car x) (cdr x) (car (cdr x))))
+    (let ((x nil)) (list (car x) (cdr x) (car (cdr x))))
+    (let ((x '(1 . 2))) (car (cdr x)))
+    (let ((x 3)) (car x))
+    (let ((x 3)) (cdr x))
+    (let ((x (list 1 2)) y) (setq y (car x)) (setq x (cdr x)) (list x y))
+    (let ((x 'a)) (if (eq x 'a) (list x) x))
+    (let ((x "a")) (and x (list x)))
+    (let ((x nil)) (and x (list x)))))
+
+(ert-deftest bytecomp-tests-instruction-pairs ()
+  "Test code with frequent pairs of instructions."
+  (dolist (lexical-binding '(nil t))
+    (dolist (pat bytecomp-tests--instruction-pair-data)
+      (should (bytecomp-check-1 pat))))
+  (should-error (funcall (byte-compile '(lambda (x) (car (cdr x)))) '(1 . 2))
+                :type 'wrong-type-argument))
+
+(defun bytecomp-tests--run-byte-code (code constants depth &rest args)
+  "Call byte-code CODE with CONSTANTS and stack DEPTH on ARGS.
+Call it with `byte-metering-on' both nil and t, and check that it
+returns the same value both times.  Return that value."
+  (let ((f (make-byte-code (+ (length args) (ash (length args) 8))
+                           code constants depth))
+        value)
+    (setq value (let ((byte-metering-on nil)) (apply f args)))
+    (should (equal (let ((byte-metering-on t)) (apply f args)) value))
+    value))
+
+(ert-deftest bytecomp-tests-jumps ()
+  "Test jumps in hand-written byte-code."
+  ;; Relative jumps, forward and backward: count the elements of a list.
+  ;;  0 stack-ref 1; 1 Rgoto-if-nil 10; 3 add1; 4 stack-ref 1; 5 cdr;
+  ;;  6 stack-set 2; 8 Rgoto 0; 10 return
+  (dolist (l '(nil (a) (a b c)))
+    (should (= (bytecomp-tests--run-byte-code
+                "\1\253\207\124\1\101\262\2\252\166\207" [] 3 l 0)
+               (length l))))
+  ;; Jumps into the second half of a pair of instructions: goto-if-nil,
+  ;; or Rgoto-if-nil, skips the cdr of cdr and car.
+  ;;  0 stack-ref 1; 1 stack-ref 1; 2 goto-if-nil 6 or Rgoto-if-nil 5;
+  ;;  cdr; car; return
+  (dolist (flag '(nil t))
+    (should (eq (bytecomp-tests--run-byte-code
+                 "\1\1\203\6\0\101\100\207" [] 4 '(a b) flag)
+                (if flag 'b 'a)))
+    (should (eq (bytecomp-tests--run-byte-code
+                 "\1\1\253\201\101\100\207" [] 4 '(a b) flag)
+                (if flag 'b 'a))))
+  ;; The goto-if-nil of dup and goto-if-nil, jumped to from a goto.
+  ;;  0 constant 0; 1 dup; 2 goto 6; 5 dup; 6 goto-if-nil 10; 9 return;
+  ;;  10 constant 1; 11 return
+  (dolist (c '(nil t))
+    (should (eq (bytecomp-tests--run-byte-code
+                 "\300\211\202\6\0\211\203\12\0\207\301\207" (vector c 'none) 3)
+                (if c c 'none)))))
+
+(ert-deftest bytecomp-tests-long-operands ()
+  "Test byte-code with two-byte operands."
+  (let ((constants (make-vector 301 'wrong)))
+    (aset constants 300 'right)
+    ;; constant2 300; return
+    (should (eq (bytecomp-tests--run-byte-code "\201\54\1\207" constants 1)
+                'right))
+    ;; constant2 300 and eq.
+    ;;  0 dup; 1 constant2 300; 4 eq; 5 return
+    (dolist (x '(right wrong))
+      (should (eq (bytecomp-tests--run-byte-code
+                   "\211\201\54\1\75\207" constants 3 x)
+                  (eq x 'right))))
+    ;; A jump to 300 over constant 0 instructions.
+    ;;  0 goto 300; 3 constant 0; ... 300 constant2 300; 303 return
+    (should (eq (bytecomp-tests--run-byte-code
+                 (concat "\202\54\1" (apply #'unibyte-string (make-list 297 #o300))
+                         "\201\54\1\207")
+                 constants 300)
+                'right))))
+
+(ert-deftest bytecomp-tests-byte-code-profiler ()
+  "Test counting instructions and calls of byte-code."
+  (let ((f (byte-compile '(lambda (l)
+                            (let ((n 0))
+                              (dolist (x l) (setq n (+ n (abs x))))
+                              n))))
+        entry)
+    (ignore (profiler-byte-code-log))
+    (profiler-byte-code-start)
+    (unwind-protect
+        (should (= (funcall f '(1 -2 3)) 6))
+      (profiler-byte-code-stop))
+    (dolist (e (profiler-byte-code-log))
+      (when (eq (aref e 1) (aref f 1))
+        (setq entry e)))
+    (should entry)
+    (should (eq (aref entry 0) f))
+    (should (= (length (aref entry 3)) (length (aref f 1))))
+    (should (= (aref (aref entry 3) 0) 1))
+    (should (equal (aref entry 4) '((abs . 3))))
+    (should-not (profiler-byte-code-log))))
+
+(ert-deftest bytecomp-tests-call-caches ()
+  "Test that calls from byte-code see new function definitions."
+  (let ((f (byte-compile '(lambda (g x)
+                            (list (bytecomp-tests--callee x) (funcall g x))))))
+    (unwind-protect
+        (progn
+          (fset 'bytecomp-tests--callee (byte-compile '(lambda (x) (1+ x))))
+          (should (equal (funcall f #'1- 5) '(6 4)))
+          (should (equal (funcall f #'- 5) '(6 -5)))
+          (fset 'bytecomp-tests--callee (byte-compile '(lambda (x) (* 2 x))))
+          (should (equal (funcall f #'1- 5) '(10 4)))
+          (defalias 'bytecomp-tests--callee #'1-)
+          (should (equal (funcall f #'1- 5) '(4 4)))
+          (fset 'bytecomp-tests--alias (lambda (x) (- x 10)))
+          (defalias 'bytecomp-tests--callee 'bytecomp-tests--alias)
+          (should (equal (funcall f #'1- 5) '(-5 4)))
+          (fset 'bytecomp-tests--alias #'abs)
+          (should (equal (funcall f #'1- -5) '(5 -6)))
+          ;; Subrs that take exactly the arguments passed, any number of
+          ;; them, optional ones and too many.
+          (defalias 'bytecomp-tests--callee #'number-to-string)
+          (should (equal (funcall f #'1- 5) '("5" 4)))
+          (defalias 'bytecomp-tests--callee #'list)
+          (should (equal (funcall f #'1- 5) '((5) 4)))
+          (defalias 'bytecomp-tests--callee #'prin1-to-string)
+          (should (equal (funcall f #'1- 5) '("5" 4)))
+          (defalias 'bytecomp-tests--callee #'cons)
+          (should-error (funcall f #'1- 5) :type 'wrong-number-of-arguments)
+          (defalias 'bytecomp-tests--callee #'make-byte-code)
+          (should-error (funcall f #'1- 5) :type 'wrong-number-of-arguments)
+          (fmakunbound 'bytecomp-tests--callee)
+          (should-error (funcall f #'1- 5) :type 'void-function))
+      (fmakunbound 'bytecomp-tests--callee)
+      (fmakunbound 'bytecomp-tests--alias))))
+
+(defvar bytecomp-tests--special nil)
+
+(ert-deftest bytecomp-tests-tail-calls ()
+  "Test calls that byte-code makes in place of returning."
+  (let ((lexical-binding t)
+        (n (* 10 max-lisp-eval-depth)))
+    (unwind-protect
+        (progn
+          (defalias 'bytecomp-tests--even
+            (byte-compile
+             '(lambda (n) (if (= n 0) t (bytecomp-tests--odd (1- n))))))
+          (defalias 'bytecomp-tests--odd
+            (byte-compile
+             '(lambda (n &optional _x)
+                (if (= n 0) nil (bytecomp-tests--even (1- n))))))
+          (should (bytecomp-tests--even n))
+          (should-not (bytecomp-tests--even (1+ n)))
+          ;; The backtrace shows the call that replaced the frame.
+          (defalias 'bytecomp-tests--odd
+            (byte-compile '(lambda (n) (backtrace-frame 1))))
+          (should (equal (bytecomp-tests--even 1) '(t bytecomp-tests--odd 0)))
+          ;; Dynamic bindings stay in effect for the call.
+          (defalias 'bytecomp-tests--odd
+            (byte-compile '(lambda (n) bytecomp-tests--special)))
+          (defalias 'bytecomp-tests--even
+            (byte-compile
+             '(lambda (n)
+                (let ((bytecomp-tests--special n))
+                  (bytecomp-tests--odd n)))))
+          (should (= (bytecomp-tests--even 3) 3)))
+      (fmakunbound 'bytecomp-tests--even)
+      (fmakunbound 'bytecomp-tests--odd))))
+
+(ert-deftest bytecomp-tests-compile-interpreted-functions ()
+  "Test compiling interpreted functions that are called often."
+  (let* ((interpreted-function-compile-threshold 3)
+         (internal--interpreted-functions-to-compile nil)
+         (square (eval '(lambda (x) (* x x)) t))
+         (counter (eval '(let ((k 0)) (lambda () (setq k (1+ k)))) t)))
+    (dotimes (i 5)
+      (should (= (funcall square i) (* i i)))
+      (should (= (funcall counter) (1+ i))))
+    (should (memq square internal--interpreted-functions-to-compile))
+    ;; A closure over a variable is never queued.
+    (should-not (memq counter internal--interpreted-functions-to-compile))
+    (setq internal--interpreted-functions-to-compile (list square))
+    (internal--compile-interpreted-functions)
+    (should (byte-code-function-p (internal--compiled-definition square)))
+    (should-not (internal--compiled-definition counter))
+    ;; The function object is unchanged and still computes the same.
+    (should (eq (car square) 'closure))
+    (should (= (funcall square 7) 49))))
+
+(ert-deftest bytecomp-tests-handlers ()
+  "Test handlers that byte-code pushes, several in one frame."
+  (let ((f (byte-compile
+            '(lambda (n)
+               (let ((log nil))
+                 (dotimes (i n)
+                   (push (condition-case err
+                             (catch 'tag
+                               (pcase (% i 3)
+                                 (0 (throw 'tag (list 'thrown i)))
+                                 (1 (car i))
+                                 (_ i)))
+                           (wrong-type-argument (list 'error i (car err))))
+                         log)
+                   (push (ignore-errors (/ 10 (- i 2))) log))
+                 (nreverse log))))))
+    (should (equal (funcall f 4)
+                   '((thrown 0) -5
+                     (error 1 wrong-type-argument) -10
+                     2 nil
+                     (thrown 3) 10))))
+  ;; A throw past handlers of several frames lands in the right one.
+  (let* ((inner (byte-compile
+                 '(lambda (tag)
+                    (condition-case nil
+                        (catch 'inner (throw tag 'outer))
+                      (error 'wrong)))))
+         (outer (byte-compile
+                 `(lambda ()
+                    (list (catch 'a (funcall ,inner 'a))
+                          (catch 'b (catch 'a (funcall ,inner 'b)))
+                          ;; `no-catch' is signaled in the inner frame.
+                          (funcall ,inner 'nowhere))))))
+    (should (equal (funcall outer) '(outer outer wrong)))))
+
+(defvar bytecomp-tests--kept-float nil)
+
+(defun bytecomp-tests--keep-float (x)
+  "Cons, collect garbage, save X in `bytecomp-tests--kept-float'; return X."
+  (make-list 100 (cons x x))
+  (garbage-collect)
+  (setq bytecomp-tests--kept-float x))
+
+(ert-deftest bytecomp-tests-float-arithmetic ()
+  "Test arithmetic on floats in byte-code."
+  (let ((lexical-binding t))
+    (let ((f (byte-compile
+              '(lambda (a b c)
+                 (let ((x (* a b)))
+                   (list x (+ x 1.0) x
+                         (1+ (* a (- b (/ c 2.0))))
+                         (- (+ a b))
+                         (/ a 0.0)
+                         (* 2 (1- c))))))))
+      (should (equal (funcall f 1.5 2 3)
+                     (list 3.0 4.0 3.0 1.75 -3.5 1.0e+INF 4)))
+      ;; A result that a variable holds is not reused.
+      (let ((x (funcall f 2.0 2.0 1.0)))
+        (should (eq (nth 0 x) (nth 2 x)))
+        (should (equal (nth 0 x) 4.0))))
+    (let ((g (byte-compile
+              '(lambda (n)
+                 (let ((sum 0.0) (squares nil))
+                   (dotimes (i n)
+                     (let ((sq (* (float i) i)))
+                       (push sq squares)
+                       (setq sum (+ sum (* sq 0.5)))))
+                   (list sum squares))))))
+      (should (equal (funcall g 4) '(7.0 (9.0 4.0 1.0 0.0)))))
+    (with-temp-buffer
+      (insert "abc")
+      (should (equal (funcall (byte-compile
+                               '(lambda (m) (list (+ m 0.5) (* 2.0 m))))
+                              (point-marker))
+                     '(4.5 8.0))))
+    ;; A result passed through a call is not reused either, even when
+    ;; the callee collects garbage before handing it back.
+    (let ((f (byte-compile
+              '(lambda (x) (- (bytecomp-tests--keep-float (+ x 1.0)))))))
+      (should (equal (funcall f 2.5) -3.5))
+      (should (equal bytecomp-tests--kept-float 3.5)))))
+
 (defun test-byte-opt-arithmetic (&optional arg)
   "Unit test for byte-opt arithmetic operations.
 Subtests signal errors if something goes wrong."
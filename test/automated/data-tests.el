@@ -255,3 +255,66 @@ comparing the subr with a much slower lisp implementation."
          (v2 (test-bool-vector-bv-from-hex-string "0000C"))
          (v3 (bool-vector-not v1)))
     (should (equal v2 v3))))
+
+(defvar data-tests--local nil)
+(make-variable-buffer-local 'data-tests--local)
+
+(ert-deftest data-tests-many-buffer-locals ()
+  "Local bindings are found however many there are in a buffer."
+  (let ((vars (cl-loop for i below 100
+                       collect (make-symbol (format "data-tests-%d" i)))))
+    (dolist (var vars)
+      (set var 'default))
+    (with-temp-buffer
+      (cl-loop for var in vars for i from 0
+               do (set (make-local-variable var) i))
+      (cl-loop for var in vars for i from 0
+               do (should (eq (symbol-value var) i))
+               (should (local-variable-p var)))
+      (let ((buffer (current-buffer)))
+        (with-temp-buffer
+          (cl-loop for var in vars for i from 0
+                   do (should (eq (symbol-value var) 'default))
+                   (should (eq (buffer-local-value var buffer) i))
+                   (should (local-variable-p var buffer)))))
+      (cl-loop for var in vars by #'cddr
+               do (kill-local-variable var))
+      (cl-loop for var in vars for i from 0
+               do (should (eq (symbol-value var)
+                              (if (cl-oddp i) i 'default)))))))
+
+(ert-deftest data-tests-buffer-locals-after-reset ()
+  "Bindings dropped by `kill-all-local-variables' are not found."
+  (with-temp-buffer
+    (setq data-tests--local 'local)
+    (kill-all-local-variables)
+    (should-not (local-variable-p 'data-tests--local))
+    (should (eq data-tests--local nil))
+    (setq data-tests--local 'again)
+    (should (eq data-tests--local 'again))
+    (should (eq (default-value 'data-tests--local) nil))))
+
+;;; The following is for benchmark testing of the lookup of
+;;; buffer-local variables, not for regression testing.
+
+(defun data-tests-benchmark-buffer-locals (&optional buffers locals)
+  "Switch among BUFFERS buffers with LOCALS local variables each.
+Read every local variable in each buffer, and return the result of
+`benchmark-run'.  BUFFERS defaults to 2000 and LOCALS to 50."
+  (let* ((vars (cl-loop for i below (or locals 50)
+                        collect (make-symbol (format "data-tests-%d" i))))
+         (list (cl-loop for i below (or buffers 2000)
+                        collect (generate-new-buffer " *data-tests*"))))
+    (unwind-protect
+        (progn
+          (dolist (buffer list)
+            (with-current-buffer buffer
+              (dolist (var vars)
+                (set (make-local-variable var) buffer))))
+          (benchmark-run 10
+            (dolist (buffer list)
+              (with-current-buffer buffer
+                (dolist (var vars)
+                  (symbol-value var))
+                (setq data-tests--local buffer)))))
+      (mapc #'kill-buffer list))))
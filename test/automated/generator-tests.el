@@ -0,0 +1,134 @@
+;;; generator-tests.el --- tests for generators and coroutines  -*- lexical-binding: t -*-
+
+;; Copyright (C) 2014 Free Software Foundation, Inc.
+
+;; This file is part of GNU Emacs.
+
+;; This program is free software: you can redistribute it and/or
+;; modify it under the terms of the GNU General Public License as
+;; published by the Free Software Foundation, either version 3 of the
+;; License, or (at your option) any later version.
+;;
+;; This program is distributed in the hope that it will be useful, but
+;; WITHOUT ANY WARRANTY; without even the implied warranty of
+;; MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+;; General Public License for more details.
+;;
+;; You should have received a copy of the GNU General Public License
+;; along with this program.  If not, see `http://www.gnu.org/licenses/'.
+
+;;; Commentary:
+
+;;; Code:
+
+(require 'ert)
+(require 'generator)
+
+(defvar generator-tests--special 'outer)
+(defvar generator-tests--log nil)
+
+(iter-defun generator-tests--range (n)
+  "Yield the numbers from 0 below N, and return `done'."
+  (let ((i 0))
+    (while (< i n)
+      (iter-yield i)
+      (setq i (1+ i)))
+    'done))
+
+;; Generators that use their arguments must be byte-compiled.
+(byte-compile 'generator-tests--range)
+
+(iter-defun generator-tests--guarded ()
+  (unwind-protect
+      (let ((generator-tests--special 'inner))
+        (condition-case err
+            (progn
+              (iter-yield generator-tests--special)
+              (error "Boom"))
+          (error (iter-yield (cadr err))))
+        (iter-yield (catch 'tag (iter-yield 'catch) (throw 'tag 'thrown))))
+    (push 'cleanup generator-tests--log)))
+
+(ert-deftest generator-tests-basic ()
+  (let ((it (generator-tests--range 2)))
+    (should (coroutinep it))
+    (should (= (iter-next it) 0))
+    (should (= (iter-next it) 1))
+    (should (equal (should-error (iter-next it)
+                                 :type 'iter-end-of-sequence)
+                   '(iter-end-of-sequence . done)))
+    (should-not (coroutine-live-p it))
+    (should-error (iter-next it) :type 'iter-end-of-sequence))
+  (let ((values nil))
+    (should (eq (iter-do (i (generator-tests--range 3))
+                  (push i values))
+                'done))
+    (should (equal values '(2 1 0)))))
+
+(ert-deftest generator-tests-send-values ()
+  (let ((it (funcall (iter-lambda ()
+                       (let ((x nil))
+                         (while t
+                           (setq x (iter-yield (list 'got x)))))))))
+    (should (equal (iter-next it 'ignored) '(got nil)))
+    (should (equal (iter-next it 1) '(got 1)))
+    (should (equal (iter-next it 2) '(got 2)))))
+
+(ert-deftest generator-tests-handlers-and-bindings ()
+  "Handlers and dynamic bindings are suspended with the generator."
+  (let ((it (generator-tests--guarded))
+        (generator-tests--log nil))
+    (should (eq (iter-next it) 'inner))
+    (should (eq generator-tests--special 'outer))
+    (garbage-collect)
+    (should (equal (iter-next it) "Boom"))
+    (should (eq (iter-next it) 'catch))
+    (should (eq (iter-next it) 'thrown))
+    (should-not generator-tests--log)
+    (should-error (iter-next it) :type 'iter-end-of-sequence)
+    (should (equal generator-tests--log '(cleanup)))))
+
+(ert-deftest generator-tests-close ()
+  (let ((it (generator-tests--guarded))
+        (generator-tests--log nil))
+    (iter-next it)
+    (iter-close it)
+    (should (equal generator-tests--log '(cleanup)))
+    (should (eq generator-tests--special 'outer))
+    (should-not (coroutine-live-p it))))
+
+(ert-deftest generator-tests-yield-from ()
+  (let ((values nil))
+    (iter-do (x (funcall (iter-lambda ()
+                           (iter-yield 'start)
+                           (iter-yield
+                            (iter-yield-from (generator-tests--range 2))))))
+      (push x values))
+    (should (equal values '(done 1 0 start)))))
+
+(ert-deftest generator-tests-errors ()
+  (let ((it (funcall (iter-lambda () (iter-yield 1) (car 'x)))))
+    (iter-next it)
+    (should-error (iter-next it) :type 'wrong-type-argument)
+    (should-not (coroutine-live-p it)))
+  (should-error (coroutine-yield 1))
+  (should-error (make-coroutine '(lambda () 1))))
+
+(ert-deftest generator-tests-interpreted ()
+  "Interpreted generators are compiled unless they use outer variables."
+  (let* ((lexical-binding t)
+         (gen (eval '(let ((unused 1))
+                       (iter-lambda () (iter-yield 'first) 'last))
+                    t))
+         (it (funcall gen)))
+    (should (eq (iter-next it) 'first))
+    (should (equal (should-error (iter-next it)
+                                 :type 'iter-end-of-sequence)
+                   '(iter-end-of-sequence . last))))
+  (let* ((lexical-binding t)
+         (gen (eval '(let ((count 0))
+                       (iter-lambda () (iter-yield (setq count (1+ count)))))
+                    t)))
+    (should-error (funcall gen))))
+
+;;; generator-tests.el ends here
@@ -0,0 +1,166 @@
+;;; thread-tests.el --- tests for Lisp threads  -*- lexical-binding: t -*-
+
+;; Copyright (C) 2014 Free Software Foundation, Inc.
+
+;; This file is part of GNU Emacs.
+
+;; This program is free software: you can redistribute it and/or
+;; modify it under the terms of the GNU General Public License as
+;; published by the Free Software Foundation, either version 3 of the
+;; License, or (at your option) any later version.
+;;
+;; This program is distributed in the hope that it will be useful, but
+;; WITHOUT ANY WARRANTY; without even the implied warranty of
+;; MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+;; General Public License for more details.
+;;
+;; You should have received a copy of the GNU General Public License
+;; along with this program.  If not, see `http://www.gnu.org/licenses/'.
+
+;;; Commentary:
+
+;;; Code:
+
+(require 'ert)
+
+(defvar thread-tests--special 'global)
+(defvar-local thread-tests--local 'default)
+
+(ert-deftest thread-tests-basic ()
+  (should (threadp (current-thread)))
+  (should (thread-alive-p (current-thread)))
+  (should (memq (current-thread) (all-threads)))
+  (should-error (thread-join (current-thread)))
+  (let ((thread (make-thread (lambda () 'done) "worker")))
+    (should (threadp thread))
+    (should (eq (type-of thread) 'thread))
+    (should (equal (thread-name thread) "worker"))
+    (should (equal (prin1-to-string thread) "#<thread worker>"))
+    (should (eq (thread-join thread) 'done))
+    (should-not (thread-alive-p thread))
+    (should-not (memq thread (all-threads)))
+    (should (eq (thread-join thread) 'done))))
+
+(ert-deftest thread-tests-bindings ()
+  "Each thread sees its own dynamic bindings."
+  (let* ((seen nil)
+         (thread (make-thread
+                  (lambda ()
+                    (let ((thread-tests--special 'thread))
+                      (thread-yield)
+                      (garbage-collect)
+                      (push thread-tests--special seen))))))
+    (let ((thread-tests--special 'main))
+      (thread-yield)
+      (thread-join thread)
+      (should (eq thread-tests--special 'main)))
+    (should (equal seen '(thread)))
+    (should (eq thread-tests--special 'global))))
+
+(ert-deftest thread-tests-buffers ()
+  "A thread starts in the current buffer and keeps its own."
+  (with-temp-buffer
+    (setq thread-tests--local 'main-buffer)
+    (let* ((buffer (current-buffer))
+           (thread
+            (make-thread
+             (lambda ()
+               (let ((start (current-buffer)))
+                 (with-temp-buffer
+                   (thread-yield)
+                   (list start (eq (current-buffer) buffer)
+                         thread-tests--local)))))))
+      (thread-yield)
+      (should (eq (current-buffer) buffer))
+      (should (equal (thread-join thread) (list buffer nil 'default))))))
+
+(ert-deftest thread-tests-errors ()
+  (let ((thread (make-thread (lambda () (car 1)))))
+    (should-not (thread-join thread))
+    (should (equal (thread-last-error) '(wrong-type-argument listp 1)))))
+
+(ert-deftest thread-tests-mutex ()
+  (let ((mutex (make-mutex "lock"))
+        (log nil))
+    (should (mutexp mutex))
+    (should (equal (mutex-name mutex) "lock"))
+    (mutex-lock mutex)
+    (mutex-lock mutex)
+    (let ((thread (make-thread (lambda ()
+                                 (with-mutex mutex
+                                   (push 'thread log))))))
+      (thread-yield)
+      (should (eq (thread--blocker thread) mutex))
+      (push 'main log)
+      ;; The mutex was locked twice, so it is still held.
+      (mutex-unlock mutex)
+      (thread-yield)
+      (should (equal log '(main)))
+      (mutex-unlock mutex)
+      (thread-join thread))
+    (should (equal log '(thread main)))
+    (should-error (mutex-unlock mutex))))
+
+(ert-deftest thread-tests-condition-variable ()
+  (let* ((mutex (make-mutex))
+         (cond (make-condition-variable mutex "ready"))
+         (ready nil)
+         (thread (make-thread (lambda ()
+                                (with-mutex mutex
+                                  (while (not ready)
+                                    (condition-wait cond))
+                                  'woken)))))
+    (should (condition-variable-p cond))
+    (should (eq (condition-mutex cond) mutex))
+    (should (equal (condition-name cond) "ready"))
+    (should-error (condition-notify cond))
+    (thread-yield)
+    (with-mutex mutex
+      (setq ready t)
+      (condition-notify cond))
+    (should (eq (thread-join thread) 'woken))))
+
+(ert-deftest thread-tests-signal ()
+  "`thread-signal' interrupts a thread waiting on a condition variable."
+  (let* ((mutex (make-mutex))
+         (cond (make-condition-variable mutex))
+         (thread (make-thread (lambda ()
+                                (with-mutex mutex
+                                  (condition-wait cond))))))
+    (thread-yield)
+    (should (eq (thread--blocker thread) cond))
+    (thread-signal thread 'error '("stop"))
+    (thread-join thread)
+    (should (equal (thread-last-error) '(error "stop")))
+    (should-not (mutex-lock mutex))
+    (mutex-unlock mutex)))
+
+(ert-deftest thread-tests-process ()
+  "Waiting for a subprocess lets other threads run."
+  (skip-unless (executable-find "sh"))
+  (let* ((counter 0)
+         (done nil)
+         (thread (make-thread (lambda ()
+                                (while (not done)
+                                  (setq counter (1+ counter))
+                                  (thread-yield))))))
+    (with-temp-buffer
+      (let ((process (start-process "thread-tests" (current-buffer)
+                                    "sh" "-c" "sleep 0.3; echo out")))
+        (set-process-sentinel process #'ignore)
+        (set-process-query-on-exit-flag process nil)
+        (should (eq (process-thread process) (current-thread)))
+        (let ((tries 0))
+          (while (and (not (equal (buffer-string) "out\n"))
+                      (< (setq tries (1+ tries)) 20))
+            (accept-process-output process 1)))
+        (should (equal (buffer-string) "out\n"))
+        (delete-process process)))
+    (should (> counter 0))
+    (with-temp-buffer
+      (call-process "sh" nil t nil "-c" "echo call")
+      (should (equal (buffer-string) "call\n")))
+    (setq done t)
+    (thread-join thread)))
+
+;;; thread-tests.el ends here
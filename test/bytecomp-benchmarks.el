@@ -0,0 +1,57 @@
+;;; bytecomp-benchmarks.el --- benchmarks of byte-compiled code
+
+;; Copyright (C) 2014 Free Software Foundation, Inc.
+
+;; This file is part of GNU Emacs.
+
+;; GNU Emacs is free software: you can redistribute it and/or modify
+;; it under the terms of the GNU General Public License as published by
+;; the Free Software Foundation, either version 3 of the License, or
+;; (at your option) any later version.
+
+;; GNU Emacs is distributed in the hope that it will be useful,
+;; but WITHOUT ANY WARRANTY; without even the implied warranty of
+;; MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+;; GNU General Public License for more details.
+
+;; You should have received a copy of the GNU General Public License
+;; along with GNU Emacs.  If not, see <http://www.gnu.org/licenses/>.
+
+;;; Commentary:
+
+;; Functions that time byte-compiled code doing things the byte-code
+;; interpreter has fast paths for.  They are meant to be run by hand,
+;; on builds with and without a change to the interpreter, and are not
+;; regression tests.
+
+;;; Code:
+
+(defun bytecomp-benchmarks-floats (&optional n)
+  "Blend N colors with compiled float arithmetic; N defaults to 200000.
+Return the result of `benchmark-run'."
+  (let ((blend (byte-compile
+                '(lambda (n)
+                   (let ((r 0.0) (g 0.0) (b 0.0))
+                     (dotimes (i n)
+                       (let ((alpha (/ (% i 256) 255.0)))
+                         (setq r (+ (* alpha 0.8) (* (- 1.0 alpha) r))
+                               g (+ (* alpha 0.4) (* (- 1.0 alpha) g))
+                               b (+ (* alpha (/ i (float n)))
+                                    (* (- 1.0 alpha) b)))))
+                     (list r g b))))))
+    (benchmark-run 1 (funcall blend (or n 200000)))))
+
+(defun bytecomp-benchmarks-subr-calls (&optional n)
+  "Call subrs from byte-code 4 times in each of N iterations.
+N defaults to 3000000.  Return the result of `benchmark-run'."
+  (let ((f (byte-compile
+            '(lambda (n)
+               (let ((s 0))
+                 (dotimes (i n)
+                   (setq s (logxor s (ash (abs i) 1) (lsh i -1))))
+                 s)))))
+    (benchmark-run 1 (funcall f (or n 3000000)))))
+
+(provide 'bytecomp-benchmarks)
+
+;;; bytecomp-benchmarks.el ends here